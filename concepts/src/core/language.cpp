@@ -1063,6 +1063,20 @@ namespace neos::concepts::core
 //            neolib::make_ref<language_type_integer<neonumerical::xxx>>();
         concepts()[neolib::string{ language_type_string<char>::Name }] =
             neolib::make_ref<language_type_string<char>>();
+        concepts()[neolib::string{ "language.type.auto" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.type.auto");
+        concepts()[neolib::string{ "language.type.boolean" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.type.boolean");
+        concepts()[neolib::string{ "language.type.character" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.type.character");
+        concepts()[neolib::string{ "language.type.object.size.signed" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.type.object.size.signed");
+        concepts()[neolib::string{ "language.type.object.size.unsigned" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.type.object.size.unsigned");
+        concepts()[neolib::string{ "language.object.boolean.true" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.object.boolean.true");
+        concepts()[neolib::string{ "language.object.boolean.false" }] =
+            neolib::make_ref<neos::language::unimplemented_semantic_concept>("language.object.boolean.false");
         concepts()[neolib::string{ language_type_custom::Name }] =
             neolib::make_ref<language_type_custom>();
         concepts()[neolib::string{ language_comment::Name }] =
@@ -1,6 +1,7 @@
 #include <neos/neos.hpp>
 #include <string>
 #include <iostream>
+#include <fstream>
 #include <boost/program_options.hpp>
 #include <neos/context.hpp>
 
@@ -46,12 +47,15 @@ bool process_command(neos::context& aContext, bool& aInteractive, const std::str
                 << "l(oad) <path to program>                 Load program\n"
                 << "list                                     List program\n"
                 << "c(ompile)                                Compile program\n"
+                << "st(ream) <path to program>               Load and compile program a statement at a time\n"
                 << "r(un)                                    Run program\n"
                 << "![<expression>]                          Evaluate expression (enter interactive mode if expression omitted)\n"
                 << ":<input>                                 Input (as stdin)\n"
                 << "q(uit)                                   Quit neos\n"
                 << "lc                                       List loaded concept libraries\n"
                 << "t(race) <0|1|2|3|4|5> [<filter>]         Compiler trace\n"
+                << "p(rofile) [on|off|json [<path>]]         Parser profile (neos parser engine)\n"
+                << "a(nalysis) [json [<path>]]               Schema grammar analysis\n"
                 << "m(etrics)                                Display metrics for running programs\n"
                 << std::flush;
         }
@@ -72,6 +76,12 @@ bool process_command(neos::context& aContext, bool& aInteractive, const std::str
             aContext.compile_program();
             output_compilation_time();
         }
+        else if (command == "st" || command == "stream")
+        {
+            aContext.stream_program(parameters);
+            std::cout << "Program: " << parameters << std::endl;
+            output_compilation_time();
+        }
         else if (command == "list")
         {
             for (auto const& tu : aContext.program().translationUnits)
@@ -121,6 +131,40 @@ bool process_command(neos::context& aContext, bool& aInteractive, const std::str
             else
                 throw std::runtime_error("invalid command argument(s)");
         }
+        else if (command == "p" || command == "profile")
+        {
+            std::string const argument{ words.size() >= 2 ? std::string{ words[1].first, words[1].second } : std::string{} };
+            if (argument.empty())
+                aContext.compiler().write_profile(std::cout);
+            else if (argument == "json" && words.size() > 2)
+            {
+                std::ofstream output{ std::string{ words[2].first, words[2].second } };
+                if (!output)
+                    throw std::runtime_error("cannot write profile to '" + std::string{ words[2].first, words[2].second } + "'");
+                aContext.compiler().write_profile(output, true);
+            }
+            else if (argument == "json")
+                aContext.compiler().write_profile(std::cout, true);
+            else
+                aContext.compiler().set_profiling(command_arg_to_bool(argument));
+        }
+        else if (command == "a" || command == "analysis")
+        {
+            std::string const argument{ words.size() >= 2 ? std::string{ words[1].first, words[1].second } : std::string{} };
+            if (argument.empty())
+                aContext.schema().write_analysis(std::cout);
+            else if (argument == "json" && words.size() > 2)
+            {
+                std::ofstream output{ std::string{ words[2].first, words[2].second } };
+                if (!output)
+                    throw std::runtime_error("cannot write analysis to '" + std::string{ words[2].first, words[2].second } + "'");
+                aContext.schema().write_analysis(output, true);
+            }
+            else if (argument == "json")
+                aContext.schema().write_analysis(std::cout, true);
+            else
+                throw std::runtime_error("invalid command argument(s)");
+        }
         else if (command == "m" || command == "metrics")
             std::cout << aContext.metrics();
         else if (command == "q" || command == "quit")
@@ -27,6 +27,7 @@
 #include <neolib/file/json.hpp>
 #include <neolib/app/i_application.hpp>
 #include <neos/language/compiler.hpp>
+#include <neos/language/concept_registry.hpp>
 #include <neos/bytecode/vm/vm.hpp>
 #include <neos/i_context.hpp>
 
@@ -48,6 +49,11 @@ namespace neos
     public:
         const concept_libraries_t& concept_libraries() const final;
         void find_concept(neolib::i_string_view const& aSymbol, neolib::i_ref_ptr<language::i_semantic_concept>& aResult) const final;
+    public:
+        // by the identity the concept registry gives a concept at load; kept off i_context so that
+        // its layout, which concept libraries are built against, is unchanged
+        void find_concept(language::concept_id aId, neolib::i_ref_ptr<language::i_semantic_concept>& aResult) const;
+        language::concept_id find_concept_id(std::string_view const& aSymbol) const;
     public:
         bool schema_loaded() const;
         void load_schema(const std::string& aSchemaPath);
@@ -56,6 +62,8 @@ namespace neos
         void load_program(std::istream& aStream);
         language::compiler& compiler() final;
         void compile_program();
+        void stream_program(std::string const& aPath);
+        void stream_program(std::istream& aStream);
         const program_t& program() const;
         program_t& program();
         const text& text() const;
@@ -68,13 +76,17 @@ namespace neos
         void init();
         translation_unit_t& load_unit(language::source_fragment&& aFragment);
         translation_unit_t& load_unit(language::source_fragment&& aFragment, std::istream& aStream);
+        void stream_unit(language::source_fragment&& aFragment, std::istream& aStream);
         void load_fragment(language::i_source_fragment& aFragment) final;
         void load_fragment(language::i_source_fragment& aFragment, std::istream& aStream);
+        void map_fragment(language::i_source_fragment& aFragment, std::string const& aPath);
+        void check_source(language::i_source_fragment const& aFragment);
     private:
         std::ostream& iCout;
         std::unique_ptr<neolib::i_application> iPrivateApplication;
         neolib::i_application& iApplication;
         concept_libraries_t iConceptLibraries;
+        language::concept_registry iConceptRegistry;
         std::shared_ptr<language::schema> iSchema;
         language::compiler iCompiler;
         program_t iProgram;
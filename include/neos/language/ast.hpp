@@ -20,6 +20,13 @@
 #pragma once
 
 #include <neos/neos.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <vector>
 #include <neolib/core/reference_counted.hpp>
 #include <neolib/core/vector.hpp>
 #include <neos/language/i_semantic_concept.hpp>
@@ -44,6 +51,7 @@ namespace neos
             virtual i_ast_node& operator=(i_ast_node& aNewNode) = 0;
         public:
             virtual void name(neolib::i_string& aResult) const = 0;
+            virtual bool is_same_concept(i_ast_node const& aOther) const = 0;
             virtual bool is_empty() const = 0;
             virtual bool holds_data() const = 0;
             virtual i_ast_node_value const& value() const = 0;
@@ -96,10 +104,108 @@ namespace neos
             }
         };
 
+        class ast_node;
+        class ast_node_arena;
+
+        // An AST laid out as arrays indexed by node in preorder (an Euler tour with a node's enter
+        // index its own and its exit index one past its last descendant) so that whether a node is
+        // another's child, sibling or descendant is a comparison of indices. Nodes added under the
+        // root after it is made are appended to it. A node taking the children of one of its
+        // descendants with operator=, as folding does, is followed by cutting the node's other
+        // descendants out of its range; any other operator= makes it out of date (its nodes then
+        // answer by looking at their children) until it is made again.
+        class flat_ast
+        {
+        public:
+            static constexpr std::uint32_t npos = ~std::uint32_t{};
+        public:
+            std::uint32_t generation() const
+            {
+                return iGeneration;
+            }
+            std::size_t size() const
+            {
+                return iParents.size();
+            }
+            i_semantic_concept const* semantic_concept(std::uint32_t aNode) const
+            {
+                return iConcepts[aNode];
+            }
+            std::uint32_t parent(std::uint32_t aNode) const
+            {
+                return iParents[aNode];
+            }
+            std::uint32_t first_child(std::uint32_t aNode) const
+            {
+                return iFirstChildren[aNode];
+            }
+            std::uint32_t next_sibling(std::uint32_t aNode) const
+            {
+                return iNextSiblings[aNode];
+            }
+            std::uint32_t exit(std::uint32_t aNode) const
+            {
+                return iExits[aNode];
+            }
+            std::string_view source(std::uint32_t aNode) const
+            {
+                return iSources[aNode];
+            }
+            bool is_child(std::uint32_t aParent, std::uint32_t aNode) const
+            {
+                return iParents[aNode] == aParent;
+            }
+            bool is_sibling(std::uint32_t aNode, std::uint32_t aOther) const
+            {
+                return iParents[aNode] != npos && iParents[aNode] == iParents[aOther];
+            }
+            // a node cut out of a range is a descendant only of the nodes cut out with it
+            bool is_descendent(std::uint32_t aAncestor, std::uint32_t aNode) const
+            {
+                return aNode > aAncestor && aNode < iExits[aAncestor] &&
+                    (iCuts[aNode] == npos || iCuts[aNode] == iCuts[aAncestor]);
+            }
+        public:
+            bool build(ast_node& aRoot);
+            bool extend(ast_node& aRoot);
+            void replace_children(ast_node const& aNode, ast_node const& aNewNode);
+            void invalidate()
+            {
+                ++iGeneration;
+                iConcepts.clear();
+                iParents.clear();
+                iFirstChildren.clear();
+                iNextSiblings.clear();
+                iExits.clear();
+                iCuts.clear();
+                iSources.clear();
+                iRootChildren = 0u;
+                iLastRootChild = npos;
+            }
+        private:
+            bool append(ast_node& aNode, std::uint32_t aParent, std::uint32_t& aPreviousSibling);
+        private:
+            std::uint32_t iGeneration = 0u;
+            std::vector<i_semantic_concept const*> iConcepts;
+            std::vector<std::uint32_t> iParents;
+            std::vector<std::uint32_t> iFirstChildren;
+            std::vector<std::uint32_t> iNextSiblings;
+            std::vector<std::uint32_t> iExits;
+            std::vector<std::uint32_t> iCuts;
+            std::vector<std::string_view> iSources;
+            std::size_t iRootChildren = 0u;
+            std::uint32_t iLastRootChild = npos;
+        };
+
+        // A node made in an AST's arena (as those the compiler builds are) isn't reference counted:
+        // it lasts as long as the arena does.
         class ast_node : public neolib::reference_counted<i_ast_node>
         {
+            friend class ast_node_arena;
+            friend class flat_ast;
         public:
             using abstract_type = i_ast_node;
+            using base_type = neolib::reference_counted<i_ast_node>;
         public:
             using value_type = ast_node_value;
             using children_t = neolib::vector<neolib::ref_ptr<i_ast_node>>;
@@ -112,11 +218,29 @@ namespace neos
                 iValue{ aValue }
             {
             }
+        public:
+            void add_ref() const noexcept final
+            {
+                if (!iArenaOwned)
+                    base_type::add_ref();
+            }
+            void release() const noexcept final
+            {
+                if (!iArenaOwned)
+                    base_type::release();
+            }
         public:
             i_ast_node& operator=(i_ast_node& aNewNode) final
             {
+                auto const* newNode = dynamic_cast<ast_node const*>(&aNewNode);
+                bool const descendent = (newNode != nullptr && flattened() && newNode->flattened() &&
+                    newNode->iFlat == iFlat && iFlat->is_descendent(iFlatIndex, newNode->iFlatIndex));
+                if (iFlat != nullptr && !descendent)
+                    iFlat->invalidate();
                 children() = aNewNode.children();
                 value() = aNewNode.value();
+                if (descendent)
+                    iFlat->replace_children(*this, *newNode);
                 return *this;
             }
         public:
@@ -136,6 +260,16 @@ namespace neos
                     throw std::logic_error("neos::language::ast::ast_node::name");
                 aResult = result;
             }
+            bool is_same_concept(i_ast_node const& aOther) const final
+            {
+                if (is_empty() || aOther.is_empty() ||
+                    !std::holds_alternative<neolib::ref_ptr<i_semantic_concept>>(value()) ||
+                    !aOther.value().holds_alternative<neolib::ref_ptr<i_semantic_concept>>())
+                    return false;
+                auto const& lhs = *std::get<neolib::ref_ptr<i_semantic_concept>>(value());
+                auto const& rhs = *aOther.value().get<neolib::ref_ptr<i_semantic_concept>>();
+                return lhs.name() == rhs.name();
+            }
             bool is_empty() const final
             {
                 return std::holds_alternative<std::monostate>(value()) ||
@@ -159,10 +293,16 @@ namespace neos
         public:
             bool is_sibling(i_ast_node const& aSibling) const final
             {
+                auto const* sibling = dynamic_cast<ast_node const*>(&aSibling);
+                if (sibling != nullptr && flattened() && sibling->flattened() && sibling->iFlat == iFlat)
+                    return iFlat->is_sibling(iFlatIndex, sibling->iFlatIndex);
                 return iParent == &aSibling.parent();
             }
             bool is_child(i_ast_node const& aChild) const final
             {
+                auto const* child = dynamic_cast<ast_node const*>(&aChild);
+                if (child != nullptr && flattened() && child->flattened() && child->iFlat == iFlat)
+                    return iFlat->is_child(iFlatIndex, child->iFlatIndex);
                 for (auto const& child : children())
                     if (&*child == &aChild)
                         return true;
@@ -170,6 +310,9 @@ namespace neos
             }
             bool is_descendent(i_ast_node const& aChild) const final
             {
+                auto const* descendent = dynamic_cast<ast_node const*>(&aChild);
+                if (descendent != nullptr && flattened() && descendent->flattened() && descendent->iFlat == iFlat)
+                    return iFlat->is_descendent(iFlatIndex, descendent->iFlatIndex);
                 for (auto const& child : children())
                     if (&*child == &aChild)
                         return true;
@@ -189,7 +332,7 @@ namespace neos
             }
             children_t& children() const final
             {
-                return *iChildren;
+                return iChildren;
             }
         public:
             neolib::i_string_view const& source() const final
@@ -307,8 +450,204 @@ namespace neos
             }
         private:
             i_ast_node* iParent = nullptr;
-            std::unique_ptr<children_t> iChildren = std::make_unique<children_t>();
+            mutable children_t iChildren;
             ast_node_value iValue;
+            bool iArenaOwned = false;
+            flat_ast* iFlat = nullptr;
+            std::uint32_t iFlatIndex = flat_ast::npos;
+            std::uint32_t iFlatGeneration = 0u;
+        private:
+            bool flattened() const
+            {
+                return iFlat != nullptr && iFlatGeneration == iFlat->generation();
+            }
+        };
+
+        // A node reached twice (one whose children were copied to another by operator=) means
+        // the AST isn't a tree and it can't be flattened; every node is an ast_node.
+        inline bool flat_ast::build(ast_node& aRoot)
+        {
+            invalidate();
+            std::uint32_t previousSibling = npos;
+            if (!append(aRoot, npos, previousSibling))
+            {
+                invalidate();
+                return false;
+            }
+            auto const& children = aRoot.children();
+            iRootChildren = children.size();
+            if (!children.empty())
+                iLastRootChild = static_cast<ast_node const&>(*children.back()).iFlatIndex;
+            return true;
+        }
+
+        // Lays out the subtrees added to the end of the root's children since the root was laid
+        // out; children removed or inserted before the last one laid out need a build().
+        inline bool flat_ast::extend(ast_node& aRoot)
+        {
+            if (aRoot.iFlat != this || aRoot.iFlatGeneration != iGeneration || iParents.empty())
+                return false;
+            auto const& children = aRoot.children();
+            if (children.size() < iRootChildren)
+                return false;
+            if (iRootChildren != 0u)
+            {
+                auto const& last = static_cast<ast_node const&>(*children[iRootChildren - 1u]);
+                if (last.iFlat != this || last.iFlatGeneration != iGeneration || last.iFlatIndex != iLastRootChild)
+                    return false;
+            }
+            for (; iRootChildren < children.size(); ++iRootChildren)
+                if (!append(static_cast<ast_node&>(*children[iRootChildren]), aRoot.iFlatIndex, iLastRootChild))
+                {
+                    invalidate();
+                    return false;
+                }
+            iExits[aRoot.iFlatIndex] = static_cast<std::uint32_t>(iParents.size());
+            return true;
+        }
+
+        // aNode has taken the children of aNewNode, one of its descendants: its other descendants
+        // are cut out of its range and aNewNode's children become its own.
+        inline void flat_ast::replace_children(ast_node const& aNode, ast_node const& aNewNode)
+        {
+            auto const node = aNode.iFlatIndex;
+            auto const newNode = aNewNode.iFlatIndex;
+            for (auto child = iFirstChildren[node]; child != npos; child = iNextSiblings[child])
+                iParents[child] = npos;
+            for (auto index = node + 1u; index < iExits[node]; ++index)
+                if (index > newNode && index < iExits[newNode])
+                    index = iExits[newNode] - 1u;
+                else if (iCuts[index] == npos)
+                    iCuts[index] = node;
+            iFirstChildren[node] = iFirstChildren[newNode];
+            for (auto child = iFirstChildren[newNode]; child != npos; child = iNextSiblings[child])
+                iParents[child] = node;
+            iConcepts[node] = iConcepts[newNode];
+            iSources[node] = iSources[newNode];
+        }
+
+        // Lays out aNode's subtree after the nodes already laid out, linking it after
+        // aPreviousSibling under aParent.
+        inline bool flat_ast::append(ast_node& aNode, std::uint32_t aParent, std::uint32_t& aPreviousSibling)
+        {
+            auto const base = static_cast<std::uint32_t>(iParents.size());
+            std::vector<std::uint32_t> lastChildren;
+            std::vector<std::pair<ast_node*, std::uint32_t>> pending{ { &aNode, aParent } };
+            while (!pending.empty())
+            {
+                auto const [node, parent] = pending.back();
+                pending.pop_back();
+                if (node->iFlat == this && node->iFlatGeneration == iGeneration)
+                    return false;
+                auto const index = static_cast<std::uint32_t>(iParents.size());
+                node->iFlat = this;
+                node->iFlatIndex = index;
+                node->iFlatGeneration = iGeneration;
+                i_semantic_concept const* semanticConcept = nullptr;
+                if (std::holds_alternative<neolib::ref_ptr<i_semantic_concept>>(node->value()) &&
+                    std::get<neolib::ref_ptr<i_semantic_concept>>(node->value()).valid())
+                    semanticConcept = &*std::get<neolib::ref_ptr<i_semantic_concept>>(node->value());
+                iConcepts.push_back(semanticConcept);
+                iParents.push_back(parent);
+                iFirstChildren.push_back(npos);
+                iNextSiblings.push_back(npos);
+                iExits.push_back(index + 1u);
+                iCuts.push_back(npos);
+                iSources.push_back(semanticConcept != nullptr ? semanticConcept->source().to_std_string_view() : std::string_view{});
+                lastChildren.push_back(npos);
+                if (index == base)
+                {
+                    if (aParent != npos)
+                    {
+                        if (aPreviousSibling == npos)
+                            iFirstChildren[aParent] = index;
+                        else
+                            iNextSiblings[aPreviousSibling] = index;
+                    }
+                    aPreviousSibling = index;
+                }
+                else
+                {
+                    auto& lastChild = lastChildren[parent - base];
+                    if (lastChild == npos)
+                        iFirstChildren[parent] = index;
+                    else
+                        iNextSiblings[lastChild] = index;
+                    lastChild = index;
+                }
+                auto& children = node->children();
+                for (auto child = children.end(); child != children.begin();)
+                    pending.emplace_back(&static_cast<ast_node&>(**--child), index);
+            }
+            // a node's descendants are numbered after it so have their exits first
+            for (auto index = static_cast<std::uint32_t>(iParents.size()); index-- > base;)
+                if (lastChildren[index - base] != npos)
+                    iExits[index] = iExits[lastChildren[index - base]];
+            return true;
+        }
+
+        // Storage for the nodes of an AST taken from blocks by bumping an index; the nodes are
+        // destroyed and their blocks freed all at once.
+        class ast_node_arena
+        {
+        public:
+            static constexpr std::size_t BlockSize = 4096u;
+        private:
+            struct slot
+            {
+                alignas(ast_node) std::byte storage[sizeof(ast_node)];
+            };
+        public:
+            ast_node_arena()
+            {
+            }
+            ast_node_arena(ast_node_arena const&) = delete;
+            ~ast_node_arena()
+            {
+                clear();
+            }
+        public:
+            ast_node_arena& operator=(ast_node_arena const&) = delete;
+        public:
+            ast_node& make(ast_node::value_type const& aValue, i_ast_node& aParent)
+            {
+                if (iBlocks.empty() || iUsed == BlockSize)
+                {
+                    iBlocks.push_back(std::unique_ptr<slot[]>{ new slot[BlockSize] });
+                    iUsed = 0u;
+                }
+                auto& node = *new (iBlocks.back()[iUsed].storage) ast_node{ aValue, aParent };
+                ++iUsed;
+                node.iArenaOwned = true;
+                return node;
+            }
+            std::size_t size() const
+            {
+                return iBlocks.empty() ? 0u : (iBlocks.size() - 1u) * BlockSize + iUsed;
+            }
+            // A node's children can have been made before it as well as after it so every node
+            // lets go of its children before any is destroyed.
+            void clear()
+            {
+                for_each_node([](ast_node& aNode) { aNode.iChildren.clear(); });
+                for_each_node([](ast_node& aNode) { aNode.~ast_node(); });
+                iBlocks.clear();
+                iUsed = 0u;
+            }
+        private:
+            template <typename Visitor>
+            void for_each_node(Visitor aVisitor)
+            {
+                for (std::size_t block = 0u; block < iBlocks.size(); ++block)
+                {
+                    auto const used = (block + 1u == iBlocks.size() ? iUsed : BlockSize);
+                    for (std::size_t node = 0u; node < used; ++node)
+                        aVisitor(*std::launder(reinterpret_cast<ast_node*>(iBlocks[block][node].storage)));
+                }
+            }
+        private:
+            std::vector<std::unique_ptr<slot[]>> iBlocks;
+            std::size_t iUsed = 0u;
         };
 
         namespace
@@ -325,6 +664,11 @@ namespace neos
             ast(ast const& aOther) : iSymbolTable{ aOther.iSymbolTable }
             {
             }
+            ~ast()
+            {
+                // the root is counted and may outlive the nodes it refers to
+                iRoot->children().clear();
+            }
         public:
             ast& operator=(ast const& aOther)
             {
@@ -339,8 +683,33 @@ namespace neos
             {
                 return iRoot;
             }
+            ast_node& make_node(ast_node::value_type const& aValue, i_ast_node& aParent)
+            {
+                return iArena.make(aValue, aParent);
+            }
+            std::size_t node_count() const
+            {
+                return iArena.size();
+            }
+            // removes the root's children freeing every node made; nothing may still refer to them
+            void clear()
+            {
+                iFlat.invalidate();
+                iRoot->children().clear();
+                iArena.clear();
+            }
+            // lays out only what has been added under the root since it was last flattened where
+            // it can
+            flat_ast const& flatten()
+            {
+                if (!iFlat.extend(*iRoot))
+                    iFlat.build(*iRoot);
+                return iFlat;
+            }
         private:
             symbol_table& iSymbolTable;
+            ast_node_arena iArena;
+            flat_ast iFlat;
             neolib::ref_ptr<ast_node> iRoot = neolib::make_ref<ast_node>();
         };
     }
@@ -0,0 +1,423 @@
+/*
+  code_parser.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace neos::language::code_parser
+{
+    enum class symbol : std::uint32_t;
+
+    class dfa;
+
+    using primitive_index = std::uint32_t;
+    using rule_index = std::uint32_t;
+    using node_index = std::uint32_t;
+
+    constexpr std::uint32_t npos = ~std::uint32_t{};
+
+    enum class primitive_type : std::uint8_t
+    {
+        Symbol,
+        Terminal,
+        Range,
+        Concatenation,
+        Alternation,
+        Repetition,
+        Optional,
+        Operators,
+        Eof
+    };
+
+    // A set of bytes as a bitmap together with, when it is made up of few enough ranges, the
+    // ranges themselves so that a run of member bytes can be scanned a block at a time.
+    struct byte_class
+    {
+        static constexpr std::size_t RangeLimit = 4u;
+
+        std::bitset<256> bitmap;
+        std::uint32_t rangeCount = 0u;
+        std::array<std::uint8_t, RangeLimit> low = {};
+        std::array<std::uint8_t, RangeLimit> span = {};
+
+        void assign(std::bitset<256> const& aBitmap);
+        bool any() const
+        {
+            return bitmap.any();
+        }
+        bool test(std::uint8_t aByte) const
+        {
+            return bitmap.test(aByte);
+        }
+        std::size_t scan(std::string_view const& aSource, std::size_t aPosition) const;
+    };
+
+    // The bytes (code points below 256) between two range end point terminals, complemented if
+    // the range is negated.
+    std::bitset<256> range_bitmap(std::string_view const& aLow, std::string_view const& aHigh, bool aNegate);
+
+    // An Operators primitive matches operands separated by binary operators: its children are the
+    // operand, the separator skipped around each operator (an empty terminal if there is none)
+    // and then the operators, each a terminal carrying its concept, precedence and associativity.
+    struct primitive
+    {
+        primitive_type type;
+        code_parser::symbol symbol = {};
+        std::string text;
+        char32_t low = U'\0';
+        char32_t high = U'\0';
+        bool codepoints = false;
+        bool negate = false;
+        std::bitset<256> exclusions;
+        bool matchFirst = false;
+        bool atLeastOne = false;
+        std::optional<std::string> c;
+        bool infix = false;
+        std::uint32_t precedence = 0u;
+        bool rightAssociative = false;
+        std::optional<std::string> constraint;
+        std::vector<primitive_index> children;
+        byte_class byteClass;
+        byte_class run;
+    };
+
+    struct rule
+    {
+        primitive_index lhs;
+        std::vector<primitive_index> rhs;
+    };
+
+    // The bytes a primitive, rule or symbol can start with and whether it can match without
+    // consuming input; used to skip alternatives that cannot match at the current position.
+    struct prediction
+    {
+        std::bitset<256> first;
+        bool nullable = false;
+
+        bool viable(std::string_view const& aSource, std::uint32_t aPosition) const
+        {
+            return nullable || (aPosition < aSource.size() && first.test(static_cast<std::uint8_t>(aSource[aPosition])));
+        }
+    };
+
+    // Keywords declared as constrained rules over a common lexeme symbol, e.g.
+    // `using $ language.keyword ::= potential keyword ::= "using" ;`, are gathered into a perfect
+    // hash table so that a matched lexeme is classified with a single probe.
+    struct keyword_table
+    {
+        struct entry
+        {
+            std::string text;
+            std::vector<code_parser::symbol> symbols;
+        };
+
+        code_parser::symbol lexeme = {};
+        std::uint64_t seed = 0u;
+        std::vector<std::uint32_t> slots;
+        std::vector<entry> entries;
+
+        void build();
+        std::span<code_parser::symbol const> find(std::string_view const& aText) const;
+    };
+
+    // The code parser's view of a schema stage: every rule visible to the stage (including those
+    // inherited from earlier pipeline stages) as an index based graph of primitives.
+    struct grammar
+    {
+        std::vector<primitive> primitives;
+        std::vector<rule> rules;
+        rule_index stageRules = 0u;
+        std::vector<std::vector<rule_index>> rulesBySymbol;
+        std::vector<code_parser::symbol> stageSymbols;
+        std::vector<std::string> symbolNames;
+        std::vector<bool> discard;
+        std::vector<prediction> primitivePredictions;
+        std::vector<prediction> rulePredictions;
+        std::vector<prediction> symbolPredictions;
+        std::vector<bool> boundedPrimitives;
+        std::vector<bool> boundedSymbols;
+        std::vector<bool> leaves;
+        std::vector<primitive_index> leafConcepts;
+        std::vector<keyword_table> keywordTables;
+        std::vector<std::uint32_t> keywords;
+        std::vector<std::shared_ptr<dfa>> triviaScanners;
+
+        primitive_index add(primitive&& aPrimitive);
+        void finalize(std::unordered_map<std::string_view, code_parser::symbol> const& aSymbolMap, std::unordered_set<std::string> const& aDiscard);
+        std::vector<rule_index> const& rules_for(code_parser::symbol aSymbol) const;
+        std::string_view symbol_name(code_parser::symbol aSymbol) const;
+        std::string rule_name(rule_index aRule) const;
+        bool discarded(code_parser::symbol aSymbol) const;
+        prediction const& symbol_prediction(code_parser::symbol aSymbol) const;
+        bool bounded(code_parser::symbol aSymbol) const;
+        bool leaf(code_parser::symbol aSymbol) const;
+        keyword_table const* keyword(code_parser::symbol aSymbol) const;
+        dfa const* trivia_scanner(code_parser::symbol aSymbol) const;
+    private:
+        void predict();
+        void find_bounded();
+        void find_runs();
+        void find_leaves();
+        void find_keywords();
+        void find_trivia();
+        prediction predict_sequence(std::vector<primitive_index> const& aSequence) const;
+    };
+
+    // A token produced by a tokenizer stage: the text it spans in the source fragment and every
+    // stage symbol that matches the whole of it (symbol being the first of these).
+    struct token
+    {
+        code_parser::symbol symbol;
+        std::string_view text;
+        std::span<code_parser::symbol const> symbols;
+    };
+
+    using token_stream = std::vector<token>;
+
+    // A stretch of source skipped as a discarded symbol (whitespace, comments) which is kept out
+    // of the parse nodes and the AST.
+    struct trivia
+    {
+        code_parser::symbol symbol;
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+
+    struct statistics
+    {
+        std::uint64_t memoHits = 0u;
+        std::uint64_t memoMisses = 0u;
+        std::uint64_t tokenHits = 0u;
+        std::uint64_t keywordProbes = 0u;
+        std::uint64_t triviaScans = 0u;
+    };
+
+    // What profiling found for one rule or primitive. Backtrack is the input a failed attempt had
+    // matched before it gave up; time includes everything matched within the attempt.
+    struct profile_counters
+    {
+        std::uint64_t attempts = 0u;
+        std::uint64_t successes = 0u;
+        std::uint64_t failures = 0u;
+        std::uint64_t bytes = 0u;
+        std::uint64_t backtrack = 0u;
+        std::chrono::nanoseconds time = {};
+    };
+
+    // Counters indexed by a grammar's rule and primitive indices, accumulated over every parse
+    // made with the profile attached to the engine.
+    struct profile
+    {
+        std::vector<profile_counters> rules;
+        std::vector<profile_counters> primitives;
+
+        void clear();
+    };
+
+    // Text quoted and escaped as a JSON string.
+    std::string json_string(std::string_view const& aText);
+
+    // The rules and primitives ranked by time and by backtrack, aTop of each.
+    void write_profile_report(std::ostream& aStream, grammar const& aGrammar, profile const& aProfile, std::size_t aTop = 10u);
+    void write_profile_json(std::ostream& aStream, grammar const& aGrammar, profile const& aProfile);
+
+    struct ast_node
+    {
+        std::optional<std::string_view> c;
+        std::string_view value;
+        ast_node const* parent = nullptr;
+        std::span<ast_node const* const> children;
+    };
+
+    // Receives the AST from the engine without an intermediate tree being built: each node is
+    // opened before its children and closed after them. A node's concept is the grammar primitive
+    // naming it (npos for a root synthesized over several top level nodes) so that it can be
+    // resolved once per primitive rather than once per node.
+    class i_ast_sink
+    {
+    public:
+        virtual ~i_ast_sink() = default;
+    public:
+        virtual void open_node(primitive_index aConcept, std::string_view const& aValue) = 0;
+        virtual void close_node(primitive_index aConcept, std::string_view const& aValue) = 0;
+    };
+
+    class engine
+    {
+    public:
+        // symbols nested deeper than this are matched using frames on the heap
+        static constexpr std::size_t NativeDepth = 128u;
+    public:
+        struct no_ast : std::logic_error { no_ast() : std::logic_error("neos::language::code_parser::engine::no_ast") {} };
+        struct bad_rebase : std::logic_error { bad_rebase() : std::logic_error("neos::language::code_parser::engine::bad_rebase") {} };
+    private:
+        struct node
+        {
+            primitive_index concept_;
+            std::uint32_t begin;
+            std::uint32_t end;
+            std::uint32_t firstChild;
+            std::uint32_t childCount;
+        };
+        // A symbol (type Symbol) or primitive part way through being matched: next and last span
+        // what is left of the rule, iteration, sequence or alternatives currently being matched.
+        // A symbol frame's primitive is the symbol primitive that referred to it (npos if none)
+        // and its alternative is the index of its current rule. An Operators frame's alternative is
+        // the base of its operator stack and its bestNode the operator awaiting its right operand.
+        struct frame
+        {
+            primitive_type type;
+            bool done;
+            primitive_index primitive;
+            code_parser::symbol symbol;
+            primitive_index const* next;
+            primitive_index const* last;
+            std::uint32_t begin;
+            std::uint32_t position;
+            std::uint32_t mark;
+            std::uint32_t sequenceBegin = 0u;
+            std::uint32_t sequenceMark = 0u;
+            std::uint32_t alternative = 0u;
+            std::uint32_t count = 0u;
+            std::uint32_t end = npos;
+            node_index bestNode = npos;
+            std::uint32_t active = npos;
+        };
+        struct unit_cursor
+        {
+            node_index unit;
+            std::uint32_t next;
+            node_index outerPending;
+        };
+        struct attempt
+        {
+            std::chrono::steady_clock::time_point start;
+            std::uint32_t outerReach;
+        };
+        struct memo_entry
+        {
+            std::uint64_t key;
+            std::uint32_t end;
+            node_index node;
+        };
+        class memo_table
+        {
+        public:
+            memo_table();
+        public:
+            void clear();
+            memo_entry* find(std::uint64_t aKey);
+            memo_entry& insert(std::uint64_t aKey);
+        private:
+            void grow();
+        private:
+            std::vector<memo_entry> iEntries;
+            std::size_t iSize = 0u;
+        };
+    public:
+        engine(code_parser::grammar const& aGrammar, bool aPackrat = false);
+    public:
+        bool parse(std::string_view const& aSource);
+        bool parse(code_parser::symbol aRoot, std::string_view const& aSource);
+        bool parse(code_parser::symbol aRoot, std::string_view const& aSource, token_stream const& aTokens);
+        void create_ast();
+        void create_ast(i_ast_sink& aSink);
+        void rebase(std::string_view const& aSource);
+        void set_profile(code_parser::profile* aProfile);
+        ast_node const& ast() const;
+        std::vector<code_parser::trivia> const& trivia() const;
+        code_parser::statistics const& statistics() const;
+    private:
+        void reset(std::string_view const& aSource);
+        std::uint32_t match(primitive_index aPrimitive, std::uint32_t aPosition);
+        std::uint32_t match_sequence(std::vector<primitive_index> const& aSequence, std::uint32_t aPosition);
+        std::uint32_t match_symbol(code_parser::symbol aSymbol, std::uint32_t aPosition);
+        bool resolve_symbol(code_parser::symbol aSymbol, std::uint32_t aPosition, std::uint32_t& aEnd);
+        void rule_matched(rule_index aRule, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aRuleEnd, std::uint32_t& aEnd, node_index& aBestNode);
+        std::uint32_t symbol_matched(code_parser::symbol aSymbol, std::uint32_t aBegin, std::uint32_t aEnd, node_index aBestNode);
+        std::uint32_t run(std::size_t aBase);
+        bool enter(primitive_index aPrimitive, std::uint32_t aPosition, std::uint32_t& aResult);
+        bool push_symbol(code_parser::symbol aSymbol, primitive_index aReference, std::uint32_t aPosition);
+        void next_rule(frame& aFrame, std::uint32_t aRule) const;
+        void begin_iteration(frame& aFrame, primitive const& aRepetition) const;
+        bool advance(frame& aFrame);
+        void resume(frame& aFrame, std::uint32_t aResult);
+        std::uint32_t leave();
+        std::uint32_t complete(primitive_index aPrimitive, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd);
+        void begin_attempt(std::uint32_t aPosition);
+        void end_attempt(profile_counters& aCounters, std::uint32_t aBegin, std::uint32_t aEnd);
+        std::uint32_t match_operators(primitive const& aOperators, std::uint32_t aPosition);
+        bool match_operator(primitive const& aOperators, std::uint32_t aPosition, std::uint32_t& aNext, node_index& aOperator);
+        void push_operator(std::size_t aBase, std::size_t aOperand, node_index aOperator);
+        void pop_operators(std::size_t aBase);
+        std::uint32_t match_range(primitive const& aRange, std::uint32_t aPosition) const;
+        void take_tokens(token_stream const& aTokens);
+        token const* find_token(token_stream const& aTokens, std::size_t& aCursor, std::uint32_t aPosition) const;
+        std::uint32_t match_token(code_parser::symbol aSymbol, std::uint32_t aPosition);
+        std::uint32_t match_discarded_token(code_parser::symbol aSymbol, std::uint32_t aPosition);
+        std::uint32_t match_keyword(code_parser::symbol aSymbol, keyword_table const& aTable, std::uint32_t aPosition);
+        void add_trivia(code_parser::symbol aSymbol, std::uint32_t aBegin, std::uint32_t aEnd);
+        void settle_trivia();
+        node_index make_node(primitive_index aConcept, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd);
+        node_index make_unit(std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd);
+        bool is_concept(node_index aNode) const;
+        bool is_infix(node_index aNode) const;
+        void flatten(node_index aUnit, std::vector<node_index>& aResult, node_index& aPending);
+    private:
+        code_parser::grammar const& iGrammar;
+        bool iPackrat;
+        std::size_t iDepth = 0u;
+        std::vector<frame> iFrames;
+        std::vector<std::uint32_t> iActive;
+        std::string_view iSource;
+        bool iTokenized = false;
+        token_stream iTokens;
+        token_stream iDiscardedTokens;
+        std::size_t iTokenCursor = 0u;
+        std::size_t iDiscardedTokenCursor = 0u;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> iLexemes;
+        std::vector<code_parser::trivia> iTrivia;
+        std::vector<node> iNodes;
+        std::vector<node_index> iChildPool;
+        std::vector<node_index> iOutput;
+        std::vector<node_index> iOperators;
+        memo_table iMemo;
+        node_index iRoot = npos;
+        std::vector<unit_cursor> iUnits;
+        std::vector<ast_node> iAst;
+        std::vector<ast_node const*> iAstChildren;
+        code_parser::statistics iStatistics;
+        code_parser::profile* iProfile = nullptr;
+        std::vector<attempt> iAttempts;
+        std::uint32_t iReach = 0u;
+    };
+}
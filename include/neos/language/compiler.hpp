@@ -19,13 +19,20 @@
 
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <list>
+#include <optional>
 #include <neos/neos.hpp>
 #include <neolib/core/optional.hpp>
 #include <neolib/core/string.hpp>
 #include <neolib/core/string_view.hpp>
 #include <neos/fwd.hpp>
 #include <neos/language/schema.hpp>
+#include <neos/language/incremental_parser.hpp>
+#include <neos/language/source_buffer.hpp>
+#include <neos/language/source_map.hpp>
+#include <neos/language/utf8.hpp>
 #include <neos/language/ast.hpp>
 #include <neos/language/semantic_concept.hpp>
 #include <neos/language/i_concept_library.hpp>
@@ -35,16 +42,64 @@
 
 namespace neos::language
 {
+    // Where a fragment's source starts in the text it was taken from, a piece of a streamed
+    // source not starting at its beginning; line and column from 0, the column in code points.
+    struct source_origin
+    {
+        std::size_t offset = 0u;
+        std::size_t line = 0u;
+        std::size_t column = 0u;
+    };
+
     class source_fragment : public i_source_fragment
     {
     public:
         source_fragment(const optional_source_path_t& aSourceFilePath = optional_source_path_t{}, const source_t& aSource = source_t{}) :
             iSourceFilePath{ aSourceFilePath }, iSource{ aSource }, iImported{ false }, iStatus{ compilation_status::Pending }
+        {
+            ++generation_counter();
+        }
+        source_fragment(const source_fragment& aOther) :
+            source_fragment{ static_cast<const i_source_fragment&>(aOther) }
         {
         }
         source_fragment(const i_source_fragment& aFragment) :
-            iSourceFilePath{ aFragment.source_file_path() }, iSource{ aFragment.source() }, iImported{ aFragment.imported() }, iStatus{ aFragment.status() }
+            iSourceFilePath{ aFragment.source_file_path() }, iImported{ aFragment.imported() }, iStatus{ aFragment.status() }
+        {
+            ++generation_counter();
+            auto const* fragment = dynamic_cast<source_fragment const*>(&aFragment);
+            if (fragment != nullptr && fragment->iBuffer)
+                iBuffer = fragment->iBuffer;
+            else
+                iSource = aFragment.source();
+            if (fragment != nullptr)
+            {
+                iIndex = fragment->iIndex;
+                iOrigin = fragment->iOrigin;
+            }
+        }
+        ~source_fragment()
+        {
+            ++generation_counter();
+        }
+        source_fragment& operator=(const source_fragment& aOther)
         {
+            iSourceFilePath = aOther.iSourceFilePath;
+            iSource = aOther.iSource;
+            iBuffer = aOther.iBuffer;
+            iIndex = aOther.iIndex;
+            iOrigin = aOther.iOrigin;
+            iImported = aOther.iImported;
+            iStatus = aOther.iStatus;
+            ++generation_counter();
+            return *this;
+        }
+    public:
+        // changes whenever a fragment is made, is destroyed or has its source set so that what
+        // refers to fragments' sources (a source_map) can tell when it is out of date
+        static std::uint64_t generation()
+        {
+            return generation_counter();
         }
     public:
         const i_optional_source_path_t& source_file_path() const final
@@ -67,12 +122,57 @@ namespace neos::language
         }
         const i_source_t& source() const final
         { 
-            iSourceView = iSource;
+            if (iBuffer)
+                iSourceView = source_t{ iBuffer->text() };
+            else
+                iSourceView = iSource;
             return iSourceView;
         }
         void set_source(i_source_t const& aSource) final
         {
+            iBuffer.reset();
             iSource = neolib::string{ aSource };
+            iIndex = std::nullopt;
+            iOrigin = {};
+            ++generation_counter();
+        }
+        // the fragment's text is then the buffer's, shared rather than copied
+        void set_source(std::shared_ptr<source_buffer const> const& aBuffer)
+        {
+            iBuffer = aBuffer;
+            iSource.clear();
+            iIndex = std::nullopt;
+            iOrigin = {};
+            ++generation_counter();
+        }
+        std::shared_ptr<source_buffer const> const& buffer() const
+        {
+            return iBuffer;
+        }
+        // made on first use (on load) and kept until the source changes
+        text_index const& index() const
+        {
+            if (!iIndex)
+                iIndex = index_text(source().to_std_string_view());
+            return *iIndex;
+        }
+        // set after the source when it is a piece of a larger one
+        source_origin const& origin() const
+        {
+            return iOrigin;
+        }
+        void set_origin(source_origin const& aOrigin)
+        {
+            iOrigin = aOrigin;
+        }
+        // the line and column of aOffset in the text the source was taken from
+        text_index::position_type position(std::size_t aOffset) const
+        {
+            auto result = index().position(source().to_std_string_view(), aOffset);
+            if (result.line == 0u)
+                result.column += iOrigin.column;
+            result.line += iOrigin.line;
+            return result;
         }
         bool imported() const final
         {
@@ -115,10 +215,19 @@ namespace neos::language
         { 
             return source().end();
         }
+    private:
+        static std::atomic<std::uint64_t>& generation_counter()
+        {
+            static std::atomic<std::uint64_t> sGeneration;
+            return sGeneration;
+        }
     private:
         optional_source_path_t iSourceFilePath;
         neolib::string iSource;
+        std::shared_ptr<source_buffer const> iBuffer;
         mutable source_t iSourceView;
+        mutable std::optional<text_index> iIndex;
+        source_origin iOrigin;
         bool iImported;
         mutable compilation_status iStatus;
     };
@@ -170,16 +279,27 @@ namespace neos::language
     {
         translation_units_t translationUnits;
         scope<> scope;
+        // how many times folding has entered each scope, less those of the source since replaced
+        std::unordered_map<i_scope const*, std::size_t> scopeUsers;
         symbol_table symbolTable;
         text text;
+        source_map sourceMap;
     };
 
-    using fold_stack = neolib::vector<neolib::ref_ptr<i_ast_node>>;
+    // a list as folding takes nodes from and puts results into the middle of it
+    using fold_stack = std::list<neolib::ref_ptr<i_ast_node>>;
 
     class compiler : public i_compiler
     {
     private:
         using source_iterator = const_source_iterator;
+        // a scope entered while folding the node whose source starts at
+        struct entered_scope
+        {
+            i_scope* parent;
+            i_scope* scope;
+            char const* at;
+        };
         struct compilation_state
         {
             program* program;
@@ -190,15 +310,53 @@ namespace neos::language
             std::vector<neolib::ref_ptr<i_scope>> scopeStack;
             std::vector<operand_type> operandStack;
             std::vector<operator_type> operatorStack;
+            i_ast_node const* folding = nullptr;
+            std::vector<entered_scope> enteredScopes;
         };
         using compilation_state_stack_t = std::vector<std::unique_ptr<compilation_state>>;
+        struct stage_profile
+        {
+            std::string stage;
+            std::shared_ptr<code_parser::grammar const> grammar;
+            code_parser::profile profile;
+        };
+        // what a piece of a fragment kept for reparse() has put in the unit's AST, with the text
+        // its nodes refer to, and the scopes folding it entered
+        struct incremental_piece
+        {
+            std::shared_ptr<source_buffer const> source;
+            std::size_t nodes = 0u;
+            std::vector<entered_scope> scopes;
+            bool folded = false;
+        };
+        struct incremental_fragment
+        {
+            translation_unit const* unit;
+            schema_stage const* stage;
+            std::unique_ptr<code_parser::incremental_parser> parser;
+            std::shared_ptr<source_buffer const> source;
+            std::vector<incremental_piece> pieces;
+        };
+        // nodes reparse() has replaced, left in a unit's AST until it is cleared, and their texts
+        struct dropped_nodes
+        {
+            std::size_t count = 0u;
+            std::vector<std::shared_ptr<source_buffer const>> sources;
+        };
+    public:
+        static constexpr std::size_t StreamChunkSize = 65536u;
+    public:
+        struct fragment_not_incremental : std::logic_error { fragment_not_incremental() : std::logic_error("neos::language::compiler::fragment_not_incremental") {} };
+        struct bad_edit : std::out_of_range { bad_edit() : std::out_of_range("neos::language::compiler::bad_edit") {} };
     public:
         compiler(i_context& aContext);
     public:
         bool compile(program& aProgram);
         bool compile(program& aProgram, translation_unit& aUnit);
         bool compile(program& aProgram, translation_unit& aUnit, i_source_fragment& aFragment);
+        bool compile(program& aProgram, translation_unit& aUnit, source_fragment& aFragment, std::istream& aSource);
         bool compile(const i_source_fragment& aFragment) final;
+        bool reparse(program& aProgram, translation_unit& aUnit, i_source_fragment& aFragment, std::size_t aOffset, std::size_t aLength, std::string_view const& aReplacement);
         i_source_fragment const& current_fragment() const final;
         i_scope const& current_scope() const final;
         i_scope& enter_scope(scope_type aScopeType, neolib::i_string const& aScopeName) final;
@@ -217,10 +375,21 @@ namespace neos::language
         void set_trace(std::uint32_t aTrace, const std::optional<std::string>& aFilter = {});
         const std::chrono::steady_clock::time_point& start_time() const;    
         const std::chrono::steady_clock::time_point& end_time() const;
+        bool profiling() const;
+        void set_profiling(bool aProfiling);
+        void write_profile(std::ostream& aStream, bool aJson = false) const;
+        bool incremental() const;
+        void set_incremental(bool aIncremental);
+        code_parser::incremental_parser const& incremental_parser(i_source_fragment const& aFragment) const;
     private:
         const compilation_state& state() const;
         compilation_state& state();
         fold_stack& fold_stack();
+        code_parser::profile& profile(schema_stage const& aStage);
+        void emit_incremental(translation_unit& aUnit, incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount, bool aRoot);
+        void record_incremental(incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount);
+        void remove_incremental(translation_unit& aUnit, incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount);
+        void compact(translation_unit& aUnit);
         bool fold();
         bool fold2();
         static std::string location(const translation_unit& aUnit, const i_source_fragment& aFragment, source_iterator aSourcePos, bool aShowFragmentFilePath = true);
@@ -230,6 +399,11 @@ namespace neos::language
         std::optional<std::string> iTraceFilter;
         std::chrono::steady_clock::time_point iStartTime;
         std::chrono::steady_clock::time_point iEndTime;
+        bool iProfiling;
+        std::vector<stage_profile> iProfiles;
+        bool iIncremental;
+        std::unordered_map<i_source_fragment const*, incremental_fragment> iIncrementalFragments;
+        std::unordered_map<translation_unit const*, dropped_nodes> iDroppedNodes;
         compilation_state_stack_t iCompilationStateStack;
     };
 }
\ No newline at end of file
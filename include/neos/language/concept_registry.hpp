@@ -0,0 +1,67 @@
+/*
+  concept_registry.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <neolib/core/reference_counted.hpp>
+#include <neos/language/i_concept_library.hpp>
+#include <neos/language/i_semantic_concept.hpp>
+
+namespace neos::language
+{
+    // Concept names are interned to dense ids when the concept libraries are loaded.
+    using concept_id = std::uint32_t;
+
+    // Every concept of a set of loaded concept libraries indexed by name and by the dense id its
+    // name is interned to. A name found in more than one library resolves to the concept that a
+    // search of the libraries in order (each before its sublibraries) finds first. The ids, and
+    // the bitset of the ids each concept is (its own and its hierarchy's), are kept here rather
+    // than on the concepts so that the interface concept libraries are built against is unchanged;
+    // a concept instance has its definition's name so is found by name.
+    class concept_registry
+    {
+    public:
+        static constexpr concept_id NoId = ~concept_id{};
+    public:
+        concept_registry() = default;
+        concept_registry(concept_registry const&) = delete;
+    public:
+        concept_registry& operator=(concept_registry const&) = delete;
+    public:
+        void build(concept_libraries_t const& aLibraries);
+        void clear();
+        std::size_t size() const;
+        concept_id id(std::string_view const& aName) const;
+        concept_id id(i_semantic_concept const& aConcept) const;
+        i_semantic_concept* find(std::string_view const& aName) const;
+        i_semantic_concept* find(concept_id aId) const;
+        bool is(concept_id aConcept, concept_id aOther) const;
+    private:
+        std::unordered_map<std::string_view, concept_id> iIds;
+        std::unordered_map<i_semantic_concept const*, concept_id> iDefinitionIds;
+        std::vector<neolib::ref_ptr<i_semantic_concept>> iById;
+        std::size_t iWordCount = 0u;
+        std::vector<std::uint64_t> iIs;
+    };
+}
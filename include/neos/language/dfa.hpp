@@ -0,0 +1,66 @@
+/*
+  dfa.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <array>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    // A schema stage whose rules describe a regular language (no recursion between symbols) is
+    // compiled into a DFA over byte classes at schema load; tokenizing with it is a table walk
+    // taking the longest match at each position.
+    class dfa
+    {
+    public:
+        using state_index = std::uint32_t;
+    public:
+        static constexpr state_index DeadState = 0u;
+        static constexpr std::size_t StateLimit = 4096u;
+        static constexpr std::size_t NfaStateLimit = 1u << 20u;
+    public:
+        static std::shared_ptr<dfa> compile(code_parser::grammar const& aGrammar);
+        static std::shared_ptr<dfa> compile(code_parser::grammar const& aGrammar, std::span<code_parser::symbol const> aSymbols);
+    public:
+        bool tokenize(std::string_view const& aSource) const;
+        bool tokenize(std::string_view const& aSource, token_stream& aTokens) const;
+        std::uint32_t match(std::string_view const& aSource, std::uint32_t aPosition) const;
+        std::uint32_t match(std::string_view const& aSource, std::uint32_t aPosition, state_index& aAcceptState) const;
+        std::span<code_parser::symbol const> accepted_symbols(state_index aState) const;
+        std::size_t state_count() const;
+        std::size_t class_count() const;
+    private:
+        std::array<std::uint8_t, 256u> iByteClass = {};
+        std::uint32_t iClassCount = 0u;
+        std::vector<state_index> iTransitions;
+        std::vector<bool> iAccepting;
+        std::vector<state_index> iEndStates;
+        std::vector<std::vector<code_parser::symbol>> iAcceptedSymbols;
+        // bytes on which a state transitions to itself so that runs of them (whitespace,
+        // identifier characters, digits) can be skipped a block at a time
+        std::vector<byte_class> iRuns;
+        state_index iStart = DeadState;
+    };
+}
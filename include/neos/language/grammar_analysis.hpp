@@ -0,0 +1,75 @@
+/*
+  grammar_analysis.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    // The worst case growth of the work matching a rule can take with the length of its input.
+    enum class cost_class : std::uint8_t
+    {
+        Bounded,
+        Linear,
+        Polynomial,
+        Exponential
+    };
+
+    enum class finding_type : std::uint8_t
+    {
+        ExponentialBacktracking,
+        LeftRecursion,
+        UnreachableRule,
+        ShadowedAlternative,
+        OverlappingRepetition
+    };
+
+    struct finding
+    {
+        finding_type type;
+        rule_index rule;
+        primitive_index primitive;
+        std::string message;
+    };
+
+    // What a stage grammar is found to do by looking at it rather than running it: the findings
+    // and a cost class for each rule (indexed by rule_index; only the stage's own rules are
+    // analyzed).
+    struct grammar_analysis
+    {
+        std::vector<finding> findings;
+        std::vector<cost_class> ruleCosts;
+    };
+
+    std::string_view to_string(cost_class aCost);
+    std::string_view to_string(finding_type aType);
+
+    // Analyzes a finalized grammar; without a root every stage symbol is a root, as it is for a
+    // tokenizer stage.
+    grammar_analysis analyze(grammar const& aGrammar, std::optional<code_parser::symbol> const& aRoot, bool aPackrat);
+    void write_analysis_report(std::ostream& aStream, grammar const& aGrammar, grammar_analysis const& aAnalysis);
+    void write_analysis_json(std::ostream& aStream, grammar const& aGrammar, grammar_analysis const& aAnalysis);
+}
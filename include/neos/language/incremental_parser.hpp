@@ -0,0 +1,91 @@
+/*
+  incremental_parser.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+#include <neos/language/dfa.hpp>
+#include <neos/language/parallel_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    // An edit to a source: aRemoved bytes at aOffset replaced by aInserted bytes.
+    struct source_edit
+    {
+        std::size_t offset;
+        std::size_t removed;
+        std::size_t inserted;
+    };
+
+    // Keeps the parse of each piece of a split source (every top level declaration a piece) so
+    // that after an edit only the pieces whose text has changed are parsed again. A piece is
+    // parsed, and tokenized, seeing only its own text so its parse holds wherever the piece
+    // moves to; pieces wholly before or after an edit are moved rather than parsed.
+    class incremental_parser
+    {
+    public:
+        struct bad_edit : std::logic_error { bad_edit() : std::logic_error("neos::language::code_parser::incremental_parser::bad_edit") {} };
+    public:
+        // pieces [first, first + removed) of the previous parse became [first, first + inserted),
+        // reparsed of which were parsed again (the rest moved); the pieces before and after are
+        // the previous parse's
+        struct damage
+        {
+            std::size_t first;
+            std::size_t removed;
+            std::size_t inserted;
+            std::size_t reparsed;
+        };
+    private:
+        struct piece
+        {
+            std::size_t begin;
+            std::size_t length;
+            std::unique_ptr<engine> parser;
+            bool parsed = false;
+        };
+    public:
+        incremental_parser(code_parser::grammar const& aGrammar, code_parser::symbol aRoot, split_hint const& aHint,
+            std::vector<std::shared_ptr<code_parser::dfa>> const& aTokenizers = {}, bool aPackrat = false);
+    public:
+        bool parse(std::string_view const& aSource);
+        bool reparse(std::string_view const& aSource, source_edit const& aEdit);
+        void create_ast(i_ast_sink& aSink, std::size_t aPiece);
+        damage const& last_damage() const;
+        std::size_t piece_count() const;
+        std::size_t piece_at(std::size_t aOffset) const;
+    private:
+        bool parse_piece(piece& aPiece);
+    private:
+        code_parser::grammar const& iGrammar;
+        code_parser::symbol iRoot;
+        split_hint iHint;
+        std::vector<std::shared_ptr<code_parser::dfa>> iTokenizers;
+        bool iPackrat;
+        std::string_view iSource;
+        std::vector<piece> iPieces;
+        token_stream iTokens;
+        damage iDamage = {};
+    };
+}
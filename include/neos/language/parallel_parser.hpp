@@ -0,0 +1,93 @@
+/*
+  parallel_parser.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    // Where a stage's source can be cut into pieces that its root symbol parses on its own: after
+    // a scope closing or a statement terminator at the top level or, for a language structured by
+    // indentation, before a line starting in the first column at the top level. Scopes, brackets
+    // and terminators inside quotes and comments don't count.
+    struct split_hint
+    {
+        static constexpr std::size_t DefaultPieceSize = 65536u;
+
+        std::vector<std::pair<std::string, std::string>> scopes;
+        std::vector<std::pair<std::string, std::string>> brackets;
+        std::vector<std::string> terminators;
+        std::vector<std::string> quotes;
+        std::string escape;
+        std::vector<std::string> lineComments;
+        std::vector<std::pair<std::string, std::string>> blockComments;
+        bool indentation = false;
+        std::size_t pieceSize = DefaultPieceSize;
+    };
+
+    // Cuts a source into pieces of at least the hint's piece size (bar the last).
+    std::vector<std::string_view> split_source(std::string_view const& aSource, split_hint const& aHint);
+
+    // Passes the ASTs of the pieces of a split source on to a sink as the one tree: the root is
+    // opened once over the whole source and closed by finish(), and the root of each piece is
+    // merged into it if they are the same concept.
+    class merged_ast_sink : public i_ast_sink
+    {
+    public:
+        merged_ast_sink(i_ast_sink& aSink, std::string_view const& aSource);
+    public:
+        void open_node(primitive_index aConcept, std::string_view const& aValue) final;
+        void close_node(primitive_index aConcept, std::string_view const& aValue) final;
+        void finish();
+    private:
+        i_ast_sink& iSink;
+        std::string_view iSource;
+        std::size_t iDepth = 0u;
+        bool iRootOpen = false;
+        primitive_index iRoot = npos;
+        bool iMerged = false;
+    };
+
+    // Parses the pieces of a split source on a pool of threads, an engine each sharing the grammar
+    // and the whole source's token stream, and emits their ASTs as the one tree.
+    class parallel_parser
+    {
+    public:
+        parallel_parser(code_parser::grammar const& aGrammar, bool aPackrat = false);
+    public:
+        bool parse(code_parser::symbol aRoot, std::string_view const& aSource, std::vector<std::string_view> const& aPieces, token_stream const& aTokens, std::size_t aThreads = 0u);
+        void create_ast(i_ast_sink& aSink);
+        std::size_t piece_count() const;
+        std::size_t thread_count() const;
+        code_parser::statistics statistics() const;
+    private:
+        code_parser::grammar const& iGrammar;
+        bool iPackrat;
+        std::string_view iSource;
+        std::vector<std::unique_ptr<engine>> iEngines;
+        std::size_t iThreads = 0u;
+    };
+}
@@ -20,17 +20,30 @@
 #pragma once
 
 #include <neos/neos.hpp>
+#include <functional>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/functional/hash.hpp>
 #include <neolib/core/i_map.hpp>
 #include <neolib/core/i_string.hpp>
+#include <neolib/core/reference_counted.hpp>
 #include <neolib/file/json.hpp>
 #include <neolib/file/parser.hpp>
 #include <neos/language/i_concept_library.hpp>
+#include <neos/language/code_parser.hpp>
+#include <neos/language/concept_registry.hpp>
+#include <neos/language/dfa.hpp>
+#include <neos/language/grammar_analysis.hpp>
+#include <neos/language/parallel_parser.hpp>
 
 namespace neos::language
 {
+    enum class parser_engine
+    {
+        Neolib,
+        Neos
+    };
+
     struct meta
     {
         std::string language;
@@ -41,6 +54,8 @@ namespace neos::language
         std::vector<std::string> sourcecodeModulePackageSpecificationFileExtension;
         std::vector<std::string> sourcecodeModulePackageImplementationFileExtension;
         std::size_t parserRecursionLimit = 256u;
+        parser_engine parserEngine = parser_engine::Neolib;
+        bool parserPackrat = false;
     };
 
     namespace code_parser
@@ -61,6 +76,43 @@ namespace neos::language
 
     using parser = neolib::parser<code_parser::symbol>;
 
+    // A stage's operator table for one of its expression symbols: the neos parser engine matches
+    // the expression as operands separated by the table's binary operators (precedence climbing)
+    // instead of through the rules spelling out one precedence level each.
+    struct operator_declaration
+    {
+        std::string text;
+        std::string semanticConcept;
+        std::uint32_t precedence;
+        bool rightAssociative;
+    };
+
+    struct operator_table_declaration
+    {
+        std::string expression;
+        std::string operand;
+        std::optional<std::string> separator;
+        std::vector<operator_declaration> operators;
+    };
+
+    // A semantic concept annotation bound to the concept it names when the schema is loaded.
+    struct bound_concept
+    {
+        neolib::ref_ptr<i_semantic_concept> semanticConcept;
+        bool fold = false;
+    };
+
+    struct concept_name_hash
+    {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view const& aName) const
+        {
+            return std::hash<std::string_view>{}(aName);
+        }
+    };
+
+    using bound_concepts = std::unordered_map<std::string, bound_concept, concept_name_hash, std::equal_to<>>;
+
     struct schema_stage
     {
         std::string name;
@@ -70,29 +122,53 @@ namespace neos::language
         std::shared_ptr<std::unordered_set<std::string>> discard;
         std::shared_ptr<std::unordered_map<std::string_view, code_parser::symbol>> symbolMap = {};
         std::shared_ptr<parser> parser = {};
+        std::shared_ptr<code_parser::grammar> codeGrammar = {};
+        std::shared_ptr<code_parser::dfa> dfa = {};
+        std::vector<operator_table_declaration> operators = {};
+        std::optional<code_parser::split_hint> split = {};
+        code_parser::grammar_analysis analysis = {};
+        // by name (for the neolib parser engine) and by code grammar primitive (for the neos one)
+        bound_concepts concepts = {};
+        std::vector<bound_concept> primitiveConcepts = {};
     };
 
     using pipeline = std::vector<std::unique_ptr<schema_stage>>;
 
     class schema
     {
+    public:
+        struct bad_image : std::runtime_error { bad_image() : std::runtime_error("neos::language::schema::bad_image") {} };
     public:
         static constexpr std::size_t RecursionLimit = 64u;
+        static constexpr std::uint32_t ImageVersion = 5u;
     public:
-        schema(std::string const& aPath, const concept_libraries_t& aConceptLibraries);
+        schema(std::string const& aPath, const concept_libraries_t& aConceptLibraries, const concept_registry& aConceptRegistry);
     public:
         std::string const& path() const;
+        std::string image_path() const;
+        bool loaded_from_image() const;
         language::meta const& meta() const;
         language::pipeline const& pipeline() const;
+        void write_analysis(std::ostream& aStream, bool aJson = false) const;
     private:
+        void parse_source(std::string& aImage);
         void parse_meta(neolib::rjson_value const& aNode);
+        std::vector<operator_table_declaration> parse_operators(neolib::rjson_value const& aNode) const;
+        code_parser::split_hint parse_split_hint(neolib::rjson_value const& aNode) const;
+        std::uint64_t image_key() const;
+        bool load_image();
+        void save_image(std::string const& aImage) const;
+        void analyze();
+        void bind_concepts();
         void throw_error(neolib::rjson_value const& aNode, const std::string aErrorText) const;
     private:
         std::string iPath;
         std::string iSource;
+        bool iLoadedFromImage = false;
         neolib::rjson iMetaSource;
         language::meta iMeta;
         language::pipeline iPipeline;
         const concept_libraries_t& iConceptLibraries;
+        const concept_registry& iConceptRegistry;
     };
 }
\ No newline at end of file
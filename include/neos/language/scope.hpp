@@ -20,6 +20,7 @@
 #pragma once
 
 #include <neos/neos.hpp>
+#include <string>
 #include <unordered_map>
 #include <neolib/core/reference_counted.hpp>
 #include <neolib/core/vector.hpp>
@@ -76,7 +77,7 @@ namespace neos
         public:
             using child_list = neolib::vector<neolib::ref_ptr<i_scope>>;
         private:
-            using index = std::unordered_map<std::string_view, child_list::iterator>;
+            using index = std::unordered_map<std::string, i_scope*>;
         public:
             scope() :
                 iParent{ nullptr },
@@ -132,6 +133,8 @@ namespace neos
             }
         public:
             i_scope& create_child(i_scope_name const& aName, scope_type aType) final;
+            // not on i_scope: a child is only taken away by the compiler that made it
+            void remove_child(i_scope const& aChild);
         private:
             i_scope* iParent;
             neolib::string iName;
@@ -161,29 +164,39 @@ namespace neos
         template <typename Base>
         inline i_scope& scope<Base>::create_child(i_scope_name const& aName, scope_type aType)
         {
-            auto const indexed = iChildIndex.find(aName.to_std_string_view());
+            auto const indexed = iChildIndex.find(aName.to_std_string());
             if (indexed != iChildIndex.end())
-                return **indexed->second;
+                return *indexed->second;
             switch (aType)
             {
             case scope_type::Namespace:
-                iChildIndex[aName.to_std_string_view()] = children().insert(
-                    children().end(), neolib::make_ref<scope<>>(*this, aName, aType));
+                children().push_back(neolib::make_ref<scope<>>(*this, aName, aType));
                 break;
             case scope_type::Class:
-                iChildIndex[aName.to_std_string_view()] = children().insert(
-                    children().end(), neolib::make_ref<scope<>>(*this, aName, aType));
+                children().push_back(neolib::make_ref<scope<>>(*this, aName, aType));
                 break;
             case scope_type::Function:
-                iChildIndex[aName.to_std_string_view()] = children().insert(
-                    children().end(), neolib::make_ref<function_scope, i_scope>(*this, aName, aType));
+                children().push_back(neolib::make_ref<function_scope, i_scope>(*this, aName, aType));
                 break;
             case scope_type::Block:
-                iChildIndex[aName.to_std_string_view()] = children().insert(
-                    children().end(), neolib::make_ref<scope<>>(*this, aName, aType));
+                children().push_back(neolib::make_ref<scope<>>(*this, aName, aType));
                 break;
             }
-            return **iChildIndex[aName.to_std_string_view()];
+            return *(iChildIndex[aName.to_std_string()] = &*children().back());
+        }
+
+        // The index holds the children rather than positions in the list so that it survives the
+        // list growing or a child being taken out of it.
+        template <typename Base>
+        inline void scope<Base>::remove_child(i_scope const& aChild)
+        {
+            iChildIndex.erase(aChild.name().to_std_string());
+            for (auto child = children().begin(); child != children().end(); ++child)
+                if (&**child == &aChild)
+                {
+                    children().erase(child);
+                    return;
+                }
         }
 
     }
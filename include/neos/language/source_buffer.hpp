@@ -0,0 +1,57 @@
+/*
+  source_buffer.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace neos::language
+{
+    // A source file mapped into memory read only. A fragment loaded from a file shares one rather
+    // than holding a copy of its text so the views of the source its AST and semantic concepts
+    // take refer to the mapping, which lasts as long as any fragment shares it. A text that isn't
+    // a file's (an edited source) is held in memory instead.
+    class source_buffer
+    {
+    public:
+        struct cannot_map : std::runtime_error { cannot_map(std::string const& aPath) : std::runtime_error("neos::language::source_buffer::cannot_map: " + aPath) {} };
+    private:
+        struct mapping;
+        struct held {};
+    public:
+        static std::shared_ptr<source_buffer const> map(std::string const& aPath);
+        static std::shared_ptr<source_buffer const> hold(std::string aText);
+    public:
+        source_buffer(std::string const& aPath);
+        source_buffer(held, std::string aText);
+        ~source_buffer();
+    public:
+        std::string const& path() const;
+        std::string_view text() const;
+    private:
+        std::string iPath;
+        std::unique_ptr<mapping> iMapping;
+        std::string iHeld;
+        std::string_view iText;
+    };
+}
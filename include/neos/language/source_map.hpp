@@ -0,0 +1,65 @@
+/*
+  source_map.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace neos::language
+{
+    class source_fragment;
+    struct translation_unit;
+
+    // Where a position in a program's source is: line and column from 1, the column in code points.
+    // For a piece of a streamed source all three are in the whole stream.
+    struct source_location
+    {
+        translation_unit const* unit;
+        source_fragment const* fragment;
+        std::size_t offset;
+        std::uint32_t line;
+        std::uint32_t column;
+    };
+
+    // Finds the fragment a position in a program's source is in from the extents of the
+    // fragments' sources ordered by address, and its line and column from the fragment's index
+    // of line starts. The extents are taken again on the first look up after any fragment has been
+    // made, destroyed or given a new source.
+    class source_map
+    {
+    private:
+        struct extent
+        {
+            char const* begin;
+            char const* end;
+            std::size_t unit;
+            source_fragment const* fragment;
+        };
+    public:
+        std::optional<source_location> locate(std::vector<translation_unit> const& aUnits, char const* aPosition) const;
+    private:
+        void update(std::vector<translation_unit> const& aUnits) const;
+    private:
+        mutable std::vector<extent> iExtents;
+        mutable std::optional<std::uint64_t> iGeneration;
+    };
+}
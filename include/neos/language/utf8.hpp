@@ -0,0 +1,57 @@
+/*
+  utf8.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <string_view>
+#include <vector>
+
+namespace neos::language
+{
+    // What a pass over a text finds: whether it is valid UTF-8, the number of code points in it and
+    // the offset of the start of each of its lines (the first at 0).
+    struct text_index
+    {
+        // both from 0, the column in code points
+        struct position_type
+        {
+            std::size_t line;
+            std::size_t column;
+        };
+
+        bool valid = false;
+        std::size_t codePoints = 0u;
+        std::vector<std::size_t> lineStarts;
+
+        // the line (from 0) aOffset is on
+        std::size_t line(std::size_t aOffset) const;
+        // the line and column of aOffset in the text indexed
+        position_type position(std::string_view const& aText, std::size_t aOffset) const;
+    };
+
+    // Validates UTF-8 as RFC 3629 has it: no overlong forms, surrogates or code points past
+    // U+10FFFF. Runs of ASCII, most of any source, are checked sixteen bytes at a time.
+    bool validate_utf8(std::string_view const& aText);
+    // Validates, counts and finds the lines of a text in the one pass; counting stops at the
+    // first invalid sequence.
+    text_index index_text(std::string_view const& aText);
+    // Counts the code points of valid UTF-8.
+    std::size_t count_code_points(std::string_view const& aText);
+}
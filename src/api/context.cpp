@@ -25,6 +25,7 @@
 #include <neolib/core/string_utf.hpp>
 #include <neolib/app/application.hpp>
 #include <neos/context.hpp>
+#include <neos/language/utf8.hpp>
 
 namespace neos
 {
@@ -72,11 +73,19 @@ namespace neos
 
     void context::find_concept(neolib::i_string_view const& aSymbol, neolib::i_ref_ptr<language::i_semantic_concept>& aResult) const
     {
-        for (auto const& cl : iConceptLibraries)
-        {
-            if (cl.second()->find_concept(aSymbol, aResult))
-                return;
-        }
+        if (auto const c = iConceptRegistry.find(aSymbol.to_std_string_view()))
+            aResult.reset(c);
+    }
+
+    void context::find_concept(language::concept_id aId, neolib::i_ref_ptr<language::i_semantic_concept>& aResult) const
+    {
+        if (auto const c = iConceptRegistry.find(aId))
+            aResult.reset(c);
+    }
+
+    language::concept_id context::find_concept_id(std::string_view const& aSymbol) const
+    {
+        return iConceptRegistry.id(aSymbol);
     }
 
     bool context::schema_loaded() const
@@ -91,7 +100,10 @@ namespace neos
             throw no_schema_path_specified();
         cout() << "Loading schema '" + schemaPath + "'..." << std::endl;
         iSchema.reset();
-        iSchema = std::make_shared<language::schema>(schemaPath, concept_libraries());
+        iSchema = std::make_shared<language::schema>(schemaPath, concept_libraries(), iConceptRegistry);
+        for (auto const& stage : iSchema->pipeline())
+            for (auto const& finding : stage->analysis.findings)
+                cout() << "Warning: schema stage '" << stage->name << "': " << finding.message << std::endl;
         for (auto& unit : program().translationUnits)
             unit.schema = iSchema;
     }
@@ -125,6 +137,20 @@ namespace neos
         compiler().compile(program());
     }
 
+    void context::stream_program(std::string const& aPath)
+    {
+        iProgram = decltype(iProgram){};
+        std::ifstream stream{ aPath, std::ios::binary };
+        if (!stream)
+            throw compiler_error("failed to open source file '" + aPath + "'");
+        stream_unit(language::source_fragment{ neolib::string{ aPath } }, stream);
+    }
+
+    void context::stream_program(std::istream& aStream)
+    {
+        stream_unit(language::source_fragment{}, aStream);
+    }
+
     const context::program_t& context::program() const
     {
         return iProgram;
@@ -193,6 +219,7 @@ namespace neos
             };
             add_sublibraries(add_sublibraries, *library);
         }
+        iConceptRegistry.build(iConceptLibraries);
     }
 
     context::translation_unit_t& context::load_unit(language::source_fragment&& aFragment)
@@ -200,11 +227,12 @@ namespace neos
         if (!schema_loaded())
             throw compiler_error("no schema loaded");
 
-        std::ifstream fragmentStream{ aFragment.source_file_path()->to_std_string(), std::ios::binary};
-        if (!fragmentStream)
-            throw compiler_error("failed to open source file '" + aFragment.source_file_path()->to_std_string() + "'");
+        auto& unit = *program().translationUnits.insert(program().translationUnits.end(),
+            translation_unit_t{ iSchema, { std::move(aFragment) }, language::ast{ program().symbolTable } });
+
+        map_fragment(unit.fragments.back(), unit.fragments.back().source_file_path()->to_std_string());
 
-        return load_unit(std::move(aFragment), fragmentStream);
+        return unit;
     }
 
     context::translation_unit_t& context::load_unit(language::source_fragment&& aFragment, std::istream& aStream)
@@ -220,36 +248,79 @@ namespace neos
         return unit;
     }
 
+    // Unlike load_unit() the source isn't read here: the compiler reads it a piece at a time
+    // compiling each as it goes.
+    void context::stream_unit(language::source_fragment&& aFragment, std::istream& aStream)
+    {
+        if (!schema_loaded())
+            throw compiler_error("no schema loaded");
+        if (!aStream)
+            throw compiler_error("input stream bad");
+
+        auto& unit = *program().translationUnits.insert(program().translationUnits.end(),
+            translation_unit_t{ iSchema, { std::move(aFragment) }, language::ast{ program().symbolTable } });
+
+        compiler().compile(program(), unit, unit.fragments.back(), aStream);
+    }
+
     void context::load_fragment(language::i_source_fragment& aFragment)
     {
         if (aFragment.source_file_path() == std::nullopt)
             throw invalid_fragment();
 
         auto const sourceFilePath = aFragment.source_file_path().value().to_std_string();
-        std::optional<std::ifstream> fragmentStream;
-        fragmentStream.emplace(sourceFilePath, std::ios::binary);
-        if (!*fragmentStream)
+        auto const is_file = [](std::string const& aPath)
+        {
+            std::error_code error;
+            return std::filesystem::is_regular_file(aPath, error);
+        };
+        std::optional<std::string> foundPath;
+        if (is_file(sourceFilePath))
+            foundPath = sourceFilePath;
+        else
             for (auto const& ext : schema().meta().sourcecodeFileExtension)
             {
                 std::string tryPath = "packages/" + schema().meta().language + "/" + sourceFilePath + ext;
-                fragmentStream.emplace(tryPath, std::ios::binary);
-                if (*fragmentStream)
+                if (is_file(tryPath))
                 {
-                    aFragment.source_file_path().value() = tryPath;
+                    foundPath = tryPath;
                     break;
                 }
                 tryPath = compiler().current_fragment().source_directory_path().value() + "/" + sourceFilePath + ext;
-                fragmentStream.emplace(tryPath, std::ios::binary);
-                if (*fragmentStream)
+                if (is_file(tryPath))
                 {
-                    aFragment.source_file_path().value() = tryPath;
+                    foundPath = tryPath;
                     break;
                 }
             }
-        if (!*fragmentStream)
+        if (!foundPath)
             throw compiler_error("failed to open source file '" + sourceFilePath + "'");
+        if (*foundPath != sourceFilePath)
+            aFragment.source_file_path().value() = *foundPath;
 
-        load_fragment(aFragment, *fragmentStream);
+        map_fragment(aFragment, *foundPath);
+    }
+
+    // A fragment of ours shares the mapping of its file; any other gets a copy of the text.
+    void context::map_fragment(language::i_source_fragment& aFragment, std::string const& aPath)
+    {
+        std::shared_ptr<language::source_buffer const> buffer;
+        try
+        {
+            buffer = language::source_buffer::map(aPath);
+        }
+        catch (language::source_buffer::cannot_map const&)
+        {
+            throw compiler_error("failed to open source file '" + aPath + "'");
+        }
+
+        auto* fragment = dynamic_cast<language::source_fragment*>(&aFragment);
+        if (fragment != nullptr)
+            fragment->set_source(buffer);
+        else
+            aFragment.set_source(language::source_t{ buffer->text() });
+
+        check_source(aFragment);
     }
 
     void context::load_fragment(language::i_source_fragment& aFragment, std::istream& aStream)
@@ -292,10 +363,19 @@ namespace neos
             aFragment.set_source(source.to_string_view());
         }
 
+        check_source(aFragment);
+    }
+
+    void context::check_source(language::i_source_fragment const& aFragment)
+    {
         if (aFragment.source().empty())
             throw compiler_error("no source code");
 
-        if (!neolib::check_utf8(aFragment.source()))
+        // ours keep the index made validating them for placing diagnostics later
+        auto const* fragment = dynamic_cast<language::source_fragment const*>(&aFragment);
+        bool const valid = (fragment != nullptr ?
+            fragment->index().valid : language::validate_utf8(aFragment.source().to_std_string_view()));
+        if (!valid)
             throw compiler_error("source file has invalid utf-8");
     }
 }
\ No newline at end of file
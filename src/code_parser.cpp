@@ -0,0 +1,1866 @@
+/*
+  code_parser.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NEOS_CODE_PARSER_SSE2
+#include <emmintrin.h>
+#endif
+#include <neolib/core/scoped.hpp>
+#include <neos/language/code_parser.hpp>
+#include <neos/language/dfa.hpp>
+
+namespace neos::language::code_parser
+{
+    namespace
+    {
+        node_index const NoNode = npos;
+
+        char32_t decode_utf8(std::string_view const& aSource, std::uint32_t aPosition, std::uint32_t& aLength)
+        {
+            auto const lead = static_cast<std::uint8_t>(aSource[aPosition]);
+            std::uint32_t length = (lead < 0x80u ? 1u : (lead & 0xE0u) == 0xC0u ? 2u : (lead & 0xF0u) == 0xE0u ? 3u : (lead & 0xF8u) == 0xF0u ? 4u : 0u);
+            if (length == 0u || aPosition + length > aSource.size())
+            {
+                aLength = 1u;
+                return lead;
+            }
+            char32_t result = (length == 1u ? lead : length == 2u ? lead & 0x1Fu : length == 3u ? lead & 0x0Fu : lead & 0x07u);
+            for (std::uint32_t i = 1u; i < length; ++i)
+            {
+                auto const next = static_cast<std::uint8_t>(aSource[aPosition + i]);
+                if ((next & 0xC0u) != 0x80u)
+                {
+                    aLength = 1u;
+                    return lead;
+                }
+                result = (result << 6) | (next & 0x3Fu);
+            }
+            aLength = length;
+            return result;
+        }
+
+        std::uint64_t keyword_hash(std::string_view const& aText, std::uint64_t aSeed)
+        {
+            std::uint64_t hash = 0xCBF29CE484222325ull ^ (aSeed * 0x9E3779B97F4A7C15ull);
+            for (auto ch : aText)
+            {
+                hash ^= static_cast<std::uint8_t>(ch);
+                hash *= 0x100000001B3ull;
+            }
+            return hash ^ (hash >> 29u);
+        }
+    }
+
+    std::bitset<256> range_bitmap(std::string_view const& aLow, std::string_view const& aHigh, bool aNegate)
+    {
+        std::uint32_t length = 0u;
+        char32_t const low = aLow.empty() ? U'\0' : decode_utf8(aLow, 0u, length);
+        char32_t const high = aHigh.empty() ? U'\0' : decode_utf8(aHigh, 0u, length);
+        std::bitset<256> result;
+        for (std::uint32_t byte = 0u; byte < 256u; ++byte)
+            result.set(byte, (byte >= low && byte <= high) != aNegate);
+        return result;
+    }
+
+    void byte_class::assign(std::bitset<256> const& aBitmap)
+    {
+        bitmap = aBitmap;
+        rangeCount = 0u;
+        for (std::uint32_t byte = 0u; byte < 256u; ++byte)
+        {
+            if (!bitmap.test(byte))
+                continue;
+            auto const first = byte;
+            while (byte + 1u < 256u && bitmap.test(byte + 1u))
+                ++byte;
+            if (rangeCount == RangeLimit)
+            {
+                // too many ranges to test a block at a time; scan() falls back to the bitmap
+                rangeCount = 0u;
+                return;
+            }
+            low[rangeCount] = static_cast<std::uint8_t>(first);
+            span[rangeCount] = static_cast<std::uint8_t>(byte - first);
+            ++rangeCount;
+        }
+    }
+
+    std::size_t byte_class::scan(std::string_view const& aSource, std::size_t aPosition) const
+    {
+        auto position = aPosition;
+#ifdef NEOS_CODE_PARSER_SSE2
+        while (rangeCount != 0u && position + 16u <= aSource.size())
+        {
+            auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(aSource.data() + position));
+            auto member = _mm_setzero_si128();
+            for (std::uint32_t i = 0u; i < rangeCount; ++i)
+            {
+                // unsigned (byte - low) <= span
+                auto const offset = _mm_sub_epi8(block, _mm_set1_epi8(static_cast<char>(low[i])));
+                member = _mm_or_si128(member, _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(static_cast<char>(span[i]))), offset));
+            }
+            auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(member));
+            if (mask != 0xFFFFu)
+                return position + std::countr_one(mask);
+            position += 16u;
+        }
+#endif
+        while (position < aSource.size() && bitmap.test(static_cast<std::uint8_t>(aSource[position])))
+            ++position;
+        return position;
+    }
+
+    void keyword_table::build()
+    {
+        for (std::size_t size = 2u;; size *= 2u)
+        {
+            if (size < entries.size() * 2u)
+                continue;
+            for (seed = 0u; seed < 256u; ++seed)
+            {
+                slots.assign(size, npos);
+                bool collision = false;
+                for (std::uint32_t e = 0u; e < entries.size() && !collision; ++e)
+                {
+                    auto& slot = slots[keyword_hash(entries[e].text, seed) & (size - 1u)];
+                    collision = (slot != npos);
+                    slot = e;
+                }
+                if (!collision)
+                    return;
+            }
+        }
+    }
+
+    std::span<code_parser::symbol const> keyword_table::find(std::string_view const& aText) const
+    {
+        auto const e = slots[keyword_hash(aText, seed) & (slots.size() - 1u)];
+        if (e == npos || entries[e].text != aText)
+            return {};
+        return entries[e].symbols;
+    }
+
+    primitive_index grammar::add(primitive&& aPrimitive)
+    {
+        primitives.push_back(std::move(aPrimitive));
+        return static_cast<primitive_index>(primitives.size() - 1u);
+    }
+
+    void grammar::finalize(std::unordered_map<std::string_view, code_parser::symbol> const& aSymbolMap, std::unordered_set<std::string> const& aDiscard)
+    {
+        symbolNames.assign(aSymbolMap.size(), std::string{});
+        for (auto const& s : aSymbolMap)
+            symbolNames[static_cast<std::size_t>(s.second)] = s.first;
+
+        discard.assign(aSymbolMap.size(), false);
+        for (auto const& d : aDiscard)
+        {
+            auto const existing = aSymbolMap.find(d);
+            if (existing != aSymbolMap.end())
+                discard[static_cast<std::size_t>(existing->second)] = true;
+        }
+
+        rulesBySymbol.assign(aSymbolMap.size(), std::vector<rule_index>{});
+        stageSymbols.clear();
+        for (rule_index r = 0u; r < rules.size(); ++r)
+        {
+            auto const lhs = primitives[rules[r].lhs].symbol;
+            auto& symbolRules = rulesBySymbol[static_cast<std::size_t>(lhs)];
+            if (r >= stageRules && std::find(stageSymbols.begin(), stageSymbols.end(), lhs) == stageSymbols.end())
+                stageSymbols.push_back(lhs);
+            symbolRules.push_back(r);
+        }
+        // an operator table's rule stands in for the rules spelling out its precedence levels
+        for (rule_index r = 0u; r < rules.size(); ++r)
+            if (rules[r].rhs.size() == 1u && primitives[rules[r].rhs[0]].type == primitive_type::Operators)
+                rulesBySymbol[static_cast<std::size_t>(primitives[rules[r].lhs].symbol)].assign(1u, r);
+
+        // ranges are built with their end points as terminal children; resolve them once here
+        for (auto& p : primitives)
+        {
+            if (p.type != primitive_type::Range || p.children.size() != 2u)
+                continue;
+            auto const& low = primitives[p.children[0]].text;
+            auto const& high = primitives[p.children[1]].text;
+            p.codepoints = low.size() > 1u || high.size() > 1u;
+            std::uint32_t length = 0u;
+            p.low = low.empty() ? U'\0' : p.codepoints ? decode_utf8(low, 0u, length) : static_cast<std::uint8_t>(low[0]);
+            p.high = high.empty() ? U'\0' : p.codepoints ? decode_utf8(high, 0u, length) : static_cast<std::uint8_t>(high[0]);
+            // a code point range's bitmap covers ASCII only; other bytes have to be decoded
+            std::bitset<256> bytes;
+            for (std::uint32_t byte = 0u; byte < (p.codepoints ? 0x80u : 256u); ++byte)
+                bytes.set(byte, ((byte >= p.low && byte <= p.high) != p.negate) && !p.exclusions.test(byte));
+            p.byteClass.assign(bytes);
+        }
+
+        predict();
+        find_bounded();
+        find_runs();
+        find_leaves();
+        find_keywords();
+        find_trivia();
+    }
+
+    std::vector<rule_index> const& grammar::rules_for(code_parser::symbol aSymbol) const
+    {
+        static std::vector<rule_index> const sNone;
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < rulesBySymbol.size() ? rulesBySymbol[index] : sNone;
+    }
+
+    std::string_view grammar::symbol_name(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < symbolNames.size() ? std::string_view{ symbolNames[index] } : std::string_view{};
+    }
+
+    // A rule is named after its symbol, numbered if the symbol has more than one.
+    std::string grammar::rule_name(rule_index aRule) const
+    {
+        auto const symbol = primitives[rules[aRule].lhs].symbol;
+        std::string result{ symbol_name(symbol) };
+        std::size_t count = 0u;
+        std::size_t number = 0u;
+        for (rule_index r = 0u; r < rules.size(); ++r)
+            if (primitives[rules[r].lhs].symbol == symbol)
+            {
+                ++count;
+                if (r <= aRule)
+                    ++number;
+            }
+        if (count > 1u)
+            result += " #" + std::to_string(number);
+        return result;
+    }
+
+    bool grammar::discarded(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < discard.size() && discard[index];
+    }
+
+    prediction const& grammar::symbol_prediction(code_parser::symbol aSymbol) const
+    {
+        static prediction const sNone;
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < symbolPredictions.size() ? symbolPredictions[index] : sNone;
+    }
+
+    bool grammar::leaf(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < leaves.size() && leaves[index];
+    }
+
+    bool grammar::bounded(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < boundedSymbols.size() && boundedSymbols[index];
+    }
+
+    keyword_table const* grammar::keyword(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < keywords.size() && keywords[index] != npos ? &keywordTables[keywords[index]] : nullptr;
+    }
+
+    dfa const* grammar::trivia_scanner(code_parser::symbol aSymbol) const
+    {
+        auto const index = static_cast<std::size_t>(aSymbol);
+        return index < triviaScanners.size() ? triviaScanners[index].get() : nullptr;
+    }
+
+    // FIRST sets and nullable flags are the least fixed point over the grammar; primitives are
+    // visited in reverse as children are added after their parents.
+    void grammar::predict()
+    {
+        primitivePredictions.assign(primitives.size(), prediction{});
+        rulePredictions.assign(rules.size(), prediction{});
+        symbolPredictions.assign(rulesBySymbol.size(), prediction{});
+
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            auto const update = [&](prediction& aExisting, prediction const& aNew)
+            {
+                auto const merged = prediction{ aExisting.first | aNew.first, aExisting.nullable || aNew.nullable };
+                if (merged.first != aExisting.first || merged.nullable != aExisting.nullable)
+                {
+                    aExisting = merged;
+                    changed = true;
+                }
+            };
+            for (auto index = primitives.size(); index-- > 0u;)
+            {
+                auto const& p = primitives[index];
+                prediction next;
+                switch (p.type)
+                {
+                case primitive_type::Symbol:
+                    next = symbol_prediction(p.symbol);
+                    if (p.constraint)
+                    {
+                        std::bitset<256> constrained;
+                        if (!p.constraint->empty())
+                            constrained.set(static_cast<std::uint8_t>((*p.constraint)[0]));
+                        next.first &= constrained;
+                        next.nullable = next.nullable && p.constraint->empty();
+                    }
+                    break;
+                case primitive_type::Terminal:
+                    if (p.text.empty())
+                        next.nullable = true;
+                    else
+                        next.first.set(static_cast<std::uint8_t>(p.text[0]));
+                    break;
+                case primitive_type::Range:
+                    next.first = p.byteClass.bitmap;
+                    // a non-ASCII lead byte (or an invalid one, which decodes as itself) can start a
+                    // code point range unless the range is wholly ASCII
+                    if (p.codepoints && (p.negate || p.high >= 0x80u))
+                        for (std::uint32_t byte = 0x80u; byte < 256u; ++byte)
+                            next.first.set(byte);
+                    break;
+                case primitive_type::Concatenation:
+                    next = predict_sequence(p.children);
+                    break;
+                case primitive_type::Alternation:
+                    for (auto alternative : p.children)
+                    {
+                        next.first |= primitivePredictions[alternative].first;
+                        next.nullable = next.nullable || primitivePredictions[alternative].nullable;
+                    }
+                    break;
+                case primitive_type::Repetition:
+                    next = predict_sequence(p.children);
+                    next.nullable = next.nullable || !p.atLeastOne;
+                    break;
+                case primitive_type::Optional:
+                    next = predict_sequence(p.children);
+                    next.nullable = true;
+                    break;
+                case primitive_type::Operators:
+                    next = primitivePredictions[p.children[0]];
+                    break;
+                case primitive_type::Eof:
+                    next.nullable = true;
+                    break;
+                }
+                update(primitivePredictions[index], next);
+            }
+            for (rule_index r = 0u; r < rules.size(); ++r)
+            {
+                auto const next = predict_sequence(rules[r].rhs);
+                update(rulePredictions[r], next);
+                update(symbolPredictions[static_cast<std::size_t>(primitives[rules[r].lhs].symbol)], next);
+            }
+        }
+    }
+
+    // A primitive or symbol is bounded if matching it cannot reach a symbol through which the
+    // grammar recurses, so the depth of nesting it can match is bounded by the grammar rather than
+    // by the input.
+    void grammar::find_bounded()
+    {
+        boundedPrimitives.assign(primitives.size(), false);
+        boundedSymbols.assign(rulesBySymbol.size(), false);
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (auto index = primitives.size(); index-- > 0u;)
+            {
+                if (boundedPrimitives[index])
+                    continue;
+                auto const& p = primitives[index];
+                bool const isBounded = p.type == primitive_type::Symbol ? bounded(p.symbol) :
+                    std::all_of(p.children.begin(), p.children.end(), [&](primitive_index aChild) { return boundedPrimitives[aChild]; });
+                if (isBounded)
+                    changed = boundedPrimitives[index] = true;
+            }
+            for (std::size_t symbol = 0u; symbol < rulesBySymbol.size(); ++symbol)
+            {
+                if (boundedSymbols[symbol])
+                    continue;
+                bool isBounded = true;
+                for (auto r : rulesBySymbol[symbol])
+                    for (auto element : rules[r].rhs)
+                        isBounded = isBounded && boundedPrimitives[element];
+                if (isBounded)
+                    changed = boundedSymbols[symbol] = true;
+            }
+        }
+    }
+
+    // A repetition of a range, or of an alternation one of whose alternatives is a range, spends
+    // most of its time matching one byte per iteration (string literal and comment bodies); the
+    // bytes for which an iteration can only be such a match, producing no nodes, form the
+    // repetition's run class and the engine scans a run of them without iterating.
+    void grammar::find_runs()
+    {
+        for (auto& p : primitives)
+        {
+            p.run = byte_class{};
+            if (p.type != primitive_type::Repetition || p.children.size() != 1u)
+                continue;
+            auto const& element = primitives[p.children[0]];
+            if (element.c)
+                continue;
+            std::bitset<256> run;
+            if (element.type == primitive_type::Range)
+                run = element.byteClass.bitmap;
+            else if (element.type == primitive_type::Alternation)
+            {
+                std::bitset<256> others;
+                bool viable = true;
+                for (auto alternative : element.children)
+                {
+                    auto const& a = primitives[alternative];
+                    if (a.type == primitive_type::Range && !a.c)
+                        run |= a.byteClass.bitmap;
+                    else if (primitivePredictions[alternative].nullable)
+                        viable = false;
+                    else
+                        others |= primitivePredictions[alternative].first;
+                }
+                if (!viable)
+                    continue;
+                run &= ~others;
+            }
+            p.run.assign(run);
+        }
+    }
+
+    // A leaf symbol produces at most one node, for its own concept, so once a tokenizer stage has
+    // matched it the engine can take the token rather than descend into its rules.
+    void grammar::find_leaves()
+    {
+        enum class visit_state : std::uint8_t
+        {
+            Unvisited,
+            Visiting,
+            Leaf,
+            NotLeaf
+        };
+        std::vector<visit_state> states(rulesBySymbol.size(), visit_state::Unvisited);
+        leaves.assign(rulesBySymbol.size(), false);
+        leafConcepts.assign(rulesBySymbol.size(), npos);
+
+        auto const visit_symbol = [&](auto const& self, code_parser::symbol aSymbol) -> bool
+        {
+            auto const index = static_cast<std::size_t>(aSymbol);
+            if (index >= states.size() || states[index] == visit_state::Visiting)
+                return false;
+            if (states[index] != visit_state::Unvisited)
+                return states[index] == visit_state::Leaf;
+            states[index] = visit_state::Visiting;
+            auto const visit_primitive = [&](auto const& selfPrimitive, primitive_index aPrimitive) -> bool
+            {
+                auto const& p = primitives[aPrimitive];
+                if (p.c)
+                    return false;
+                if (p.type == primitive_type::Symbol)
+                    return discarded(p.symbol) || (self(self, p.symbol) && leafConcepts[static_cast<std::size_t>(p.symbol)] == npos);
+                for (auto child : p.children)
+                    if (!selfPrimitive(selfPrimitive, child))
+                        return false;
+                return true;
+            };
+            auto const& symbolRules = rulesBySymbol[index];
+            bool isLeaf = !symbolRules.empty();
+            for (auto r : symbolRules)
+            {
+                if (primitives[rules[r].lhs].c != primitives[rules[symbolRules[0]].lhs].c)
+                    isLeaf = false;
+                for (auto element : rules[r].rhs)
+                    isLeaf = isLeaf && visit_primitive(visit_primitive, element);
+            }
+            if (isLeaf && primitives[rules[symbolRules[0]].lhs].c)
+                leafConcepts[index] = rules[symbolRules[0]].lhs;
+            states[index] = isLeaf ? visit_state::Leaf : visit_state::NotLeaf;
+            leaves[index] = isLeaf;
+            return isLeaf;
+        };
+        for (std::size_t index = 0u; index < rulesBySymbol.size(); ++index)
+            visit_symbol(visit_symbol, static_cast<code_parser::symbol>(index));
+    }
+
+    // A keyword symbol has a single rule whose right hand side is a constrained reference to a
+    // lexeme symbol; the lexeme must be a leaf without a concept so that matching it produces no
+    // nodes and the keyword's own node can be made directly.
+    void grammar::find_keywords()
+    {
+        keywordTables.clear();
+        keywords.assign(rulesBySymbol.size(), npos);
+        for (std::size_t index = 0u; index < rulesBySymbol.size(); ++index)
+        {
+            auto const& symbolRules = rulesBySymbol[index];
+            if (symbolRules.size() != 1u || rules[symbolRules[0]].rhs.size() != 1u)
+                continue;
+            auto const& rhs = primitives[rules[symbolRules[0]].rhs[0]];
+            if (rhs.type != primitive_type::Symbol || !rhs.constraint || rhs.c || !leaf(rhs.symbol) ||
+                leafConcepts[static_cast<std::size_t>(rhs.symbol)] != npos)
+                continue;
+            auto table = std::find_if(keywordTables.begin(), keywordTables.end(),
+                [&](keyword_table const& aTable) { return aTable.lexeme == rhs.symbol; });
+            if (table == keywordTables.end())
+            {
+                keywordTables.emplace_back().lexeme = rhs.symbol;
+                table = std::prev(keywordTables.end());
+            }
+            auto entry = std::find_if(table->entries.begin(), table->entries.end(),
+                [&](keyword_table::entry const& aEntry) { return aEntry.text == *rhs.constraint; });
+            if (entry == table->entries.end())
+            {
+                table->entries.emplace_back().text = *rhs.constraint;
+                entry = std::prev(table->entries.end());
+            }
+            entry->symbols.push_back(static_cast<code_parser::symbol>(index));
+            keywords[index] = static_cast<std::uint32_t>(std::distance(keywordTables.begin(), table));
+        }
+        for (auto& table : keywordTables)
+            table.build();
+    }
+
+    // A discarded symbol describing a regular language (as whitespace and comments do) is compiled
+    // into its own DFA so that the engine skips it with a table walk instead of matching its rules
+    // and building nodes that would only be thrown away.
+    void grammar::find_trivia()
+    {
+        triviaScanners.assign(rulesBySymbol.size(), nullptr);
+        for (std::size_t index = 0u; index < rulesBySymbol.size(); ++index)
+        {
+            if (!discard[index] || rulesBySymbol[index].empty())
+                continue;
+            auto const symbol = static_cast<code_parser::symbol>(index);
+            triviaScanners[index] = dfa::compile(*this, std::span<code_parser::symbol const>{ &symbol, 1u });
+        }
+    }
+
+    prediction grammar::predict_sequence(std::vector<primitive_index> const& aSequence) const
+    {
+        prediction result{ {}, true };
+        for (auto element : aSequence)
+        {
+            result.first |= primitivePredictions[element].first;
+            if (!primitivePredictions[element].nullable)
+            {
+                result.nullable = false;
+                break;
+            }
+        }
+        return result;
+    }
+
+    void profile::clear()
+    {
+        std::fill(rules.begin(), rules.end(), profile_counters{});
+        std::fill(primitives.begin(), primitives.end(), profile_counters{});
+    }
+
+    std::string json_string(std::string_view const& aText)
+    {
+        std::string result = "\"";
+        for (auto ch : aText)
+        {
+            if (ch == '"' || ch == '\\')
+                result += '\\';
+            if (static_cast<std::uint8_t>(ch) < 0x20u)
+            {
+                static char const sHex[] = "0123456789abcdef";
+                result += "\\u00";
+                result += sHex[(ch >> 4) & 0xF];
+                result += sHex[ch & 0xF];
+            }
+            else
+                result += ch;
+        }
+        result += '"';
+        return result;
+    }
+
+    namespace
+    {
+        // Names rules by grammar::rule_name and primitives after what they match and the rule they
+        // belong to.
+        class profile_names
+        {
+        public:
+            profile_names(grammar const& aGrammar) :
+                iGrammar{ aGrammar }, iRules(aGrammar.rules.size()), iOwners(aGrammar.primitives.size(), npos)
+            {
+                for (rule_index r = 0u; r < aGrammar.rules.size(); ++r)
+                {
+                    iRules[r] = aGrammar.rule_name(r);
+                    own(aGrammar.rules[r].lhs, r);
+                    for (auto element : aGrammar.rules[r].rhs)
+                        own(element, r);
+                }
+            }
+        public:
+            std::string const& rule(rule_index aRule) const
+            {
+                return iRules[aRule];
+            }
+            std::string const* owner(primitive_index aPrimitive) const
+            {
+                return iOwners[aPrimitive] != npos ? &iRules[iOwners[aPrimitive]] : nullptr;
+            }
+            std::string primitive(primitive_index aPrimitive) const
+            {
+                auto const& p = iGrammar.primitives[aPrimitive];
+                switch (p.type)
+                {
+                case primitive_type::Symbol:
+                    return std::string{ iGrammar.symbol_name(p.symbol) };
+                case primitive_type::Terminal:
+                    return json_string(p.text);
+                case primitive_type::Range:
+                    return p.children.size() == 2u ?
+                        json_string(iGrammar.primitives[p.children[0]].text) + " .. " + json_string(iGrammar.primitives[p.children[1]].text) : "range";
+                case primitive_type::Concatenation:
+                    return "concatenation";
+                case primitive_type::Alternation:
+                    return "alternation";
+                case primitive_type::Repetition:
+                    return "repetition";
+                case primitive_type::Optional:
+                    return "optional";
+                case primitive_type::Operators:
+                    return "operators";
+                case primitive_type::Eof:
+                default:
+                    return "eof";
+                }
+            }
+        private:
+            void own(primitive_index aPrimitive, rule_index aRule)
+            {
+                std::vector<primitive_index> pending{ aPrimitive };
+                while (!pending.empty())
+                {
+                    auto const next = pending.back();
+                    pending.pop_back();
+                    if (iOwners[next] != npos)
+                        continue;
+                    iOwners[next] = aRule;
+                    auto const& children = iGrammar.primitives[next].children;
+                    pending.insert(pending.end(), children.begin(), children.end());
+                }
+            }
+        private:
+            grammar const& iGrammar;
+            std::vector<std::string> iRules;
+            std::vector<rule_index> iOwners;
+        };
+
+        std::vector<std::uint32_t> ranked(std::vector<profile_counters> const& aCounters, std::uint64_t(*aKey)(profile_counters const&))
+        {
+            std::vector<std::uint32_t> result;
+            for (std::uint32_t index = 0u; index < aCounters.size(); ++index)
+                if (aCounters[index].attempts != 0u)
+                    result.push_back(index);
+            std::stable_sort(result.begin(), result.end(), [&](std::uint32_t lhs, std::uint32_t rhs)
+            {
+                return aKey(aCounters[lhs]) > aKey(aCounters[rhs]);
+            });
+            return result;
+        }
+
+        std::uint64_t by_time(profile_counters const& aCounters)
+        {
+            return static_cast<std::uint64_t>(aCounters.time.count());
+        }
+
+        std::uint64_t by_backtrack(profile_counters const& aCounters)
+        {
+            return aCounters.backtrack;
+        }
+
+        void write_counters(std::ostream& aStream, profile_counters const& aCounters)
+        {
+            aStream << std::setw(12) << std::fixed << std::setprecision(3) << aCounters.time.count() / 1.0e6 <<
+                std::setw(12) << aCounters.attempts << std::setw(12) << aCounters.successes << std::setw(12) << aCounters.failures <<
+                std::setw(12) << aCounters.bytes << std::setw(12) << aCounters.backtrack << "  ";
+        }
+
+        void write_ranking(std::ostream& aStream, std::string_view const& aTitle, std::vector<std::uint32_t> const& aRanking, std::size_t aTop,
+            std::vector<profile_counters> const& aCounters, std::function<std::string(std::uint32_t)> const& aName)
+        {
+            aStream << aTitle << ":\n" << std::setw(12) << "time (ms)" << std::setw(12) << "attempts" << std::setw(12) << "successes" <<
+                std::setw(12) << "failures" << std::setw(12) << "bytes" << std::setw(12) << "backtrack" << "\n";
+            for (std::size_t rank = 0u; rank < aRanking.size() && rank < aTop; ++rank)
+            {
+                write_counters(aStream, aCounters[aRanking[rank]]);
+                aStream << aName(aRanking[rank]) << "\n";
+            }
+        }
+
+        void write_counters_json(std::ostream& aStream, profile_counters const& aCounters)
+        {
+            aStream << "\"attempts\": " << aCounters.attempts << ", \"successes\": " << aCounters.successes <<
+                ", \"failures\": " << aCounters.failures << ", \"bytes\": " << aCounters.bytes <<
+                ", \"backtrack\": " << aCounters.backtrack << ", \"timeNs\": " << aCounters.time.count();
+        }
+    }
+
+    void write_profile_report(std::ostream& aStream, grammar const& aGrammar, profile const& aProfile, std::size_t aTop)
+    {
+        profile_names const names{ aGrammar };
+        auto const rule = [&](std::uint32_t aRule) { return names.rule(aRule); };
+        auto const primitive = [&](std::uint32_t aPrimitive)
+        {
+            auto const owner = names.owner(aPrimitive);
+            return names.primitive(aPrimitive) + (owner ? " in " + *owner : std::string{});
+        };
+        write_ranking(aStream, "Hottest rules", ranked(aProfile.rules, by_time), aTop, aProfile.rules, rule);
+        write_ranking(aStream, "Most backtracking rules", ranked(aProfile.rules, by_backtrack), aTop, aProfile.rules, rule);
+        write_ranking(aStream, "Hottest primitives", ranked(aProfile.primitives, by_time), aTop, aProfile.primitives, primitive);
+        write_ranking(aStream, "Most backtracking primitives", ranked(aProfile.primitives, by_backtrack), aTop, aProfile.primitives, primitive);
+    }
+
+    void write_profile_json(std::ostream& aStream, grammar const& aGrammar, profile const& aProfile)
+    {
+        profile_names const names{ aGrammar };
+        aStream << "{ \"rules\": [";
+        bool first = true;
+        for (auto r : ranked(aProfile.rules, by_time))
+        {
+            aStream << (first ? "\n" : ",\n") << "    { \"rule\": " << json_string(names.rule(r)) << ", ";
+            write_counters_json(aStream, aProfile.rules[r]);
+            aStream << " }";
+            first = false;
+        }
+        aStream << " ],\n  \"primitives\": [";
+        first = true;
+        for (auto p : ranked(aProfile.primitives, by_time))
+        {
+            aStream << (first ? "\n" : ",\n") << "    { \"primitive\": " << json_string(names.primitive(p)) << ", ";
+            if (auto const owner = names.owner(p))
+                aStream << "\"rule\": " << json_string(*owner) << ", ";
+            write_counters_json(aStream, aProfile.primitives[p]);
+            aStream << " }";
+            first = false;
+        }
+        aStream << " ] }";
+    }
+
+    engine::memo_table::memo_table() :
+        iEntries(1024u, memo_entry{ ~std::uint64_t{}, npos, NoNode })
+    {
+    }
+
+    void engine::memo_table::clear()
+    {
+        std::fill(iEntries.begin(), iEntries.end(), memo_entry{ ~std::uint64_t{}, npos, NoNode });
+        iSize = 0u;
+    }
+
+    engine::memo_entry* engine::memo_table::find(std::uint64_t aKey)
+    {
+        auto const mask = iEntries.size() - 1u;
+        for (auto slot = static_cast<std::size_t>((aKey * 0x9E3779B97F4A7C15ull) >> 32) & mask;; slot = (slot + 1u) & mask)
+        {
+            auto& entry = iEntries[slot];
+            if (entry.key == aKey)
+                return &entry;
+            if (entry.key == ~std::uint64_t{})
+                return nullptr;
+        }
+    }
+
+    engine::memo_entry& engine::memo_table::insert(std::uint64_t aKey)
+    {
+        if ((iSize + 1u) * 2u > iEntries.size())
+            grow();
+        auto const mask = iEntries.size() - 1u;
+        for (auto slot = static_cast<std::size_t>((aKey * 0x9E3779B97F4A7C15ull) >> 32) & mask;; slot = (slot + 1u) & mask)
+        {
+            auto& entry = iEntries[slot];
+            if (entry.key == aKey)
+                return entry;
+            if (entry.key == ~std::uint64_t{})
+            {
+                ++iSize;
+                entry.key = aKey;
+                return entry;
+            }
+        }
+    }
+
+    void engine::memo_table::grow()
+    {
+        std::vector<memo_entry> existing(iEntries.size() * 2u, memo_entry{ ~std::uint64_t{}, npos, NoNode });
+        existing.swap(iEntries);
+        iSize = 0u;
+        for (auto const& entry : existing)
+            if (entry.key != ~std::uint64_t{})
+                insert(entry.key) = entry;
+    }
+
+    engine::engine(code_parser::grammar const& aGrammar, bool aPackrat) :
+        iGrammar{ aGrammar }, iPackrat{ aPackrat }
+    {
+    }
+
+    bool engine::parse(std::string_view const& aSource)
+    {
+        reset(aSource);
+        take_tokens({});
+        std::uint32_t position = 0u;
+        while (position < iSource.size())
+        {
+            std::uint32_t longest = npos;
+            for (auto s : iGrammar.stageSymbols)
+            {
+                auto const mark = iOutput.size();
+                auto const end = match_symbol(s, position);
+                iOutput.resize(mark);
+                if (end != npos && (longest == npos || end > longest))
+                    longest = end;
+            }
+            if (longest == npos || longest == position)
+                return false;
+            position = longest;
+        }
+        settle_trivia();
+        return true;
+    }
+
+    bool engine::parse(code_parser::symbol aRoot, std::string_view const& aSource)
+    {
+        static token_stream const sNoTokens;
+        return parse(aRoot, aSource, sNoTokens);
+    }
+
+    bool engine::parse(code_parser::symbol aRoot, std::string_view const& aSource, token_stream const& aTokens)
+    {
+        reset(aSource);
+        take_tokens(aTokens);
+        if (match_symbol(aRoot, 0u) != iSource.size())
+            return false;
+        if (!iOutput.empty())
+            iRoot = make_unit(0u, 0u, static_cast<std::uint32_t>(iSource.size()));
+        settle_trivia();
+        return true;
+    }
+
+    void engine::create_ast()
+    {
+        // the engine's own AST is just another sink
+        class tree_builder : public i_ast_sink
+        {
+        public:
+            tree_builder(code_parser::grammar const& aGrammar, std::vector<ast_node>& aAst) :
+                iGrammar{ aGrammar }, iAst{ aAst }
+            {
+            }
+        public:
+            void open_node(primitive_index aConcept, std::string_view const& aValue) final
+            {
+                auto const index = iAst.size();
+                iAst.emplace_back();
+                if (aConcept != npos)
+                    iAst[index].c = std::string_view{ *iGrammar.primitives[aConcept].c };
+                iAst[index].value = aValue;
+                children.emplace_back();
+                if (!iOpen.empty())
+                    children[iOpen.back()].push_back(index);
+                iOpen.push_back(index);
+            }
+            void close_node(primitive_index, std::string_view const&) final
+            {
+                iOpen.pop_back();
+            }
+        public:
+            std::vector<std::vector<std::size_t>> children;
+        private:
+            code_parser::grammar const& iGrammar;
+            std::vector<ast_node>& iAst;
+            std::vector<std::size_t> iOpen;
+        };
+
+        iAst.clear();
+        iAstChildren.clear();
+        tree_builder builder{ iGrammar, iAst };
+        create_ast(builder);
+        auto const& children = builder.children;
+        std::size_t total = 0u;
+        for (auto const& c : children)
+            total += c.size();
+        iAstChildren.reserve(total);
+        for (std::size_t index = 0u; index < iAst.size(); ++index)
+        {
+            auto const first = iAstChildren.size();
+            for (auto child : children[index])
+            {
+                iAst[child].parent = &iAst[index];
+                iAstChildren.push_back(&iAst[child]);
+            }
+            iAst[index].children = std::span<ast_node const* const>{ iAstChildren.data() + first, children[index].size() };
+        }
+    }
+
+    // Emits the AST from the engine's own nodes; the walk keeps its own stack as the tree is as
+    // deep as the input's nesting.
+    void engine::create_ast(i_ast_sink& aSink)
+    {
+        if (iRoot == NoNode)
+            throw no_ast();
+        struct level
+        {
+            node_index node;
+            std::size_t first;
+            std::size_t next;
+            std::size_t end;
+        };
+        std::vector<level> levels;
+        std::vector<node_index> children;
+        auto const open = [&](node_index aNode)
+        {
+            auto const& n = iNodes[aNode];
+            aSink.open_node(n.concept_, iSource.substr(n.begin, n.end - n.begin));
+            auto const first = children.size();
+            node_index pending = NoNode;
+            flatten(aNode, children, pending);
+            if (pending != NoNode)
+                children.push_back(pending);
+            levels.push_back(level{ aNode, first, first, children.size() });
+        };
+        std::vector<node_index> topLevel;
+        if (is_concept(iRoot))
+            topLevel.push_back(iRoot);
+        else
+        {
+            node_index pending = NoNode;
+            flatten(iRoot, topLevel, pending);
+            if (pending != NoNode)
+                topLevel.push_back(pending);
+        }
+        bool const synthesizedRoot = (topLevel.size() != 1u);
+        if (synthesizedRoot)
+            aSink.open_node(npos, iSource);
+        for (auto node : topLevel)
+        {
+            open(node);
+            while (!levels.empty())
+            {
+                auto& current = levels.back();
+                if (current.next != current.end)
+                {
+                    auto const child = children[current.next++];
+                    open(child);
+                    continue;
+                }
+                auto const& n = iNodes[current.node];
+                aSink.close_node(n.concept_, iSource.substr(n.begin, n.end - n.begin));
+                children.resize(current.first);
+                levels.pop_back();
+            }
+        }
+        if (synthesizedRoot)
+            aSink.close_node(npos, iSource);
+    }
+
+    // Moves a parse to another copy of its source, such as the same text at a different offset in
+    // an edited buffer; nodes and trivia are offsets into the source so only the view changes.
+    void engine::rebase(std::string_view const& aSource)
+    {
+        if (aSource.size() != iSource.size())
+            throw bad_rebase();
+        iSource = aSource;
+        take_tokens({});
+        iAst.clear();
+        iAstChildren.clear();
+    }
+
+    // Profiling adds a clock read around every match attempt so it is only done with a profile
+    // attached; counters accumulate into it across parses.
+    void engine::set_profile(code_parser::profile* aProfile)
+    {
+        iProfile = aProfile;
+        if (iProfile)
+        {
+            iProfile->rules.resize(std::max(iProfile->rules.size(), iGrammar.rules.size()));
+            iProfile->primitives.resize(std::max(iProfile->primitives.size(), iGrammar.primitives.size()));
+        }
+    }
+
+    ast_node const& engine::ast() const
+    {
+        if (iAst.empty())
+            throw no_ast();
+        return iAst[0];
+    }
+
+    std::vector<code_parser::trivia> const& engine::trivia() const
+    {
+        return iTrivia;
+    }
+
+    code_parser::statistics const& engine::statistics() const
+    {
+        return iStatistics;
+    }
+
+    void engine::reset(std::string_view const& aSource)
+    {
+        iSource = aSource;
+        iDepth = 0u;
+        iFrames.clear();
+        iActive.assign(iGrammar.rulesBySymbol.size(), npos);
+        iNodes.clear();
+        iChildPool.clear();
+        iOutput.clear();
+        iOperators.clear();
+        iRoot = NoNode;
+        iAst.clear();
+        iAstChildren.clear();
+        iStatistics = {};
+        iLexemes.assign(iGrammar.keywordTables.size(), { npos, npos });
+        iTrivia.clear();
+        iAttempts.clear();
+        iReach = 0u;
+        if (iPackrat)
+            iMemo.clear();
+    }
+
+    std::uint32_t engine::match(primitive_index aPrimitive, std::uint32_t aPosition)
+    {
+        if (!iGrammar.primitivePredictions[aPrimitive].viable(iSource, aPosition))
+            return npos;
+        if (iProfile)
+            begin_attempt(aPosition);
+        auto const& p = iGrammar.primitives[aPrimitive];
+        auto const mark = iOutput.size();
+        std::uint32_t end = npos;
+        switch (p.type)
+        {
+        case primitive_type::Symbol:
+            end = match_symbol(p.symbol, aPosition);
+            if (end != npos && p.constraint && iSource.substr(aPosition, end - aPosition) != *p.constraint)
+                end = npos;
+            break;
+        case primitive_type::Terminal:
+            if (iSource.substr(aPosition).starts_with(p.text))
+                end = aPosition + static_cast<std::uint32_t>(p.text.size());
+            break;
+        case primitive_type::Range:
+            end = match_range(p, aPosition);
+            break;
+        case primitive_type::Concatenation:
+            end = match_sequence(p.children, aPosition);
+            break;
+        case primitive_type::Alternation:
+            {
+                node_index bestNode = NoNode;
+                for (auto alternative : p.children)
+                {
+                    auto const alternativeEnd = match(alternative, aPosition);
+                    if (alternativeEnd == npos)
+                        continue;
+                    auto const alternativeNode = make_unit(mark, aPosition, alternativeEnd);
+                    if (end == npos || alternativeEnd > end)
+                    {
+                        end = alternativeEnd;
+                        bestNode = alternativeNode;
+                    }
+                    if (p.matchFirst)
+                        break;
+                }
+                if (bestNode != NoNode)
+                    iOutput.push_back(bestNode);
+            }
+            break;
+        case primitive_type::Repetition:
+            {
+                end = aPosition;
+                std::size_t count = 0u;
+                for (;;)
+                {
+                    if (p.run.any())
+                    {
+                        auto const runEnd = static_cast<std::uint32_t>(p.run.scan(iSource, end));
+                        count += runEnd - end;
+                        end = runEnd;
+                    }
+                    auto const next = match_sequence(p.children, end);
+                    if (next == npos)
+                        break;
+                    ++count;
+                    if (next == end)
+                        break;
+                    end = next;
+                }
+                if (p.atLeastOne && count == 0u)
+                    end = npos;
+            }
+            break;
+        case primitive_type::Optional:
+            end = match_sequence(p.children, aPosition);
+            if (end == npos)
+                end = aPosition;
+            break;
+        case primitive_type::Operators:
+            end = match_operators(p, aPosition);
+            break;
+        case primitive_type::Eof:
+            if (aPosition == iSource.size())
+                end = aPosition;
+            break;
+        }
+        if (end == npos)
+            iOutput.resize(mark);
+        else if (p.c)
+            iOutput.push_back(make_node(aPrimitive, mark, aPosition, end));
+        if (iProfile)
+            end_attempt(iProfile->primitives[aPrimitive], aPosition, end);
+        return end;
+    }
+
+    std::uint32_t engine::match_sequence(std::vector<primitive_index> const& aSequence, std::uint32_t aPosition)
+    {
+        auto const mark = iOutput.size();
+        auto end = aPosition;
+        for (auto element : aSequence)
+        {
+            end = match(element, end);
+            if (end == npos)
+            {
+                iOutput.resize(mark);
+                return npos;
+            }
+        }
+        return end;
+    }
+
+    std::uint32_t engine::match_symbol(code_parser::symbol aSymbol, std::uint32_t aPosition)
+    {
+        std::uint32_t end = npos;
+        if (resolve_symbol(aSymbol, aPosition, end))
+            return end;
+        bool const bounded = iGrammar.bounded(aSymbol);
+        if (!bounded && iDepth >= NativeDepth)
+        {
+            // nested too deeply to keep recursing on the native stack so carry on with frames
+            auto const base = iFrames.size();
+            if (!push_symbol(aSymbol, npos, aPosition))
+                return npos;
+            return run(base);
+        }
+        auto outerActive = npos;
+        if (!bounded)
+        {
+            auto& active = iActive[static_cast<std::size_t>(aSymbol)];
+            if (active == aPosition)
+                return npos;
+            outerActive = active;
+            active = aPosition;
+        }
+        neolib::scoped_counter<std::size_t> scopedDepth{ iDepth };
+        auto const mark = iOutput.size();
+        node_index bestNode = NoNode;
+        for (auto r : iGrammar.rules_for(aSymbol))
+        {
+            if (!iGrammar.rulePredictions[r].viable(iSource, aPosition))
+                continue;
+            if (iProfile)
+                begin_attempt(aPosition);
+            auto const ruleEnd = match_sequence(iGrammar.rules[r].rhs, aPosition);
+            if (iProfile)
+                end_attempt(iProfile->rules[r], aPosition, ruleEnd);
+            if (ruleEnd != npos)
+                rule_matched(r, mark, aPosition, ruleEnd, end, bestNode);
+        }
+        if (!bounded)
+            iActive[static_cast<std::size_t>(aSymbol)] = outerActive;
+        return symbol_matched(aSymbol, aPosition, end, bestNode);
+    }
+
+    // Settles a symbol without matching its rules where possible: a failed prediction, a token
+    // from the tokenizer stage, a keyword or a memoized result.
+    bool engine::resolve_symbol(code_parser::symbol aSymbol, std::uint32_t aPosition, std::uint32_t& aEnd)
+    {
+        aEnd = npos;
+        if (!iGrammar.symbol_prediction(aSymbol).viable(iSource, aPosition))
+            return true;
+        if (iTokenized && iGrammar.discarded(aSymbol))
+        {
+            aEnd = match_discarded_token(aSymbol, aPosition);
+            if (aEnd != npos)
+                return true;
+        }
+        if (auto const scanner = iGrammar.trivia_scanner(aSymbol))
+        {
+            ++iStatistics.triviaScans;
+            aEnd = scanner->match(iSource, aPosition);
+            if (aEnd != npos && aEnd != aPosition)
+                add_trivia(aSymbol, aPosition, aEnd);
+            return true;
+        }
+        if (iTokenized && iGrammar.leaf(aSymbol))
+        {
+            aEnd = match_token(aSymbol, aPosition);
+            if (aEnd != npos)
+                return true;
+        }
+        if (auto const table = iGrammar.keyword(aSymbol))
+        {
+            aEnd = match_keyword(aSymbol, *table, aPosition);
+            return true;
+        }
+        if (iPackrat)
+        {
+            auto const key = (static_cast<std::uint64_t>(aSymbol) << 32) | aPosition;
+            if (auto const existing = iMemo.find(key))
+            {
+                ++iStatistics.memoHits;
+                if (existing->node != NoNode)
+                    iOutput.push_back(existing->node);
+                aEnd = existing->end;
+                return true;
+            }
+            ++iStatistics.memoMisses;
+            iMemo.insert(key) = memo_entry{ key, npos, NoNode };
+        }
+        return false;
+    }
+
+    void engine::rule_matched(rule_index aRule, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aRuleEnd, std::uint32_t& aEnd, node_index& aBestNode)
+    {
+        auto const lhs = iGrammar.rules[aRule].lhs;
+        auto const ruleNode = iGrammar.primitives[lhs].c ?
+            make_node(lhs, aMark, aBegin, aRuleEnd) : make_unit(aMark, aBegin, aRuleEnd);
+        iOutput.resize(aMark);
+        if (aEnd == npos || aRuleEnd > aEnd)
+        {
+            aEnd = aRuleEnd;
+            aBestNode = ruleNode;
+        }
+    }
+
+    std::uint32_t engine::symbol_matched(code_parser::symbol aSymbol, std::uint32_t aBegin, std::uint32_t aEnd, node_index aBestNode)
+    {
+        if (iGrammar.discarded(aSymbol))
+            aBestNode = NoNode;
+        if (aBestNode != NoNode)
+            iOutput.push_back(aBestNode);
+        if (iPackrat)
+        {
+            auto const key = (static_cast<std::uint64_t>(aSymbol) << 32) | aBegin;
+            iMemo.insert(key) = memo_entry{ key, aEnd, aBestNode };
+        }
+        return aEnd;
+    }
+
+    // Matches frames until the stack is back down to aBase. Only primitives and symbols through
+    // which the grammar recurses get frames, so deeper input nesting costs heap rather than
+    // native stack; everything else is matched by match(), whose recursion is bounded by the
+    // grammar.
+    std::uint32_t engine::run(std::size_t aBase)
+    {
+        std::uint32_t result = npos;
+        while (iFrames.size() > aBase)
+        {
+            auto& f = iFrames.back();
+            if (f.next == f.last)
+            {
+                if (advance(f))
+                    continue;
+                result = leave();
+                if (iFrames.size() > aBase)
+                    resume(iFrames.back(), result);
+                continue;
+            }
+            std::uint32_t immediate = npos;
+            if (!enter(*f.next, f.position, immediate))
+                resume(f, immediate);
+        }
+        return result;
+    }
+
+    // Starts matching a primitive; returns false with aResult set if it is matched without
+    // needing a frame.
+    bool engine::enter(primitive_index aPrimitive, std::uint32_t aPosition, std::uint32_t& aResult)
+    {
+        if (iGrammar.boundedPrimitives[aPrimitive] || !iGrammar.primitivePredictions[aPrimitive].viable(iSource, aPosition))
+        {
+            aResult = match(aPrimitive, aPosition);
+            return false;
+        }
+        auto const& p = iGrammar.primitives[aPrimitive];
+        // an attempt begun here ends in leave() if the primitive needs a frame
+        if (iProfile)
+            begin_attempt(aPosition);
+        if (p.type == primitive_type::Symbol)
+        {
+            auto const mark = iOutput.size();
+            if (resolve_symbol(p.symbol, aPosition, aResult))
+                aResult = complete(aPrimitive, mark, aPosition, aResult);
+            else if (push_symbol(p.symbol, aPrimitive, aPosition))
+                return true;
+            else
+                aResult = complete(aPrimitive, mark, aPosition, npos);
+            if (iProfile)
+                end_attempt(iProfile->primitives[aPrimitive], aPosition, aResult);
+            return false;
+        }
+        auto const mark = static_cast<std::uint32_t>(iOutput.size());
+        iFrames.push_back(frame{ p.type, false, aPrimitive, {}, p.children.data(), p.children.data() + p.children.size(), aPosition, aPosition, mark });
+        if (p.type == primitive_type::Repetition)
+            begin_iteration(iFrames.back(), p);
+        else if (p.type == primitive_type::Operators)
+        {
+            // only operands are matched as children; operators are matched between them
+            auto& f = iFrames.back();
+            f.last = f.next + 1;
+            f.alternative = static_cast<std::uint32_t>(iOperators.size());
+        }
+        return true;
+    }
+
+    bool engine::push_symbol(code_parser::symbol aSymbol, primitive_index aReference, std::uint32_t aPosition)
+    {
+        // a symbol already being matched at this position can only be reached again through left
+        // recursion, which cannot produce a match that the outer attempt won't
+        auto& active = iActive[static_cast<std::size_t>(aSymbol)];
+        if (active == aPosition)
+            return false;
+        auto const mark = static_cast<std::uint32_t>(iOutput.size());
+        iFrames.push_back(frame{ primitive_type::Symbol, false, aReference, aSymbol, nullptr, nullptr, aPosition, aPosition, mark });
+        auto& f = iFrames.back();
+        f.active = active;
+        active = aPosition;
+        next_rule(f, 0u);
+        if (iProfile && !f.done)
+            begin_attempt(aPosition);
+        return true;
+    }
+
+    void engine::next_rule(frame& aFrame, std::uint32_t aRule) const
+    {
+        auto const& rules = iGrammar.rules_for(aFrame.symbol);
+        while (aRule < rules.size() && !iGrammar.rulePredictions[rules[aRule]].viable(iSource, aFrame.begin))
+            ++aRule;
+        aFrame.alternative = aRule;
+        aFrame.position = aFrame.begin;
+        if (aRule < rules.size())
+        {
+            auto const& rhs = iGrammar.rules[rules[aRule]].rhs;
+            aFrame.next = rhs.data();
+            aFrame.last = rhs.data() + rhs.size();
+        }
+        else
+        {
+            aFrame.next = nullptr;
+            aFrame.last = nullptr;
+            aFrame.done = true;
+        }
+    }
+
+    void engine::begin_iteration(frame& aFrame, primitive const& aRepetition) const
+    {
+        if (aRepetition.run.any())
+        {
+            auto const runEnd = static_cast<std::uint32_t>(aRepetition.run.scan(iSource, aFrame.position));
+            aFrame.count += runEnd - aFrame.position;
+            aFrame.position = runEnd;
+        }
+        aFrame.sequenceBegin = aFrame.position;
+        aFrame.sequenceMark = static_cast<std::uint32_t>(iOutput.size());
+        aFrame.next = aRepetition.children.data();
+        aFrame.last = aRepetition.children.data() + aRepetition.children.size();
+    }
+
+    // Called once a frame has no children left to match: completes the current rule or iteration
+    // and returns true if there is another to match, false once the frame has its result.
+    bool engine::advance(frame& aFrame)
+    {
+        if (aFrame.done)
+            return false;
+        switch (aFrame.type)
+        {
+        case primitive_type::Symbol:
+            {
+                auto const r = iGrammar.rules_for(aFrame.symbol)[aFrame.alternative];
+                if (iProfile)
+                    end_attempt(iProfile->rules[r], aFrame.begin, aFrame.position);
+                rule_matched(r, aFrame.mark, aFrame.begin, aFrame.position, aFrame.end, aFrame.bestNode);
+            }
+            next_rule(aFrame, aFrame.alternative + 1u);
+            if (iProfile && !aFrame.done)
+                begin_attempt(aFrame.begin);
+            return !aFrame.done;
+        case primitive_type::Alternation:
+            return false;
+        case primitive_type::Repetition:
+            ++aFrame.count;
+            if (aFrame.position == aFrame.sequenceBegin)
+            {
+                aFrame.end = aFrame.position;
+                return false;
+            }
+            begin_iteration(aFrame, iGrammar.primitives[aFrame.primitive]);
+            return true;
+        case primitive_type::Operators:
+            if (aFrame.bestNode != NoNode)
+                push_operator(aFrame.alternative, aFrame.sequenceMark, aFrame.bestNode);
+            {
+                std::uint32_t next = npos;
+                if (match_operator(iGrammar.primitives[aFrame.primitive], aFrame.position, next, aFrame.bestNode))
+                {
+                    aFrame.sequenceBegin = aFrame.position;
+                    aFrame.sequenceMark = static_cast<std::uint32_t>(iOutput.size());
+                    aFrame.position = next;
+                    aFrame.next = aFrame.last - 1;
+                    return true;
+                }
+            }
+            pop_operators(aFrame.alternative);
+            aFrame.end = aFrame.position;
+            return false;
+        default:
+            aFrame.end = aFrame.position;
+            return false;
+        }
+    }
+
+    // Takes the result of the frame's current child.
+    void engine::resume(frame& aFrame, std::uint32_t aResult)
+    {
+        if (aResult != npos && aFrame.type != primitive_type::Alternation)
+        {
+            aFrame.position = aResult;
+            ++aFrame.next;
+            return;
+        }
+        switch (aFrame.type)
+        {
+        case primitive_type::Symbol:
+            if (iProfile)
+                end_attempt(iProfile->rules[iGrammar.rules_for(aFrame.symbol)[aFrame.alternative]], aFrame.begin, npos);
+            iOutput.resize(aFrame.mark);
+            next_rule(aFrame, aFrame.alternative + 1u);
+            if (iProfile && !aFrame.done)
+                begin_attempt(aFrame.begin);
+            return;
+        case primitive_type::Alternation:
+            ++aFrame.next;
+            if (aResult == npos)
+                return;
+            {
+                auto const alternativeNode = make_unit(aFrame.mark, aFrame.begin, aResult);
+                if (aFrame.end == npos || aResult > aFrame.end)
+                {
+                    aFrame.end = aResult;
+                    aFrame.bestNode = alternativeNode;
+                }
+            }
+            if (iGrammar.primitives[aFrame.primitive].matchFirst)
+                aFrame.next = aFrame.last;
+            return;
+        case primitive_type::Repetition:
+            iOutput.resize(aFrame.sequenceMark);
+            aFrame.end = aFrame.sequenceBegin;
+            break;
+        case primitive_type::Optional:
+            iOutput.resize(aFrame.mark);
+            aFrame.end = aFrame.begin;
+            break;
+        case primitive_type::Operators:
+            // without its right operand the last operator is not part of the match
+            if (aFrame.bestNode == NoNode)
+                aFrame.end = npos;
+            else
+            {
+                iOutput.resize(aFrame.sequenceMark);
+                pop_operators(aFrame.alternative);
+                aFrame.end = aFrame.sequenceBegin;
+            }
+            break;
+        default:
+            aFrame.end = npos;
+            break;
+        }
+        aFrame.done = true;
+        aFrame.next = aFrame.last;
+    }
+
+    // Pops the finished top frame and returns its result.
+    std::uint32_t engine::leave()
+    {
+        auto const f = iFrames.back();
+        iFrames.pop_back();
+        if (f.type == primitive_type::Symbol)
+        {
+            iActive[static_cast<std::size_t>(f.symbol)] = f.active;
+            auto const end = symbol_matched(f.symbol, f.begin, f.end, f.bestNode);
+            if (f.primitive == npos)
+                return end;
+            auto const result = complete(f.primitive, f.mark, f.begin, end);
+            if (iProfile)
+                end_attempt(iProfile->primitives[f.primitive], f.begin, result);
+            return result;
+        }
+        auto end = f.end;
+        if (f.type == primitive_type::Alternation && f.bestNode != NoNode)
+            iOutput.push_back(f.bestNode);
+        else if (f.type == primitive_type::Repetition && iGrammar.primitives[f.primitive].atLeastOne && f.count == 0u)
+            end = npos;
+        auto const result = complete(f.primitive, f.mark, f.begin, end);
+        if (iProfile)
+            end_attempt(iProfile->primitives[f.primitive], f.begin, result);
+        return result;
+    }
+
+    // Applies a primitive's constraint and concept to what it matched.
+    std::uint32_t engine::complete(primitive_index aPrimitive, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd)
+    {
+        auto const& p = iGrammar.primitives[aPrimitive];
+        if (aEnd != npos && p.constraint && iSource.substr(aBegin, aEnd - aBegin) != *p.constraint)
+            aEnd = npos;
+        if (aEnd == npos)
+        {
+            iOutput.resize(aMark);
+            return npos;
+        }
+        if (p.c)
+            iOutput.push_back(make_node(aPrimitive, aMark, aBegin, aEnd));
+        return aEnd;
+    }
+
+    // Attempts nest so each keeps the furthest point reached by anything matched within it; what a
+    // failed attempt had reached is the input it backtracks over.
+    void engine::begin_attempt(std::uint32_t aPosition)
+    {
+        iAttempts.push_back(attempt{ std::chrono::steady_clock::now(), iReach });
+        iReach = aPosition;
+    }
+
+    void engine::end_attempt(profile_counters& aCounters, std::uint32_t aBegin, std::uint32_t aEnd)
+    {
+        auto const outer = iAttempts.back();
+        iAttempts.pop_back();
+        ++aCounters.attempts;
+        aCounters.time += std::chrono::steady_clock::now() - outer.start;
+        if (aEnd != npos)
+        {
+            ++aCounters.successes;
+            aCounters.bytes += aEnd - aBegin;
+            iReach = std::max(iReach, aEnd);
+        }
+        else
+        {
+            ++aCounters.failures;
+            aCounters.backtrack += iReach - aBegin;
+        }
+        iReach = std::max(iReach, outer.outerReach);
+    }
+
+    // Matches operands separated by binary operators with an operator stack rather than a rule per
+    // precedence level; each operator's node follows the nodes of both of its operands so that the
+    // output is in the order it folds.
+    std::uint32_t engine::match_operators(primitive const& aOperators, std::uint32_t aPosition)
+    {
+        auto const base = iOperators.size();
+        auto const operand = aOperators.children[0];
+        auto end = match(operand, aPosition);
+        if (end == npos)
+            return npos;
+        std::uint32_t next = npos;
+        node_index op = NoNode;
+        while (match_operator(aOperators, end, next, op))
+        {
+            auto const operandMark = iOutput.size();
+            auto const operandEnd = match(operand, next);
+            if (operandEnd == npos)
+                break;
+            push_operator(base, operandMark, op);
+            end = operandEnd;
+        }
+        pop_operators(base);
+        return end;
+    }
+
+    // Matches the longest operator at aPosition together with the separators either side of it;
+    // the operator's node is taken out of the output until its right operand has been matched.
+    bool engine::match_operator(primitive const& aOperators, std::uint32_t aPosition, std::uint32_t& aNext, node_index& aOperator)
+    {
+        auto const mark = iOutput.size();
+        auto const separator = aOperators.children[1];
+        auto begin = match(separator, aPosition);
+        if (begin == npos)
+            begin = aPosition;
+        iOutput.resize(mark);
+        std::uint32_t end = npos;
+        aOperator = NoNode;
+        for (auto o = std::next(aOperators.children.begin(), 2); o != aOperators.children.end(); ++o)
+        {
+            auto const operatorEnd = match(*o, begin);
+            if (operatorEnd != npos && (end == npos || operatorEnd > end) && iOutput.size() > mark)
+            {
+                end = operatorEnd;
+                aOperator = iOutput.back();
+            }
+            iOutput.resize(mark);
+        }
+        if (end == npos)
+            return false;
+        aNext = match(separator, end);
+        if (aNext == npos)
+            aNext = end;
+        iOutput.resize(mark);
+        return true;
+    }
+
+    // Moves the stacked operators that bind at least as tightly as aOperator in front of the nodes
+    // of its right operand (those from aOperand on) and then stacks it.
+    void engine::push_operator(std::size_t aBase, std::size_t aOperand, node_index aOperator)
+    {
+        auto const& incoming = iGrammar.primitives[iNodes[aOperator].concept_];
+        auto const operandEnd = iOutput.size();
+        while (iOperators.size() > aBase)
+        {
+            auto const& stacked = iGrammar.primitives[iNodes[iOperators.back()].concept_];
+            if (stacked.precedence < incoming.precedence || (stacked.precedence == incoming.precedence && incoming.rightAssociative))
+                break;
+            iOutput.push_back(iOperators.back());
+            iOperators.pop_back();
+        }
+        std::rotate(std::next(iOutput.begin(), aOperand), std::next(iOutput.begin(), operandEnd), iOutput.end());
+        iOperators.push_back(aOperator);
+    }
+
+    void engine::pop_operators(std::size_t aBase)
+    {
+        while (iOperators.size() > aBase)
+        {
+            iOutput.push_back(iOperators.back());
+            iOperators.pop_back();
+        }
+    }
+
+    std::uint32_t engine::match_range(primitive const& aRange, std::uint32_t aPosition) const
+    {
+        if (aPosition >= iSource.size())
+            return npos;
+        auto const byte = static_cast<std::uint8_t>(iSource[aPosition]);
+        if (!aRange.codepoints || byte < 0x80u)
+            return aRange.byteClass.test(byte) ? aPosition + 1u : npos;
+        std::uint32_t length = 1u;
+        char32_t const ch = decode_utf8(iSource, aPosition, length);
+        bool const inRange = (ch >= aRange.low && ch <= aRange.high) != aRange.negate;
+        if (!inRange || (ch < 256u && aRange.exclusions.test(ch)))
+            return npos;
+        return aPosition + length;
+    }
+
+    // Takes the tokens of a tokenizer stage that fall within the source being parsed (a piece
+    // of a larger source sees only its own), setting aside the discarded ones so that matching
+    // walks just the tokens the grammar can build nodes from.
+    void engine::take_tokens(token_stream const& aTokens)
+    {
+        iTokens.clear();
+        iDiscardedTokens.clear();
+        iTokenCursor = 0u;
+        iDiscardedTokenCursor = 0u;
+        auto const first = std::lower_bound(aTokens.begin(), aTokens.end(), iSource.data(),
+            [](token const& aToken, char const* aBegin) { return aToken.text.data() < aBegin; });
+        auto const last = std::lower_bound(first, aTokens.end(), iSource.data() + iSource.size(),
+            [](token const& aToken, char const* aEnd) { return aToken.text.data() < aEnd; });
+        for (auto t = first; t != last; ++t)
+        {
+            bool const discarded = std::all_of(t->symbols.begin(), t->symbols.end(),
+                [&](code_parser::symbol aSymbol) { return iGrammar.discarded(aSymbol); });
+            (discarded ? iDiscardedTokens : iTokens).push_back(*t);
+        }
+        iTokenized = (first != last);
+    }
+
+    token const* engine::find_token(token_stream const& aTokens, std::size_t& aCursor, std::uint32_t aPosition) const
+    {
+        auto const begin = iSource.data() + aPosition;
+        // lookups mostly move forward through the stream so try the token after the last one first
+        if (aCursor < aTokens.size() && aTokens[aCursor].text.data() == begin)
+            return &aTokens[aCursor];
+        if (aCursor + 1u < aTokens.size() && aTokens[aCursor + 1u].text.data() == begin)
+            return &aTokens[++aCursor];
+        auto const t = std::lower_bound(aTokens.begin(), aTokens.end(), begin,
+            [](token const& aToken, char const* aBegin) { return aToken.text.data() < aBegin; });
+        if (t == aTokens.end() || t->text.data() != begin)
+            return nullptr;
+        aCursor = static_cast<std::size_t>(std::distance(aTokens.begin(), t));
+        return &*t;
+    }
+
+    std::uint32_t engine::match_token(code_parser::symbol aSymbol, std::uint32_t aPosition)
+    {
+        auto const t = find_token(iTokens, iTokenCursor, aPosition);
+        if (t == nullptr || std::find(t->symbols.begin(), t->symbols.end(), aSymbol) == t->symbols.end())
+            return npos;
+        ++iStatistics.tokenHits;
+        auto const end = aPosition + static_cast<std::uint32_t>(t->text.size());
+        auto const leafConcept = iGrammar.leafConcepts[static_cast<std::size_t>(aSymbol)];
+        if (leafConcept != npos && !iGrammar.discarded(aSymbol))
+            iOutput.push_back(make_node(leafConcept, iOutput.size(), aPosition, end));
+        return end;
+    }
+
+    // Whitespace and comments the tokenizer stage has already found are skipped a token at a
+    // time rather than rescanned.
+    std::uint32_t engine::match_discarded_token(code_parser::symbol aSymbol, std::uint32_t aPosition)
+    {
+        auto const t = find_token(iDiscardedTokens, iDiscardedTokenCursor, aPosition);
+        if (t == nullptr || std::find(t->symbols.begin(), t->symbols.end(), aSymbol) == t->symbols.end())
+            return npos;
+        ++iStatistics.tokenHits;
+        auto const end = aPosition + static_cast<std::uint32_t>(t->text.size());
+        add_trivia(aSymbol, aPosition, end);
+        return end;
+    }
+
+    std::uint32_t engine::match_keyword(code_parser::symbol aSymbol, keyword_table const& aTable, std::uint32_t aPosition)
+    {
+        // the lexeme is matched once per position however many keywords are tried there
+        auto& lexeme = iLexemes[static_cast<std::size_t>(std::distance(iGrammar.keywordTables.data(), &aTable))];
+        if (lexeme.first != aPosition)
+        {
+            auto const mark = iOutput.size();
+            lexeme = { aPosition, match_symbol(aTable.lexeme, aPosition) };
+            iOutput.resize(mark);
+        }
+        if (lexeme.second == npos)
+            return npos;
+        ++iStatistics.keywordProbes;
+        auto const symbols = aTable.find(iSource.substr(aPosition, lexeme.second - aPosition));
+        if (std::find(symbols.begin(), symbols.end(), aSymbol) == symbols.end())
+            return npos;
+        auto const& rule = iGrammar.rules[iGrammar.rules_for(aSymbol)[0]];
+        if (iGrammar.primitives[rule.lhs].c && !iGrammar.discarded(aSymbol))
+            iOutput.push_back(make_node(rule.lhs, iOutput.size(), aPosition, lexeme.second));
+        return lexeme.second;
+    }
+
+    void engine::add_trivia(code_parser::symbol aSymbol, std::uint32_t aBegin, std::uint32_t aEnd)
+    {
+        // the same stretch is usually skipped several times over as alternatives are tried
+        if (!iTrivia.empty() && iTrivia.back().begin <= aBegin && aEnd <= iTrivia.back().end)
+            return;
+        iTrivia.push_back(code_parser::trivia{ aSymbol, aBegin, aEnd });
+    }
+
+    // Orders the trivia by position, keeping the outermost where stretches overlap (a symbol
+    // skipped on its own as well as within another). Trivia skipped by an alternative that was
+    // then abandoned is still trivia of the source so it is kept too.
+    void engine::settle_trivia()
+    {
+        std::stable_sort(iTrivia.begin(), iTrivia.end(), [](code_parser::trivia const& aLeft, code_parser::trivia const& aRight)
+            { return aLeft.begin < aRight.begin || (aLeft.begin == aRight.begin && aLeft.end > aRight.end); });
+        std::size_t kept = 0u;
+        for (std::size_t index = 0u; index < iTrivia.size(); ++index)
+            if (kept == 0u || iTrivia[index].begin >= iTrivia[kept - 1u].end)
+                iTrivia[kept++] = iTrivia[index];
+        iTrivia.resize(kept);
+    }
+
+    node_index engine::make_node(primitive_index aConcept, std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd)
+    {
+        auto const firstChild = static_cast<std::uint32_t>(iChildPool.size());
+        iChildPool.insert(iChildPool.end(), std::next(iOutput.begin(), aMark), iOutput.end());
+        iNodes.push_back(node{ aConcept, aBegin, aEnd, firstChild, static_cast<std::uint32_t>(iOutput.size() - aMark) });
+        iOutput.resize(aMark);
+        return static_cast<node_index>(iNodes.size() - 1u);
+    }
+
+    node_index engine::make_unit(std::size_t aMark, std::uint32_t aBegin, std::uint32_t aEnd)
+    {
+        auto const count = iOutput.size() - aMark;
+        if (count == 0u)
+            return NoNode;
+        if (count == 1u)
+        {
+            auto const result = iOutput.back();
+            iOutput.resize(aMark);
+            return result;
+        }
+        return make_node(npos, aMark, aBegin, aEnd);
+    }
+
+    bool engine::is_concept(node_index aNode) const
+    {
+        return iNodes[aNode].concept_ != npos;
+    }
+
+    bool engine::is_infix(node_index aNode) const
+    {
+        return is_concept(aNode) && iGrammar.primitives[iNodes[aNode].concept_].infix;
+    }
+
+    // Lists the nodes a unit (a node without a concept) contributes to its parent, moving each
+    // infix concept after the operand that follows it. Units nest as deeply as the input does so
+    // the walk keeps its own stack.
+    void engine::flatten(node_index aUnit, std::vector<node_index>& aResult, node_index& aPending)
+    {
+        iUnits.clear();
+        iUnits.push_back(unit_cursor{ aUnit, iNodes[aUnit].firstChild, NoNode });
+        auto pending = aPending;
+        while (!iUnits.empty())
+        {
+            auto& cursor = iUnits.back();
+            auto const& unit = iNodes[cursor.unit];
+            if (cursor.next == unit.firstChild + unit.childCount)
+            {
+                auto const outerPending = cursor.outerPending;
+                iUnits.pop_back();
+                if (iUnits.empty())
+                    break;
+                if (outerPending != NoNode)
+                    aResult.push_back(outerPending);
+                continue;
+            }
+            auto const child = iChildPool[cursor.next++];
+            if (is_infix(child))
+            {
+                if (pending != NoNode)
+                    aResult.push_back(pending);
+                pending = child;
+            }
+            else if (is_concept(child))
+            {
+                aResult.push_back(child);
+                if (pending != NoNode)
+                {
+                    aResult.push_back(pending);
+                    pending = NoNode;
+                }
+            }
+            else
+            {
+                iUnits.push_back(unit_cursor{ child, iNodes[child].firstChild, pending });
+                pending = NoNode;
+            }
+        }
+        aPending = pending;
+    }
+}
@@ -20,6 +20,7 @@
 #include <neolib/neolib.hpp>
 
 #include <iostream>
+#include <istream>
 #include <boost/lexical_cast.hpp>
 
 #include <neolib/core/scoped.hpp>
@@ -29,11 +30,12 @@
 #include <neos/bytecode/text.hpp>
 #include <neos/i_context.hpp>
 #include <neos/language/compiler.hpp>
+#include <neos/language/utf8.hpp>
 
 namespace neos::language
 {
     compiler::compiler(i_context& aContext) :
-        iContext{ aContext }, iTrace { 0u }, iStartTime{ std::chrono::steady_clock::now() }, iEndTime{ std::chrono::steady_clock::now() }
+        iContext{ aContext }, iTrace { 0u }, iStartTime{ std::chrono::steady_clock::now() }, iEndTime{ std::chrono::steady_clock::now() }, iProfiling{ false }, iIncremental{ false }
     {
     }
 
@@ -63,6 +65,63 @@ namespace neos::language
         return iEndTime;
     }
 
+    bool compiler::profiling() const
+    {
+        return iProfiling;
+    }
+
+    void compiler::set_profiling(bool aProfiling)
+    {
+        iProfiling = aProfiling;
+        if (iProfiling)
+            iProfiles.clear();
+    }
+
+    bool compiler::incremental() const
+    {
+        return iIncremental;
+    }
+
+    // Fragments compiled while on keep their parse so that they can be reparsed after an edit;
+    // turning it off forgets those kept.
+    void compiler::set_incremental(bool aIncremental)
+    {
+        iIncremental = aIncremental;
+        if (!iIncremental)
+            iIncrementalFragments.clear();
+    }
+
+    code_parser::incremental_parser const& compiler::incremental_parser(i_source_fragment const& aFragment) const
+    {
+        auto const existing = iIncrementalFragments.find(&aFragment);
+        if (existing == iIncrementalFragments.end())
+            throw fragment_not_incremental();
+        return *existing->second.parser;
+    }
+
+    void compiler::write_profile(std::ostream& aStream, bool aJson) const
+    {
+        if (aJson)
+        {
+            aStream << "{ \"stages\": [";
+            for (auto const& p : iProfiles)
+            {
+                aStream << (&p == &iProfiles.front() ? "\n" : ",\n") << "{ \"stage\": \"" << p.stage << "\", \"profile\":\n";
+                code_parser::write_profile_json(aStream, *p.grammar, p.profile);
+                aStream << " }";
+            }
+            aStream << " ] }" << std::endl;
+            return;
+        }
+        if (iProfiles.empty())
+            aStream << "No parser profile (profiles are gathered by the neos parser engine)" << std::endl;
+        for (auto const& p : iProfiles)
+        {
+            aStream << "Parser stage '" << p.stage << "':" << std::endl;
+            code_parser::write_profile_report(aStream, *p.grammar, p.profile);
+        }
+    }
+
     bool compiler::compile(program& aProgram)
     {
         for (auto& unit : aProgram.translationUnits)
@@ -106,24 +165,25 @@ namespace neos::language
 
     namespace
     {
-        void walk_ast(i_context& context, ast& ast, fold_stack& foldStack, parser::ast_node const& parserAstNode, i_ast_node& astNode)
+        void walk_ast(i_context& context, schema_stage const& stage, ast& ast, fold_stack& foldStack, parser::ast_node const& parserAstNode, i_ast_node& astNode)
         {
             for (auto const& childParserNode : parserAstNode.children)
             {
-                astNode.children().push_back(neolib::make_ref<ast_node>(std::monostate{}, astNode));
-                auto& childNode = *astNode.children().back();
-                walk_ast(context, ast, foldStack, *childParserNode, childNode);
+                auto& childNode = ast.make_node(std::monostate{}, astNode);
+                astNode.children().push_back(neolib::ref_ptr<i_ast_node>{ childNode });
+                walk_ast(context, stage, ast, foldStack, *childParserNode, childNode);
             }
 
             neolib::string_view const conceptName{ parserAstNode.c.value() };
             neolib::string_view const conceptValue{ parserAstNode.value };
 
-            auto c = context.find_concept(conceptName.to_std_string_view());
+            auto const bound = stage.concepts.find(conceptName.to_std_string_view());
+            auto c = (bound != stage.concepts.end() ? bound->second.semanticConcept : context.find_concept(conceptName.to_std_string_view()));
             if (c)
             {
                 auto const semanticConcept = c->instantiate(context, conceptValue);
                 astNode.value() = semanticConcept;
-                if (conceptName != "language.keyword")
+                if (bound != stage.concepts.end() ? bound->second.fold : conceptName != "language.keyword")
                 {
                     foldStack.push_back(neolib::ref_ptr<i_ast_node>{ astNode });
                     if (context.compiler().trace() >= 2)
@@ -134,6 +194,64 @@ namespace neos::language
             else
                 throw concept_not_found(conceptName.to_std_string_view(), conceptValue.begin());
         };
+
+        // Builds the AST straight from the neos parser engine's nodes using the concepts the
+        // schema bound to the stage grammar's primitives when it was loaded.
+        class ast_builder : public code_parser::i_ast_sink
+        {
+        public:
+            // the root is given its concept, and folded, unless it has it already (as it has when
+            // only some of a fragment's pieces are built again)
+            ast_builder(i_context& aContext, fold_stack& aFoldStack, schema_stage const& aStage, ast& aAst, bool aRoot = true) :
+                iContext{ aContext }, iFoldStack{ aFoldStack }, iGrammar{ *aStage.codeGrammar }, iConcepts{ aStage.primitiveConcepts }, iAst{ aAst }, iRoot{ *aAst.root() }, iBuildRoot{ aRoot }
+            {
+            }
+        public:
+            void open_node(code_parser::primitive_index, std::string_view const&) final
+            {
+                if (iOpen.empty())
+                {
+                    iOpen.push_back(&iRoot);
+                    return;
+                }
+                auto& parent = *iOpen.back();
+                auto& node = iAst.make_node(std::monostate{}, parent);
+                parent.children().push_back(neolib::ref_ptr<i_ast_node>{ node });
+                iOpen.push_back(&node);
+            }
+            void close_node(code_parser::primitive_index aConcept, std::string_view const& aValue) final
+            {
+                auto& astNode = *iOpen.back();
+                iOpen.pop_back();
+
+                if (aConcept == code_parser::npos || (&astNode == &iRoot && !iBuildRoot))
+                    return;
+
+                neolib::string_view const conceptName{ *iGrammar.primitives[aConcept].c };
+                neolib::string_view const conceptValue{ aValue };
+
+                auto const& bound = iConcepts[aConcept];
+                if (!bound.semanticConcept)
+                    throw concept_not_found(conceptName.to_std_string_view(), conceptValue.begin());
+                astNode.value() = bound.semanticConcept->instantiate(iContext, conceptValue);
+                if (bound.fold)
+                {
+                    iFoldStack.push_back(neolib::ref_ptr<i_ast_node>{ astNode });
+                    if (iContext.compiler().trace() >= 2)
+                        iContext.cout() << "Fold stack add: " << conceptName << " [" <<
+                        neolib::to_escaped_string(conceptValue.to_std_string_view(), 32u, true) << "]" << std::endl;
+                }
+            }
+        private:
+            i_context& iContext;
+            fold_stack& iFoldStack;
+            code_parser::grammar const& iGrammar;
+            std::vector<bound_concept> const& iConcepts;
+            ast& iAst;
+            i_ast_node& iRoot;
+            bool iBuildRoot;
+            std::vector<i_ast_node*> iOpen;
+        };
     }
 
     bool compiler::compile(program& aProgram, translation_unit& aUnit, i_source_fragment& aFragment)
@@ -145,11 +263,105 @@ namespace neos::language
 
         aFragment.set_status(compilation_status::Compiling);
 
+        // a fragment kept for reparse() shares its text with the pieces whose nodes refer to it so
+        // that the text outlives an edit
+        auto* const sourceFragment = dynamic_cast<source_fragment*>(&aFragment);
+        if (iIncremental && sourceFragment != nullptr && !sourceFragment->buffer())
+        {
+            auto const origin = sourceFragment->origin();
+            sourceFragment->set_source(source_buffer::hold(aFragment.source().to_std_string()));
+            sourceFragment->set_origin(origin);
+        }
+
         bool ok = false;
+        incremental_fragment* kept = nullptr;
+
+        auto const& meta = aUnit.schema->meta();
+        code_parser::token_stream tokens;
 
         for (auto const& stage : aUnit.schema->pipeline())
         {
             bool const last = (stage == aUnit.schema->pipeline().back());
+            if (!last && stage->dfa)
+            {
+                // only the neos engine can consume a token stream
+                if (meta.parserEngine == parser_engine::Neos)
+                    ok = stage->dfa->tokenize(aFragment.source().to_std_string_view(), tokens);
+                else
+                    ok = stage->dfa->tokenize(aFragment.source().to_std_string_view());
+                if (!ok)
+                    break;
+                continue;
+            }
+            if (meta.parserEngine == parser_engine::Neos)
+            {
+                // a large enough source the stage says how to split is parsed a piece per thread;
+                // profiling wants a single engine's counters so it always parses the source whole
+                if (last && stage->root && stage->split && !iProfiling)
+                {
+                    auto const source = aFragment.source().to_std_string_view();
+                    if (iIncremental)
+                    {
+                        // pieces are tokenized on their own when reparsed so every stage before
+                        // this one must be a tokenizer
+                        std::vector<std::shared_ptr<code_parser::dfa>> tokenizers;
+                        for (auto const& previous : aUnit.schema->pipeline())
+                            if (previous != stage)
+                                tokenizers.push_back(previous->dfa);
+                        if (sourceFragment != nullptr && std::find(tokenizers.begin(), tokenizers.end(), nullptr) == tokenizers.end())
+                        {
+                            auto& incremental = iIncrementalFragments[&aFragment];
+                            // compiled again: what its previous compile contributed goes first
+                            remove_incremental(aUnit, incremental, 0u, incremental.pieces.size());
+                            incremental = incremental_fragment{ &aUnit, stage.get(), std::make_unique<code_parser::incremental_parser>(
+                                *stage->codeGrammar, stage->symbolMap->at(stage->root.value()), *stage->split, tokenizers, meta.parserPackrat),
+                                sourceFragment->buffer() };
+                            ok = incremental.parser->parse(source);
+                            if (ok)
+                            {
+                                emit_incremental(aUnit, incremental, 0u, incremental.parser->piece_count(), true);
+                                kept = &incremental;
+                                continue;
+                            }
+                            iIncrementalFragments.erase(&aFragment);
+                        }
+                    }
+                    auto const pieces = code_parser::split_source(source, *stage->split);
+                    if (pieces.size() > 1u)
+                    {
+                        code_parser::parallel_parser parser{ *stage->codeGrammar, meta.parserPackrat };
+                        ok = parser.parse(stage->symbolMap->at(stage->root.value()), source, pieces, tokens);
+                        if (trace() >= 1)
+                            iContext.cout() << "Parser stage '" << stage->name << "': " << parser.piece_count() << " piece(s) on " <<
+                                parser.thread_count() << " thread(s), " << (ok ? "parsed" : "a piece failed to parse, parsing whole") << std::endl;
+                        if (ok)
+                        {
+                            ast_builder builder{ iContext, fold_stack(), *stage, aUnit.ast };
+                            parser.create_ast(builder);
+                            continue;
+                        }
+                    }
+                }
+                code_parser::engine parser{ *stage->codeGrammar, meta.parserPackrat };
+                if (iProfiling)
+                    parser.set_profile(&profile(*stage));
+                if (stage->root)
+                    ok = parser.parse(stage->symbolMap->at(stage->root.value()), aFragment.source().to_std_string_view(), tokens);
+                else
+                    ok = parser.parse(aFragment.source().to_std_string_view());
+                if (trace() >= 1)
+                    iContext.cout() << "Parser stage '" << stage->name << "': " << tokens.size() << " token(s), " <<
+                        parser.statistics().tokenHits << " token hit(s), " << parser.statistics().memoHits << " memo hit(s), " <<
+                        parser.statistics().memoMisses << " memo miss(es), " << parser.statistics().triviaScans << " trivia scan(s)" << std::endl;
+                if (!ok)
+                    break;
+                if (last)
+                {
+                    ast_builder builder{ iContext, fold_stack(), *stage, aUnit.ast };
+                    parser.create_ast(builder);
+                }
+                continue;
+            }
             auto& parser = *stage->parser;
             for (auto const& discard : *stage->discard)
                 parser.ignore(stage->symbolMap->at(discard));
@@ -163,7 +375,7 @@ namespace neos::language
             if (last)
             {
                 parser.create_ast();
-                walk_ast(iContext, aUnit.ast, fold_stack(), parser.ast(), *aUnit.ast.root());
+                walk_ast(iContext, *stage, aUnit.ast, fold_stack(), parser.ast(), *aUnit.ast.root());
             }
         }
             
@@ -178,6 +390,9 @@ namespace neos::language
                 throw std::runtime_error("Failed to fold semantic concepts");
             }
 
+            if (kept != nullptr)
+                record_incremental(*kept, 0u, kept->pieces.size());
+
             aFragment.set_status(compilation_status::Compiled);
         }
         else
@@ -189,6 +404,163 @@ namespace neos::language
         return ok;
     }
 
+    // Reparses a fragment compiled with incremental() on after replacing aLength bytes of its source
+    // at aOffset with aReplacement: only the top level declarations the edit touched are parsed
+    // again. What the pieces replaced contributed, their scopes, is taken away and only the pieces
+    // that replaced them are built and folded as compile() does; a piece left unbuilt by an edit
+    // that didn't parse is built by the next that does.
+    bool compiler::reparse(program& aProgram, translation_unit& aUnit, i_source_fragment& aFragment, std::size_t aOffset, std::size_t aLength, std::string_view const& aReplacement)
+    {
+        auto existing = iIncrementalFragments.find(&aFragment);
+        auto* const sourceFragment = dynamic_cast<source_fragment*>(&aFragment);
+        if (existing == iIncrementalFragments.end() || existing->second.unit != &aUnit || sourceFragment == nullptr)
+            throw fragment_not_incremental();
+        auto& incremental = existing->second;
+
+        auto const before = aFragment.source().to_std_string_view();
+        if (aOffset > before.size() || aLength > before.size() - aOffset)
+            throw bad_edit();
+        std::string edited;
+        edited.reserve(before.size() - aLength + aReplacement.size());
+        edited.append(before.substr(0u, aOffset)).append(aReplacement).append(before.substr(aOffset + aLength));
+        auto const origin = sourceFragment->origin();
+        sourceFragment->set_source(source_buffer::hold(std::move(edited)));
+        sourceFragment->set_origin(origin);
+
+        iCompilationStateStack.push_back(std::make_unique<compilation_state>(&aProgram, &aUnit, &aFragment));
+
+        aFragment.set_status(compilation_status::Compiling);
+
+        bool const ok = incremental.parser->reparse(sourceFragment->buffer()->text(),
+            code_parser::source_edit{ aOffset, aLength, aReplacement.size() });
+        incremental.source = sourceFragment->buffer();
+        auto const& damage = incremental.parser->last_damage();
+        if (trace() >= 1)
+            iContext.cout() << "Reparse: " << damage.reparsed << " of " << incremental.parser->piece_count() << " piece(s) parsed, " <<
+                damage.removed << " replaced by " << damage.inserted << std::endl;
+        remove_incremental(aUnit, incremental, damage.first, damage.removed);
+        incremental.pieces.insert(std::next(incremental.pieces.begin(), damage.first), damage.inserted, incremental_piece{});
+        if (ok)
+        {
+            auto const unfolded = [](incremental_piece const& aPiece) { return !aPiece.folded; };
+            auto const first = static_cast<std::size_t>(std::distance(incremental.pieces.begin(), 
+                std::find_if(incremental.pieces.begin(), incremental.pieces.end(), unfolded)));
+            auto const last = static_cast<std::size_t>(std::distance(std::find_if(incremental.pieces.rbegin(), incremental.pieces.rend(), unfolded), 
+                incremental.pieces.rend()));
+            if (first < last)
+            {
+                remove_incremental(aUnit, incremental, first, last - first);
+                emit_incremental(aUnit, incremental, first, last - first, false);
+                if (!fold())
+                {
+                    aFragment.set_status(compilation_status::Error);
+
+                    iCompilationStateStack.pop_back();
+
+                    throw std::runtime_error("Failed to fold semantic concepts");
+                }
+                record_incremental(incremental, first, last - first);
+            }
+            compact(aUnit);
+
+            aFragment.set_status(compilation_status::Compiled);
+        }
+        else
+            aFragment.set_status(compilation_status::Error);
+
+        iCompilationStateStack.pop_back();
+
+        return ok;
+    }
+
+    // Compiles a source as it is read for a schema whose parser stage has a split hint: each piece
+    // (top level statements up to the hint's piece size) is parsed and folded and its AST dropped
+    // before the rest of the source is read so what is resident is bounded by the largest piece
+    // rather than the source. The fragment holds the piece being compiled with its origin in the
+    // stream so that diagnostics give positions in the stream rather than in the piece.
+    bool compiler::compile(program& aProgram, translation_unit& aUnit, source_fragment& aFragment, std::istream& aSource)
+    {
+        auto const& stage = *aUnit.schema->pipeline().back();
+        if (!stage.split)
+            throw std::runtime_error("Schema stage '" + stage.name + "' has no split hint so its source can't be streamed");
+
+        iStartTime = std::chrono::steady_clock::now();
+
+        bool ok = true;
+
+        try
+        {
+            std::string buffer;
+            // the bytes at the front of the buffer origin has been advanced over
+            std::size_t consumed = 0u;
+            source_origin origin;
+            auto const advance = [&](std::size_t aEnd)
+            {
+                auto const text = std::string_view{ buffer }.substr(consumed, aEnd - consumed);
+                origin.offset += text.size();
+                auto const lastNewline = text.rfind('\n');
+                if (lastNewline == std::string_view::npos)
+                    origin.column += count_code_points(text);
+                else
+                {
+                    origin.line += static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n'));
+                    origin.column = count_code_points(text.substr(lastNewline + 1u));
+                }
+                consumed = aEnd;
+            };
+            bool more = true;
+            while (ok && (more || !buffer.empty()))
+            {
+                if (more)
+                {
+                    // a piece longer than what is buffered doubles the read so it is scanned a
+                    // bounded number of times
+                    auto const existing = buffer.size();
+                    auto const length = std::max(StreamChunkSize, existing);
+                    buffer.resize(existing + length);
+                    aSource.read(buffer.data() + existing, static_cast<std::streamsize>(length));
+                    buffer.resize(existing + static_cast<std::size_t>(aSource.gcount()));
+                    more = !!aSource;
+                }
+                if (buffer.empty())
+                    break;
+                auto const pieces = code_parser::split_source(buffer, *stage.split);
+                // the last piece may be continued by what is yet to be read
+                auto const complete = (more ? pieces.size() - 1u : pieces.size());
+                for (std::size_t piece = 0u; ok && piece < complete; ++piece)
+                {
+                    auto const begin = static_cast<std::size_t>(pieces[piece].data() - buffer.data());
+                    advance(begin);
+                    neolib::string const source{ std::string{ pieces[piece] } };
+                    aFragment.set_source(source.to_string_view());
+                    aFragment.set_origin(origin);
+                    if (!validate_utf8(pieces[piece]))
+                        throw std::runtime_error("Source has invalid utf-8");
+                    aFragment.set_status(compilation_status::Pending);
+                    ok = compile(aProgram, aUnit, aFragment);
+                    advance(begin + pieces[piece].size());
+                    // the piece's code is in the program's text now and, as folding it emptied
+                    // its fold stack, nothing being compiled refers to its AST
+                    if (std::any_of(iCompilationStateStack.begin(), iCompilationStateStack.end(),
+                        [&](auto const& aState) { return aState->unit == &aUnit && !aState->foldStack.empty(); }))
+                        throw std::logic_error("neos::language::compiler::compile");
+                    aUnit.ast.clear();
+                }
+                buffer.erase(0u, consumed);
+                consumed = 0u;
+            }
+        }
+        catch (...)
+        {
+            iEndTime = std::chrono::steady_clock::now();
+            throw;
+        }
+
+        iEndTime = std::chrono::steady_clock::now();
+
+        return ok;
+    }
+
     bool compiler::compile(const i_source_fragment& aFragment)
     {
         auto& program = *state().program;
@@ -209,13 +581,17 @@ namespace neos::language
         return state().program->scope;
     }
 
+    // Who entered a scope is counted, and from where in the source, so that a reparse can take
+    // away a scope only the source it replaced entered.
     i_scope& compiler::enter_scope(scope_type aScopeType, neolib::i_string const& aScopeName)
     {
-        if (state().scopeStack.empty())
-            state().scopeStack.push_back(state().program->scope.create_child(aScopeName, aScopeType));
-        else
-            state().scopeStack.push_back(state().scopeStack.back()->create_child(aScopeName, aScopeType));
-        return *state().scopeStack.back();
+        i_scope& parent = (state().scopeStack.empty() ? state().program->scope : *state().scopeStack.back());
+        auto& entered = parent.create_child(aScopeName, aScopeType);
+        state().scopeStack.push_back(entered);
+        ++state().program->scopeUsers[&entered];
+        state().enteredScopes.push_back(entered_scope{ &parent, &entered,
+            state().folding != nullptr ? std::to_address(state().folding->source().begin()) : nullptr });
+        return entered;
     }
 
     void compiler::leave_scope(scope_type aScopeType)
@@ -320,10 +696,117 @@ namespace neos::language
         return *iCompilationStateStack.back();
     }
 
+    // Builds pieces [aFirst, aFirst + aCount) of a fragment's kept parse under the unit's root,
+    // merged into it as the whole fragment's are; their nodes are appended to the root's children
+    // so the unit's AST is flattened by extending it.
+    void compiler::emit_incremental(translation_unit& aUnit, incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount, bool aRoot)
+    {
+        std::vector<incremental_piece> emitted;
+        ast_builder builder{ iContext, fold_stack(), *aIncremental.stage, aUnit.ast, aRoot };
+        code_parser::merged_ast_sink merger{ builder, aIncremental.source->text() };
+        for (auto piece = aFirst; piece < aFirst + aCount; ++piece)
+        {
+            auto const before = aUnit.ast.node_count();
+            aIncremental.parser->create_ast(merger, piece);
+            emitted.push_back(incremental_piece{ aIncremental.source, aUnit.ast.node_count() - before });
+        }
+        merger.finish();
+        aIncremental.pieces.insert(std::next(aIncremental.pieces.begin(), aFirst), 
+            std::make_move_iterator(emitted.begin()), std::make_move_iterator(emitted.end()));
+    }
+
+    // The scopes folding the pieces just emitted entered are those entered from their source.
+    void compiler::record_incremental(incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount)
+    {
+        auto const text = aIncremental.source->text();
+        for (auto const& entered : state().enteredScopes)
+            if (entered.at >= text.data() && entered.at < text.data() + text.size())
+            {
+                auto const piece = aIncremental.parser->piece_at(static_cast<std::size_t>(entered.at - text.data()));
+                if (piece >= aFirst && piece < aFirst + aCount)
+                    aIncremental.pieces[piece].scopes.push_back(entered);
+            }
+        for (auto piece = aFirst; piece < aFirst + aCount; ++piece)
+            aIncremental.pieces[piece].folded = true;
+        state().enteredScopes.clear();
+    }
+
+    namespace
+    {
+        // a scope's children are made by scope<>::create_child so are scope<> or function_scope
+        void remove_child(i_scope& aParent, i_scope const& aChild)
+        {
+            if (auto* const parent = dynamic_cast<scope<>*>(&aParent))
+                parent->remove_child(aChild);
+            else if (auto* const parent = dynamic_cast<function_scope*>(&aParent))
+                parent->remove_child(aChild);
+        }
+    }
+
+    // Takes away what pieces [aFirst, aFirst + aCount) contributed: a scope they entered that
+    // nothing else has entered, and that has nothing in it, is taken out of its parent (the last
+    // entered first so that a function's scope goes before its namespace's). Their nodes are
+    // left in the unit's AST, out of the way as they are folded, until compact() clears it.
+    void compiler::remove_incremental(translation_unit& aUnit, incremental_fragment& aIncremental, std::size_t aFirst, std::size_t aCount)
+    {
+        auto& scopeUsers = state().program->scopeUsers;
+        auto& dropped = iDroppedNodes[&aUnit];
+        auto const first = std::next(aIncremental.pieces.begin(), aFirst);
+        auto const last = std::next(first, aCount);
+        for (auto piece = std::make_reverse_iterator(last); piece != std::make_reverse_iterator(first); ++piece)
+        {
+            for (auto entered = piece->scopes.rbegin(); entered != piece->scopes.rend(); ++entered)
+            {
+                auto const users = scopeUsers.find(entered->scope);
+                if (users != scopeUsers.end() && --users->second == 0u && entered->scope->children().empty())
+                {
+                    scopeUsers.erase(users);
+                    remove_child(*entered->parent, *entered->scope);
+                }
+            }
+            dropped.count += piece->nodes;
+            if (piece->source && (dropped.sources.empty() || dropped.sources.back() != piece->source))
+                dropped.sources.push_back(piece->source);
+        }
+        aIncremental.pieces.erase(first, last);
+    }
+
+    // The unit's AST is only looked at as it is folded so, once the nodes reparse() has replaced
+    // outnumber the rest and none of the unit's nodes are being folded, it is cleared as a
+    // streamed compile clears it after each piece; the arena then grows with the source rather
+    // than with every edit.
+    void compiler::compact(translation_unit& aUnit)
+    {
+        auto const dropped = iDroppedNodes.find(&aUnit);
+        if (dropped == iDroppedNodes.end() || dropped->second.count * 2u <= aUnit.ast.node_count())
+            return;
+        if (std::any_of(iCompilationStateStack.begin(), iCompilationStateStack.end(),
+            [&](auto const& aState) { return aState->unit == &aUnit && !aState->foldStack.empty(); }))
+            return;
+        aUnit.ast.clear();
+        iDroppedNodes.erase(dropped);
+        for (auto& other : iIncrementalFragments)
+            if (other.second.unit == &aUnit)
+                for (auto& piece : other.second.pieces)
+                {
+                    piece.nodes = 0u;
+                    piece.source.reset();
+                }
+    }
+
+    // Each step of a fold does what can be done at the first position of the fold stack where
+    // something can, looking from the bottom of the stack every time: a step can change whether
+    // pairs below where it folded can fold (a node taking another's children and value, or a
+    // concept's answer depending on what has been folded) so the order of folds is only the same
+    // as it always has been if no pair is passed over for having been looked at before. The stack
+    // is a list so that the steps themselves don't move what is after them. Flattening the unit's
+    // AST lays out just the nodes the fragment added to it.
     bool compiler::fold()
     {
+        state().unit->ast.flatten();
         while (fold2())
             ;
+        state().folding = nullptr;
         return fold_stack().empty();
     }
 
@@ -358,6 +841,7 @@ namespace neos::language
             for (auto ilhs = fold_stack().begin(); !didSome && ilhs != fold_stack().end();)
             {
                 auto& lhs = **ilhs;
+                state().folding = &lhs;
                 if (lhs.can_fold())
                 {
                     trace_out("Folding", lhs);
@@ -375,6 +859,7 @@ namespace neos::language
                     bool const unrelated = !lhs.is_sibling(rhs) && !lhs.is_child(rhs) && !rhs.is_child(lhs);
                     if (rhs.can_fold())
                     {
+                        state().folding = &rhs;
                         trace_out("Folding", rhs);
                         auto const result = rhs.fold(iContext);
                         trace_out("Folded", rhs, {}, result);
@@ -389,7 +874,7 @@ namespace neos::language
                             trace_out("Skipping", lhs, rhs);
                         ++ilhs;
                     }
-                    else if (lhs.name() == rhs.name() && lhs.has_ghosts())
+                    else if (lhs.is_same_concept(rhs) && lhs.has_ghosts())
                     {
                         if (lhs.holds_data() && !rhs.holds_data())
                         {
@@ -487,9 +972,16 @@ namespace neos::language
         {
             if (trace() >= 3)
             {
+                auto const& program = *state().program;
                 for (auto const& e : fold_stack())
+                {
                     iContext.cout() << "Fold stack: " << e->name() << " [" <<
-                    neolib::to_escaped_string(e->source().to_std_string_view(), 32u, true) << "]" << std::endl;
+                        neolib::to_escaped_string(e->source().to_std_string_view(), 32u, true) << "]";
+                    auto const where = program.sourceMap.locate(program.translationUnits, std::to_address(e->source().begin()));
+                    if (where)
+                        iContext.cout() << " (" << where->line << "," << where->column << ")";
+                    iContext.cout() << std::endl;
+                }
             }
             if (fold_stack().size() == 1)
                 throw_error(fold_stack().front()->source().begin(),
@@ -508,43 +1000,71 @@ namespace neos::language
         return state().foldStack;
     }
 
-    std::string compiler::location(const translation_unit& aUnit, const i_source_fragment& aFragment, source_iterator aSourcePos, bool aShowFragmentFilePath)
+    // A stage's counters accumulate over every compile until profiling is restarted or the schema
+    // is reloaded with a different grammar.
+    code_parser::profile& compiler::profile(schema_stage const& aStage)
     {
-        std::uint32_t line = 1;
-        std::uint32_t col = 1;
-        for (auto pos = aFragment.begin(); pos != aSourcePos; ++pos)
-        {
-            if (*pos == '\n')
+        for (auto& p : iProfiles)
+            if (p.stage == aStage.name)
             {
-                ++line;
-                col = 1;
+                if (p.grammar != aStage.codeGrammar)
+                    p = stage_profile{ aStage.name, aStage.codeGrammar };
+                return p.profile;
             }
-            else
-                ++col;
-        }
-        std::vector<std::string> lines;
-        std::istringstream iss{ aFragment.source().to_std_string() };
-        std::string nextLine;
-        while (std::getline(iss, nextLine))
-            lines.push_back(nextLine);
-        std::size_t numberWidth = std::to_string(lines.size()).size();
-        std::uint32_t lineNumber = 1u;
+        iProfiles.push_back(stage_profile{ aStage.name, aStage.codeGrammar });
+        return iProfiles.back().profile;
+    }
+
+    // The line is found from the fragment's index of line starts and the column counts code points.
+    // Lines of a piece of a streamed source are numbered as they are in the stream.
+    std::string compiler::location(const translation_unit& aUnit, const i_source_fragment& aFragment, source_iterator aSourcePos, bool aShowFragmentFilePath)
+    {
+        auto const source = aFragment.source().to_std_string_view();
+        auto const* fragment = dynamic_cast<source_fragment const*>(&aFragment);
+        std::optional<text_index> ownIndex;
+        if (fragment == nullptr)
+            ownIndex = index_text(source);
+        auto const& index = (fragment != nullptr ? fragment->index() : *ownIndex);
+        auto const origin = (fragment != nullptr ? fragment->origin() : source_origin{});
+        auto const position = index.position(source, static_cast<std::size_t>(std::distance(aFragment.begin(), aSourcePos)));
+        auto const lineIndex = position.line;
+        auto const line = static_cast<std::uint32_t>(origin.line + lineIndex + 1u);
+        auto const col = static_cast<std::uint32_t>(position.column + 1u);
+        auto const streamCol = static_cast<std::uint32_t>(lineIndex == 0u ? origin.column + col : col);
+        auto const text_of_line = [&](std::size_t aLine)
+        {
+            auto const begin = index.lineStarts[aLine];
+            auto const end = (aLine + 1u < index.lineStarts.size() ? index.lineStarts[aLine + 1u] - 1u : source.size());
+            return source.substr(begin, end - begin);
+        };
+        // as std::getline would split it: no last line if the source ends with a newline
+        auto lineCount = index.lineStarts.size();
+        if (lineCount > 1u && index.lineStarts.back() == source.size())
+            --lineCount;
+        std::size_t numberWidth = std::to_string(origin.line + lineCount).size();
         std::ostringstream oss;
-        for (auto const& outputLine : lines)
+        auto const first = (lineIndex > 5u ? lineIndex - 5u : 0u);
+        auto const last = std::min(lineIndex + 6u, lineCount);
+        for (auto outputLine = first; outputLine < last; ++outputLine)
         {
-            if (std::abs(static_cast<int>(line - lineNumber)) <= 5)
-                oss << std::setw(numberWidth) << lineNumber << (lineNumber == line ? ">" : "|") << outputLine << std::endl;
-            ++lineNumber;
+            auto const lineNumber = origin.line + outputLine + 1u;
+            oss << std::setw(numberWidth) << lineNumber << (lineNumber == line ? ">" : "|") << text_of_line(outputLine) << std::endl;
         }
         oss << std::string(col + numberWidth, '-') << "^" << std::endl;
         std::string info = (aShowFragmentFilePath && aFragment.source_file_path() != std::nullopt ? aFragment.source_file_path()->to_std_string() : "") + 
-            "(" + boost::lexical_cast<std::string>(line) + "," + boost::lexical_cast<std::string>(col) + ")";
+            "(" + boost::lexical_cast<std::string>(line) + "," + boost::lexical_cast<std::string>(streamCol) + ")";
         oss << info;
         return oss.str();
     }
 
+    // The fragment the error is in is looked up as it needn't be the one being compiled (it can
+    // be one imported by it).
     void compiler::throw_error(source_iterator aSourcePos, neolib::i_string const& aError, neolib::i_string const& aErrorType)
     {
+        auto const& program = *state().program;
+        auto const where = program.sourceMap.locate(program.translationUnits, std::to_address(aSourcePos));
+        if (where)
+            throw compiler_error((location(*where->unit, *where->fragment, aSourcePos) + ": " + aErrorType + ": " + aError).to_std_string());
         throw compiler_error((location(*state().unit, *state().fragment, aSourcePos) + ": " + aErrorType + ": " + aError).to_std_string());
     }
 }
@@ -0,0 +1,100 @@
+/*
+  concept_registry.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <unordered_set>
+#include <neos/language/concept_registry.hpp>
+
+namespace neos::language
+{
+    // Each name gets the next id and, from the concept it resolves to, a row of the bitset of the
+    // ids it is so that after this a relation is a bit test. What a concept can fold with is left
+    // to the concept to answer as it can depend on what has been folded.
+    void concept_registry::build(concept_libraries_t const& aLibraries)
+    {
+        clear();
+        std::unordered_set<i_concept_library const*> visited;
+        auto const add = [&](auto& self, i_concept_library const& aLibrary) -> void
+        {
+            if (!visited.insert(&aLibrary).second)
+                return;
+            for (auto const& c : aLibrary.concepts())
+            {
+                auto const newId = static_cast<concept_id>(iById.size());
+                auto const id = iIds.try_emplace(c.second()->name().to_std_string_view(), newId).first->second;
+                if (id == newId)
+                    iById.push_back(c.second());
+                iDefinitionIds.try_emplace(&*c.second(), id);
+            }
+            for (auto const& sublibrary : aLibrary.sublibraries())
+                self(self, *sublibrary.second());
+        };
+        for (auto const& library : aLibraries)
+            add(add, *library.second());
+        iWordCount = (iById.size() + 63u) / 64u;
+        iIs.assign(iById.size() * iWordCount, 0u);
+        for (concept_id c = 0u; c < iById.size(); ++c)
+            for (concept_id other = 0u; other < iById.size(); ++other)
+                if (iById[c]->is(iById[other]->name()))
+                    iIs[c * iWordCount + (other >> 6u)] |= (std::uint64_t{ 1u } << (other & 63u));
+    }
+
+    void concept_registry::clear()
+    {
+        iIds.clear();
+        iDefinitionIds.clear();
+        iById.clear();
+        iWordCount = 0u;
+        iIs.clear();
+    }
+
+    std::size_t concept_registry::size() const
+    {
+        return iById.size();
+    }
+
+    concept_id concept_registry::id(std::string_view const& aName) const
+    {
+        auto const existing = iIds.find(aName);
+        return existing != iIds.end() ? existing->second : NoId;
+    }
+
+    concept_id concept_registry::id(i_semantic_concept const& aConcept) const
+    {
+        auto const existing = iDefinitionIds.find(&aConcept);
+        return existing != iDefinitionIds.end() ? existing->second : id(aConcept.name().to_std_string_view());
+    }
+
+    i_semantic_concept* concept_registry::find(std::string_view const& aName) const
+    {
+        return find(id(aName));
+    }
+
+    i_semantic_concept* concept_registry::find(concept_id aId) const
+    {
+        return aId < iById.size() ? &*iById[aId] : nullptr;
+    }
+
+    bool concept_registry::is(concept_id aConcept, concept_id aOther) const
+    {
+        if (aConcept >= iById.size() || aOther >= iById.size())
+            return false;
+        return ((iIs[aConcept * iWordCount + (aOther >> 6u)] >> (aOther & 63u)) & 1u) != 0u;
+    }
+}
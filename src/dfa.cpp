@@ -0,0 +1,612 @@
+/*
+  dfa.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <neos/language/dfa.hpp>
+
+namespace neos::language::code_parser
+{
+    namespace
+    {
+        struct not_regular {};
+
+        std::uint16_t const EndOfInput = 256u;
+
+        struct nfa
+        {
+            struct edge
+            {
+                std::uint16_t low;
+                std::uint16_t high;
+                std::uint32_t target;
+            };
+            struct state
+            {
+                std::vector<edge> edges;
+                std::vector<std::uint32_t> epsilons;
+            };
+            struct fragment
+            {
+                std::uint32_t start;
+                std::uint32_t end;
+            };
+
+            std::vector<state> states;
+            mutable std::vector<std::uint32_t> marks;
+            mutable std::uint32_t generation = 0u;
+
+            std::uint32_t add_state()
+            {
+                if (states.size() >= dfa::NfaStateLimit)
+                    throw not_regular{};
+                states.emplace_back();
+                return static_cast<std::uint32_t>(states.size() - 1u);
+            }
+            fragment add_fragment()
+            {
+                auto const start = add_state();
+                return fragment{ start, add_state() };
+            }
+            void add_edge(std::uint32_t aFrom, std::uint16_t aLow, std::uint16_t aHigh, std::uint32_t aTo)
+            {
+                states[aFrom].edges.push_back(edge{ aLow, aHigh, aTo });
+            }
+            void add_epsilon(std::uint32_t aFrom, std::uint32_t aTo)
+            {
+                states[aFrom].epsilons.push_back(aTo);
+            }
+            void closure(std::vector<std::uint32_t>& aSet) const
+            {
+                marks.resize(states.size(), 0u);
+                ++generation;
+                std::vector<std::uint32_t> pending;
+                std::vector<std::uint32_t> result;
+                for (auto s : aSet)
+                    if (marks[s] != generation)
+                    {
+                        marks[s] = generation;
+                        pending.push_back(s);
+                    }
+                while (!pending.empty())
+                {
+                    auto const s = pending.back();
+                    pending.pop_back();
+                    result.push_back(s);
+                    for (auto e : states[s].epsilons)
+                        if (marks[e] != generation)
+                        {
+                            marks[e] = generation;
+                            pending.push_back(e);
+                        }
+                }
+                std::sort(result.begin(), result.end());
+                aSet.swap(result);
+            }
+            std::vector<std::uint32_t> step(std::vector<std::uint32_t> const& aSet, std::uint16_t aLow, std::uint16_t aHigh) const
+            {
+                std::vector<std::uint32_t> result;
+                for (auto s : aSet)
+                    for (auto const& e : states[s].edges)
+                        if (e.low <= aLow && aHigh <= e.high)
+                            result.push_back(e.target);
+                closure(result);
+                return result;
+            }
+        };
+
+        std::size_t encode_utf8(char32_t aCodePoint, std::array<std::uint8_t, 4u>& aBytes)
+        {
+            if (aCodePoint < 0x80u)
+            {
+                aBytes[0] = static_cast<std::uint8_t>(aCodePoint);
+                return 1u;
+            }
+            if (aCodePoint < 0x800u)
+            {
+                aBytes[0] = static_cast<std::uint8_t>(0xC0u | (aCodePoint >> 6u));
+                aBytes[1] = static_cast<std::uint8_t>(0x80u | (aCodePoint & 0x3Fu));
+                return 2u;
+            }
+            if (aCodePoint < 0x10000u)
+            {
+                aBytes[0] = static_cast<std::uint8_t>(0xE0u | (aCodePoint >> 12u));
+                aBytes[1] = static_cast<std::uint8_t>(0x80u | ((aCodePoint >> 6u) & 0x3Fu));
+                aBytes[2] = static_cast<std::uint8_t>(0x80u | (aCodePoint & 0x3Fu));
+                return 3u;
+            }
+            aBytes[0] = static_cast<std::uint8_t>(0xF0u | (aCodePoint >> 18u));
+            aBytes[1] = static_cast<std::uint8_t>(0x80u | ((aCodePoint >> 12u) & 0x3Fu));
+            aBytes[2] = static_cast<std::uint8_t>(0x80u | ((aCodePoint >> 6u) & 0x3Fu));
+            aBytes[3] = static_cast<std::uint8_t>(0x80u | (aCodePoint & 0x3Fu));
+            return 4u;
+        }
+
+        // Splits a code point interval into UTF-8 byte range sequences, each of which is a
+        // rectangle (every combination of its byte ranges is a code point in the interval).
+        template <typename Emit>
+        void utf8_sequences(char32_t aLow, char32_t aHigh, Emit const& aEmit)
+        {
+            if (aLow > aHigh)
+                return;
+            for (char32_t const boundary : { 0x7Fu, 0x7FFu, 0xFFFFu })
+                if (aLow <= boundary && aHigh > boundary)
+                {
+                    utf8_sequences(aLow, boundary, aEmit);
+                    utf8_sequences(boundary + 1u, aHigh, aEmit);
+                    return;
+                }
+            std::array<std::uint8_t, 4u> low;
+            auto const length = encode_utf8(aLow, low);
+            for (std::size_t i = 1u; i < length; ++i)
+            {
+                char32_t const mask = (1u << (6u * i)) - 1u;
+                if ((aLow & ~mask) != (aHigh & ~mask))
+                {
+                    if ((aLow & mask) != 0u)
+                    {
+                        utf8_sequences(aLow, aLow | mask, aEmit);
+                        utf8_sequences((aLow | mask) + 1u, aHigh, aEmit);
+                        return;
+                    }
+                    if ((aHigh & mask) != mask)
+                    {
+                        utf8_sequences(aLow, (aHigh & ~mask) - 1u, aEmit);
+                        utf8_sequences(aHigh & ~mask, aHigh, aEmit);
+                        return;
+                    }
+                }
+            }
+            std::array<std::uint8_t, 4u> high;
+            encode_utf8(aHigh, high);
+            aEmit(low, high, length);
+        }
+
+        class nfa_builder
+        {
+        public:
+            nfa_builder(code_parser::grammar const& aGrammar, nfa& aNfa) :
+                iGrammar{ aGrammar }, iNfa{ aNfa }, iExpanding(aGrammar.symbolNames.size(), false)
+            {
+            }
+        public:
+            nfa::fragment build(primitive_index aPrimitive)
+            {
+                auto const& p = iGrammar.primitives[aPrimitive];
+                switch (p.type)
+                {
+                case primitive_type::Symbol:
+                    if (p.constraint)
+                    {
+                        // a constrained symbol matches only its constraint text and only if the
+                        // symbol itself accepts that text
+                        auto const symbol = build_symbol(p.symbol);
+                        if (accepts(symbol, *p.constraint))
+                            return build_text(*p.constraint);
+                        return iNfa.add_fragment();
+                    }
+                    return build_symbol(p.symbol);
+                case primitive_type::Terminal:
+                    return build_text(p.text);
+                case primitive_type::Range:
+                    {
+                        auto const result = iNfa.add_fragment();
+                        build_range(result, p);
+                        return result;
+                    }
+                case primitive_type::Concatenation:
+                    return build_sequence(p.children);
+                case primitive_type::Alternation:
+                    {
+                        auto const result = iNfa.add_fragment();
+                        for (auto alternative : p.children)
+                        {
+                            auto const f = build(alternative);
+                            iNfa.add_epsilon(result.start, f.start);
+                            iNfa.add_epsilon(f.end, result.end);
+                        }
+                        return result;
+                    }
+                case primitive_type::Repetition:
+                    {
+                        auto const inner = build_sequence(p.children);
+                        auto const result = iNfa.add_fragment();
+                        iNfa.add_epsilon(result.start, inner.start);
+                        if (!p.atLeastOne)
+                            iNfa.add_epsilon(result.start, result.end);
+                        iNfa.add_epsilon(inner.end, inner.start);
+                        iNfa.add_epsilon(inner.end, result.end);
+                        return result;
+                    }
+                case primitive_type::Optional:
+                    {
+                        auto const inner = build_sequence(p.children);
+                        auto const result = iNfa.add_fragment();
+                        iNfa.add_epsilon(result.start, inner.start);
+                        iNfa.add_epsilon(result.start, result.end);
+                        iNfa.add_epsilon(inner.end, result.end);
+                        return result;
+                    }
+                case primitive_type::Eof:
+                    {
+                        auto const result = iNfa.add_fragment();
+                        iNfa.add_edge(result.start, EndOfInput, EndOfInput, result.end);
+                        return result;
+                    }
+                case primitive_type::Operators:
+                    // operands nest through their operators
+                    break;
+                }
+                throw not_regular{};
+            }
+            nfa::fragment build_sequence(std::vector<primitive_index> const& aSequence)
+            {
+                auto const start = iNfa.add_state();
+                auto current = start;
+                for (auto element : aSequence)
+                {
+                    auto const f = build(element);
+                    iNfa.add_epsilon(current, f.start);
+                    current = f.end;
+                }
+                return nfa::fragment{ start, current };
+            }
+            nfa::fragment build_symbol(code_parser::symbol aSymbol)
+            {
+                auto const index = static_cast<std::size_t>(aSymbol);
+                if (index >= iExpanding.size())
+                    iExpanding.resize(index + 1u, false);
+                if (iExpanding[index])
+                    throw not_regular{};
+                iExpanding[index] = true;
+                auto const result = iNfa.add_fragment();
+                for (auto r : iGrammar.rules_for(aSymbol))
+                {
+                    auto const f = build_sequence(iGrammar.rules[r].rhs);
+                    iNfa.add_epsilon(result.start, f.start);
+                    iNfa.add_epsilon(f.end, result.end);
+                }
+                iExpanding[index] = false;
+                return result;
+            }
+        private:
+            nfa::fragment build_text(std::string_view const& aText)
+            {
+                auto const start = iNfa.add_state();
+                auto current = start;
+                for (auto ch : aText)
+                {
+                    auto const next = iNfa.add_state();
+                    iNfa.add_edge(current, static_cast<std::uint8_t>(ch), static_cast<std::uint8_t>(ch), next);
+                    current = next;
+                }
+                return nfa::fragment{ start, current };
+            }
+            void build_range(nfa::fragment const& aFragment, primitive const& aRange)
+            {
+                if (!aRange.codepoints)
+                {
+                    auto const& bytes = aRange.byteClass;
+                    for (std::uint32_t low = 0u; low < 256u; ++low)
+                    {
+                        if (!bytes.test(static_cast<std::uint8_t>(low)))
+                            continue;
+                        auto high = low;
+                        while (high + 1u < 256u && bytes.test(static_cast<std::uint8_t>(high + 1u)))
+                            ++high;
+                        iNfa.add_edge(aFragment.start, static_cast<std::uint16_t>(low), static_cast<std::uint16_t>(high), aFragment.end);
+                        low = high;
+                    }
+                    return;
+                }
+                std::vector<std::pair<char32_t, char32_t>> intervals;
+                if (!aRange.negate)
+                    intervals.emplace_back(aRange.low, std::min<char32_t>(aRange.high, 0x10FFFFu));
+                else
+                {
+                    if (aRange.low > 0u)
+                        intervals.emplace_back(0u, aRange.low - 1u);
+                    if (aRange.high < 0x10FFFFu)
+                        intervals.emplace_back(aRange.high + 1u, 0x10FFFFu);
+                }
+                for (char32_t excluded = 0u; excluded < 256u; ++excluded)
+                {
+                    if (!aRange.exclusions.test(excluded))
+                        continue;
+                    for (std::size_t i = 0u; i < intervals.size(); ++i)
+                    {
+                        auto const [low, high] = intervals[i];
+                        if (excluded < low || excluded > high)
+                            continue;
+                        intervals.erase(std::next(intervals.begin(), i));
+                        if (excluded < high)
+                            intervals.emplace(std::next(intervals.begin(), i), excluded + 1u, high);
+                        if (excluded > low)
+                            intervals.emplace(std::next(intervals.begin(), i), low, excluded - 1u);
+                        break;
+                    }
+                }
+                for (auto const& interval : intervals)
+                    utf8_sequences(interval.first, interval.second, [&](std::array<std::uint8_t, 4u> const& aLow, std::array<std::uint8_t, 4u> const& aHigh, std::size_t aLength)
+                    {
+                        auto current = aFragment.start;
+                        for (std::size_t i = 0u; i < aLength; ++i)
+                        {
+                            auto const next = (i + 1u == aLength ? aFragment.end : iNfa.add_state());
+                            iNfa.add_edge(current, aLow[i], aHigh[i], next);
+                            current = next;
+                        }
+                    });
+            }
+            bool accepts(nfa::fragment const& aFragment, std::string_view const& aText) const
+            {
+                std::vector<std::uint32_t> current{ aFragment.start };
+                iNfa.closure(current);
+                for (auto ch : aText)
+                {
+                    current = iNfa.step(current, static_cast<std::uint8_t>(ch), static_cast<std::uint8_t>(ch));
+                    if (current.empty())
+                        return false;
+                }
+                for (;;)
+                {
+                    if (std::binary_search(current.begin(), current.end(), aFragment.end))
+                        return true;
+                    auto next = iNfa.step(current, EndOfInput, EndOfInput);
+                    next.insert(next.end(), current.begin(), current.end());
+                    iNfa.closure(next);
+                    if (next == current)
+                        return false;
+                    current.swap(next);
+                }
+            }
+        private:
+            code_parser::grammar const& iGrammar;
+            nfa& iNfa;
+            std::vector<bool> iExpanding;
+        };
+    }
+
+    std::shared_ptr<dfa> dfa::compile(code_parser::grammar const& aGrammar)
+    {
+        return compile(aGrammar, aGrammar.stageSymbols);
+    }
+
+    std::shared_ptr<dfa> dfa::compile(code_parser::grammar const& aGrammar, std::span<code_parser::symbol const> aSymbols)
+    {
+        if (aSymbols.empty())
+            return {};
+
+        // each symbol gets its own accepting NFA state so that a DFA state knows which symbols
+        // match the text consumed so far
+        nfa automaton;
+        std::uint32_t nfaStart = 0u;
+        std::vector<std::uint32_t> nfaAccepts;
+        try
+        {
+            nfa_builder builder{ aGrammar, automaton };
+            nfaStart = automaton.add_state();
+            for (auto s : aSymbols)
+            {
+                auto const f = builder.build_symbol(s);
+                automaton.add_epsilon(nfaStart, f.start);
+                nfaAccepts.push_back(automaton.add_state());
+                automaton.add_epsilon(f.end, nfaAccepts.back());
+            }
+        }
+        catch (not_regular const&)
+        {
+            return {};
+        }
+
+        auto result = std::make_shared<dfa>();
+
+        std::bitset<257u> boundaries;
+        for (auto const& s : automaton.states)
+            for (auto const& e : s.edges)
+                if (e.low != EndOfInput)
+                {
+                    boundaries.set(e.low);
+                    boundaries.set(e.high + 1u);
+                }
+        std::vector<std::uint8_t> representatives;
+        for (std::uint32_t byte = 0u; byte < 256u; ++byte)
+        {
+            if (byte == 0u || boundaries.test(byte))
+                representatives.push_back(static_cast<std::uint8_t>(byte));
+            result->iByteClass[byte] = static_cast<std::uint8_t>(representatives.size() - 1u);
+        }
+        result->iClassCount = static_cast<std::uint32_t>(representatives.size());
+        auto const stride = result->iClassCount + 1u;
+
+        std::map<std::vector<std::uint32_t>, state_index> stateIds;
+        std::vector<std::vector<std::uint32_t>> stateSets;
+        stateSets.emplace_back();
+        stateIds.emplace(stateSets.back(), DeadState);
+        std::vector<std::uint32_t> startSet{ nfaStart };
+        automaton.closure(startSet);
+        stateSets.push_back(startSet);
+        stateIds.emplace(startSet, static_cast<state_index>(1u));
+        result->iStart = 1u;
+
+        for (std::size_t stateIndex = 0u; stateIndex < stateSets.size(); ++stateIndex)
+        {
+            result->iTransitions.resize((stateIndex + 1u) * stride, DeadState);
+            if (stateIndex == DeadState)
+                continue;
+            auto const current = stateSets[stateIndex];
+            for (std::uint32_t c = 0u; c < stride; ++c)
+            {
+                auto const next = (c == result->iClassCount ?
+                    automaton.step(current, EndOfInput, EndOfInput) : automaton.step(current, representatives[c], representatives[c]));
+                auto existing = stateIds.find(next);
+                if (existing == stateIds.end())
+                {
+                    if (stateSets.size() >= StateLimit)
+                        return {};
+                    existing = stateIds.emplace(next, static_cast<state_index>(stateSets.size())).first;
+                    stateSets.push_back(next);
+                }
+                result->iTransitions[stateIndex * stride + c] = existing->second;
+            }
+        }
+
+        auto const stateCount = stateSets.size();
+        result->iAccepting.resize(stateCount, false);
+        result->iAcceptedSymbols.resize(stateCount);
+        for (std::size_t s = 0u; s < stateCount; ++s)
+        {
+            for (std::size_t a = 0u; a < nfaAccepts.size(); ++a)
+                if (std::binary_search(stateSets[s].begin(), stateSets[s].end(), nfaAccepts[a]))
+                    result->iAcceptedSymbols[s].push_back(aSymbols[a]);
+            result->iAccepting[s] = !result->iAcceptedSymbols[s].empty();
+        }
+        // the accepting state (if any) reached from each state by end of input transitions alone
+        result->iEndStates.resize(stateCount, DeadState);
+        for (std::size_t s = 0u; s < stateCount; ++s)
+            if (result->iAccepting[s])
+                result->iEndStates[s] = static_cast<state_index>(s);
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (std::size_t s = 0u; s < stateCount; ++s)
+            {
+                auto const next = result->iEndStates[result->iTransitions[s * stride + result->iClassCount]];
+                if (result->iEndStates[s] == DeadState && next != DeadState)
+                {
+                    result->iEndStates[s] = next;
+                    changed = true;
+                }
+            }
+        }
+
+        result->iRuns.resize(stateCount);
+        for (std::size_t s = 1u; s < stateCount; ++s)
+        {
+            std::bitset<256> loops;
+            for (std::uint32_t byte = 0u; byte < 256u; ++byte)
+                loops.set(byte, result->iTransitions[s * stride + result->iByteClass[byte]] == s);
+            auto& r = result->iRuns[s];
+            r.assign(loops);
+            if (r.rangeCount == 0u)
+                r = byte_class{};
+        }
+
+        return result;
+    }
+
+    bool dfa::tokenize(std::string_view const& aSource) const
+    {
+        std::uint32_t position = 0u;
+        while (position < aSource.size())
+        {
+            auto const end = match(aSource, position);
+            if (end == npos || end == position)
+                return false;
+            position = end;
+        }
+        return true;
+    }
+
+    bool dfa::tokenize(std::string_view const& aSource, token_stream& aTokens) const
+    {
+        aTokens.clear();
+        std::uint32_t position = 0u;
+        while (position < aSource.size())
+        {
+            state_index acceptState = DeadState;
+            auto const end = match(aSource, position, acceptState);
+            if (end == npos || end == position)
+                return false;
+            auto const symbols = accepted_symbols(acceptState);
+            aTokens.push_back(token{ symbols.front(), aSource.substr(position, end - position), symbols });
+            position = end;
+        }
+        return true;
+    }
+
+    std::uint32_t dfa::match(std::string_view const& aSource, std::uint32_t aPosition) const
+    {
+        state_index acceptState = DeadState;
+        return match(aSource, aPosition, acceptState);
+    }
+
+    std::uint32_t dfa::match(std::string_view const& aSource, std::uint32_t aPosition, state_index& aAcceptState) const
+    {
+        auto const stride = iClassCount + 1u;
+        auto state = iStart;
+        std::uint32_t longest = npos;
+        aAcceptState = DeadState;
+        if (iAccepting[state])
+        {
+            longest = aPosition;
+            aAcceptState = state;
+        }
+        std::size_t position = aPosition;
+        while (position < aSource.size())
+        {
+            if (iRuns[state].any())
+            {
+                auto const runEnd = iRuns[state].scan(aSource, position);
+                if (runEnd != position)
+                {
+                    position = runEnd;
+                    if (iAccepting[state])
+                    {
+                        longest = static_cast<std::uint32_t>(position);
+                        aAcceptState = state;
+                    }
+                    continue;
+                }
+            }
+            state = iTransitions[state * stride + iByteClass[static_cast<std::uint8_t>(aSource[position])]];
+            if (state == DeadState)
+                break;
+            ++position;
+            if (iAccepting[state])
+            {
+                longest = static_cast<std::uint32_t>(position);
+                aAcceptState = state;
+            }
+        }
+        if (position == aSource.size() && state != DeadState && iEndStates[state] != DeadState)
+        {
+            longest = static_cast<std::uint32_t>(position);
+            aAcceptState = iEndStates[state];
+        }
+        return longest;
+    }
+
+    std::span<code_parser::symbol const> dfa::accepted_symbols(state_index aState) const
+    {
+        return iAcceptedSymbols[aState];
+    }
+
+    std::size_t dfa::state_count() const
+    {
+        return iAccepting.size();
+    }
+
+    std::size_t dfa::class_count() const
+    {
+        return iClassCount;
+    }
+}
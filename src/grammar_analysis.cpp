@@ -0,0 +1,641 @@
+/*
+  grammar_analysis.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <span>
+#include <neos/language/grammar_analysis.hpp>
+
+namespace neos::language::code_parser
+{
+    namespace
+    {
+        using symbol_graph = std::vector<std::vector<std::uint32_t>>;
+
+        // Strongly connected components of a symbol graph (Tarjan); a symbol is cyclic if it can
+        // reach itself.
+        class components
+        {
+        public:
+            components(symbol_graph const& aGraph) :
+                iGraph{ aGraph }, iComponent(aGraph.size(), npos), iCyclic(aGraph.size(), false),
+                iIndex(aGraph.size(), npos), iLowLink(aGraph.size(), npos), iOnStack(aGraph.size(), false)
+            {
+                for (std::uint32_t node = 0u; node < aGraph.size(); ++node)
+                    if (iIndex[node] == npos)
+                        connect(node);
+            }
+        public:
+            std::uint32_t component(std::uint32_t aNode) const
+            {
+                return iComponent[aNode];
+            }
+            bool cyclic(std::uint32_t aNode) const
+            {
+                return iCyclic[aNode];
+            }
+        private:
+            void connect(std::uint32_t aNode)
+            {
+                iIndex[aNode] = iLowLink[aNode] = iNextIndex++;
+                iStack.push_back(aNode);
+                iOnStack[aNode] = true;
+                for (auto next : iGraph[aNode])
+                {
+                    if (iIndex[next] == npos)
+                    {
+                        connect(next);
+                        iLowLink[aNode] = std::min(iLowLink[aNode], iLowLink[next]);
+                    }
+                    else if (iOnStack[next])
+                        iLowLink[aNode] = std::min(iLowLink[aNode], iIndex[next]);
+                }
+                if (iLowLink[aNode] != iIndex[aNode])
+                    return;
+                auto const first = std::find(iStack.begin(), iStack.end(), aNode);
+                bool const cyclic = std::next(first) != iStack.end() ||
+                    std::find(iGraph[aNode].begin(), iGraph[aNode].end(), aNode) != iGraph[aNode].end();
+                for (auto member = first; member != iStack.end(); ++member)
+                {
+                    iComponent[*member] = iNextComponent;
+                    iCyclic[*member] = cyclic;
+                    iOnStack[*member] = false;
+                }
+                iStack.erase(first, iStack.end());
+                ++iNextComponent;
+            }
+        private:
+            symbol_graph const& iGraph;
+            std::vector<std::uint32_t> iComponent;
+            std::vector<bool> iCyclic;
+            std::vector<std::uint32_t> iIndex;
+            std::vector<std::uint32_t> iLowLink;
+            std::vector<bool> iOnStack;
+            std::vector<std::uint32_t> iStack;
+            std::uint32_t iNextIndex = 0u;
+            std::uint32_t iNextComponent = 0u;
+        };
+
+        class analyzer
+        {
+        public:
+            analyzer(grammar const& aGrammar, std::optional<code_parser::symbol> const& aRoot, bool aPackrat) :
+                iGrammar{ aGrammar }, iRoot{ aRoot }, iPackrat{ aPackrat },
+                iReferences(aGrammar.rulesBySymbol.size()), iLeftEdges(aGrammar.rulesBySymbol.size()),
+                iRecursion{ build(iReferences, false) }, iLeftRecursion{ build(iLeftEdges, true) },
+                iActive(aGrammar.rules.size(), false), iExponential(aGrammar.rules.size(), false)
+            {
+                for (auto const& symbolRules : aGrammar.rulesBySymbol)
+                    for (auto r : symbolRules)
+                        iActive[r] = true;
+            }
+        public:
+            grammar_analysis run()
+            {
+                find_left_recursion();
+                find_unreachable();
+                find_shadowed();
+                find_overlapping_repetition();
+                find_exponential();
+                estimate_costs();
+                return std::move(iResult);
+            }
+        private:
+            symbol_graph const& build(symbol_graph& aGraph, bool aLeftEdge)
+            {
+                for (std::size_t s = 0u; s < aGraph.size(); ++s)
+                {
+                    for (auto r : iGrammar.rulesBySymbol[s])
+                    {
+                        if (aLeftEdge)
+                            left_edge(iGrammar.rules[r].rhs, aGraph[s]);
+                        else
+                            for (auto element : iGrammar.rules[r].rhs)
+                                references(element, aGraph[s]);
+                    }
+                    std::sort(aGraph[s].begin(), aGraph[s].end());
+                    aGraph[s].erase(std::unique(aGraph[s].begin(), aGraph[s].end()), aGraph[s].end());
+                }
+                return aGraph;
+            }
+            bool stage_rule(rule_index aRule) const
+            {
+                return aRule >= iGrammar.stageRules && iActive[aRule];
+            }
+            std::uint32_t lhs(rule_index aRule) const
+            {
+                return static_cast<std::uint32_t>(iGrammar.primitives[iGrammar.rules[aRule].lhs].symbol);
+            }
+            std::string rule_name(rule_index aRule) const
+            {
+                return "rule '" + iGrammar.rule_name(aRule) + "'";
+            }
+            std::string symbol_name(std::uint32_t aSymbol) const
+            {
+                return "'" + std::string{ iGrammar.symbol_name(static_cast<code_parser::symbol>(aSymbol)) } + "'";
+            }
+            bool nullable(primitive_index aPrimitive) const
+            {
+                return iGrammar.primitivePredictions[aPrimitive].nullable;
+            }
+            bool overlap(prediction const& aLeft, prediction const& aRight) const
+            {
+                return aLeft.nullable || aRight.nullable || (aLeft.first & aRight.first).any();
+            }
+            void add(finding_type aType, rule_index aRule, primitive_index aPrimitive, std::string const& aMessage)
+            {
+                iResult.findings.push_back(finding{ aType, aRule, aPrimitive, aMessage });
+            }
+        private:
+            // Symbols referenced anywhere within a primitive.
+            void references(primitive_index aPrimitive, std::vector<std::uint32_t>& aResult) const
+            {
+                std::vector<primitive_index> pending{ aPrimitive };
+                while (!pending.empty())
+                {
+                    auto const& p = iGrammar.primitives[pending.back()];
+                    pending.pop_back();
+                    if (p.type == primitive_type::Symbol)
+                        aResult.push_back(static_cast<std::uint32_t>(p.symbol));
+                    else if (p.type != primitive_type::Range)
+                        pending.insert(pending.end(), p.children.begin(), p.children.end());
+                }
+            }
+            bool references(primitive_index aPrimitive, std::uint32_t aComponent) const
+            {
+                std::vector<std::uint32_t> symbols;
+                references(aPrimitive, symbols);
+                return std::any_of(symbols.begin(), symbols.end(), [&](std::uint32_t aSymbol) { return iRecursion.component(aSymbol) == aComponent; });
+            }
+            // Symbols that can be matched at the position a primitive or sequence starts at.
+            void left_edge(primitive_index aPrimitive, std::vector<std::uint32_t>& aResult) const
+            {
+                auto const& p = iGrammar.primitives[aPrimitive];
+                switch (p.type)
+                {
+                case primitive_type::Symbol:
+                    aResult.push_back(static_cast<std::uint32_t>(p.symbol));
+                    break;
+                case primitive_type::Concatenation:
+                case primitive_type::Repetition:
+                case primitive_type::Optional:
+                    left_edge(p.children, aResult);
+                    break;
+                case primitive_type::Alternation:
+                    for (auto child : p.children)
+                        left_edge(child, aResult);
+                    break;
+                case primitive_type::Operators:
+                    if (!p.children.empty())
+                        left_edge(p.children[0], aResult);
+                    break;
+                default:
+                    break;
+                }
+            }
+            void left_edge(std::span<primitive_index const> aSequence, std::vector<std::uint32_t>& aResult) const
+            {
+                for (auto element : aSequence)
+                {
+                    left_edge(element, aResult);
+                    if (!nullable(element))
+                        break;
+                }
+            }
+            // Calls aVisitor with each primitive of a rule and whether it is within a repetition.
+            void visit(rule_index aRule, std::function<void(primitive_index, bool)> const& aVisitor) const
+            {
+                std::vector<std::pair<primitive_index, bool>> pending;
+                for (auto element : iGrammar.rules[aRule].rhs)
+                    pending.emplace_back(element, false);
+                while (!pending.empty())
+                {
+                    auto const [next, repeated] = pending.back();
+                    pending.pop_back();
+                    aVisitor(next, repeated);
+                    auto const& p = iGrammar.primitives[next];
+                    if (p.type != primitive_type::Range)
+                        for (auto child : p.children)
+                            pending.emplace_back(child, repeated || p.type == primitive_type::Repetition);
+                }
+            }
+            bool same(primitive_index aLeft, primitive_index aRight) const
+            {
+                if (aLeft == aRight)
+                    return true;
+                auto const& left = iGrammar.primitives[aLeft];
+                auto const& right = iGrammar.primitives[aRight];
+                if (left.type != right.type || left.symbol != right.symbol || left.text != right.text || left.negate != right.negate ||
+                    left.exclusions != right.exclusions || left.matchFirst != right.matchFirst || left.atLeastOne != right.atLeastOne ||
+                    left.constraint != right.constraint || left.precedence != right.precedence || left.rightAssociative != right.rightAssociative)
+                    return false;
+                return same(left.children, right.children);
+            }
+            bool same(std::vector<primitive_index> const& aLeft, std::vector<primitive_index> const& aRight) const
+            {
+                return std::equal(aLeft.begin(), aLeft.end(), aRight.begin(), aRight.end(),
+                    [&](primitive_index aLeftElement, primitive_index aRightElement) { return same(aLeftElement, aRightElement); });
+            }
+            // A primitive that matches exactly one character of a set.
+            bool character_class(primitive_index aPrimitive) const
+            {
+                auto const& p = iGrammar.primitives[aPrimitive];
+                switch (p.type)
+                {
+                case primitive_type::Range:
+                    return true;
+                case primitive_type::Terminal:
+                    return p.text.size() == 1u;
+                case primitive_type::Alternation:
+                    return !p.children.empty() && std::all_of(p.children.begin(), p.children.end(), [&](primitive_index aChild) { return character_class(aChild); });
+                default:
+                    return false;
+                }
+            }
+        private:
+            // The engine fails a symbol that it reaches again at the same position so the
+            // recursive alternative of a left recursive rule never matches.
+            void find_left_recursion()
+            {
+                for (rule_index r = 0u; r < iGrammar.rules.size(); ++r)
+                {
+                    if (!stage_rule(r) || !iLeftRecursion.cyclic(lhs(r)))
+                        continue;
+                    std::vector<std::uint32_t> edge;
+                    left_edge(iGrammar.rules[r].rhs, edge);
+                    for (auto s : edge)
+                        if (iLeftRecursion.component(s) == iLeftRecursion.component(lhs(r)))
+                        {
+                            add(finding_type::LeftRecursion, r, npos, rule_name(r) + " is left recursive" +
+                                (s != lhs(r) ? " through " + symbol_name(s) : std::string{}) + " so its recursive alternative can never match");
+                            break;
+                        }
+                }
+            }
+            void find_unreachable()
+            {
+                if (!iRoot)
+                    return;
+                std::vector<bool> reached(iReferences.size(), false);
+                std::vector<std::uint32_t> pending{ static_cast<std::uint32_t>(*iRoot) };
+                for (std::uint32_t s = 0u; s < iGrammar.discard.size(); ++s)
+                    if (iGrammar.discard[s])
+                        pending.push_back(s);
+                while (!pending.empty())
+                {
+                    auto const next = pending.back();
+                    pending.pop_back();
+                    if (reached[next])
+                        continue;
+                    reached[next] = true;
+                    pending.insert(pending.end(), iReferences[next].begin(), iReferences[next].end());
+                }
+                for (rule_index r = 0u; r < iGrammar.rules.size(); ++r)
+                    if (stage_rule(r) && !reached[lhs(r)])
+                        add(finding_type::UnreachableRule, r, npos, rule_name(r) + " is unreachable from " + symbol_name(static_cast<std::uint32_t>(*iRoot)));
+            }
+            // Of a symbol's rules (or an alternation's alternatives) matching the same length the
+            // first is taken, so a repeated one is never chosen; an alternation that takes its
+            // first match never gets past an alternative that always matches or that matches a
+            // prefix of a later one.
+            void find_shadowed()
+            {
+                for (auto const& symbolRules : iGrammar.rulesBySymbol)
+                    for (std::size_t later = 1u; later < symbolRules.size(); ++later)
+                    {
+                        if (!stage_rule(symbolRules[later]))
+                            continue;
+                        for (std::size_t earlier = 0u; earlier < later; ++earlier)
+                            if (same(iGrammar.rules[symbolRules[earlier]].rhs, iGrammar.rules[symbolRules[later]].rhs))
+                            {
+                                add(finding_type::ShadowedAlternative, symbolRules[later], npos, rule_name(symbolRules[later]) +
+                                    " matches the same input as " + rule_name(symbolRules[earlier]) + " so is never chosen");
+                                break;
+                            }
+                    }
+                for (rule_index r = 0u; r < iGrammar.rules.size(); ++r)
+                {
+                    if (!stage_rule(r))
+                        continue;
+                    visit(r, [&](primitive_index aPrimitive, bool)
+                    {
+                        auto const& p = iGrammar.primitives[aPrimitive];
+                        if (p.type != primitive_type::Alternation)
+                            return;
+                        for (std::size_t later = 1u; later < p.children.size(); ++later)
+                            for (std::size_t earlier = 0u; earlier < later; ++earlier)
+                            {
+                                auto const& first = iGrammar.primitives[p.children[earlier]];
+                                auto const& second = iGrammar.primitives[p.children[later]];
+                                bool const shadowed = same(p.children[earlier], p.children[later]) ||
+                                    (p.matchFirst && (nullable(p.children[earlier]) || (first.type == primitive_type::Terminal &&
+                                        second.type == primitive_type::Terminal && !first.constraint && second.text.starts_with(first.text))));
+                                if (!shadowed)
+                                    continue;
+                                add(finding_type::ShadowedAlternative, r, p.children[later], "alternative " + std::to_string(later + 1u) +
+                                    " of an alternation in " + rule_name(r) + " is shadowed by alternative " + std::to_string(earlier + 1u));
+                                break;
+                            }
+                    });
+                }
+            }
+            // A repetition that can match nothing stops at once (and one repeating a repetition is
+            // redundant); a repetition of single characters takes every character that could
+            // start the element after it.
+            void find_overlapping_repetition()
+            {
+                for (rule_index r = 0u; r < iGrammar.rules.size(); ++r)
+                {
+                    if (!stage_rule(r))
+                        continue;
+                    auto const check_sequence = [&](std::vector<primitive_index> const& aSequence)
+                    {
+                        for (std::size_t index = 0u; index + 1u < aSequence.size(); ++index)
+                        {
+                            auto const& p = iGrammar.primitives[aSequence[index]];
+                            auto const next = aSequence[index + 1u];
+                            if (p.type != primitive_type::Repetition || p.children.size() != 1u || !character_class(p.children[0]) || nullable(next))
+                                continue;
+                            if ((iGrammar.primitivePredictions[p.children[0]].first & iGrammar.primitivePredictions[next].first).any())
+                                add(finding_type::OverlappingRepetition, r, aSequence[index], "a repetition in " + rule_name(r) +
+                                    " consumes characters that the element following it needs to start with");
+                        }
+                    };
+                    check_sequence(iGrammar.rules[r].rhs);
+                    visit(r, [&](primitive_index aPrimitive, bool)
+                    {
+                        auto const& p = iGrammar.primitives[aPrimitive];
+                        if (p.type == primitive_type::Concatenation || p.type == primitive_type::Optional)
+                            check_sequence(p.children);
+                        if (p.type != primitive_type::Repetition)
+                            return;
+                        check_sequence(p.children);
+                        if (std::all_of(p.children.begin(), p.children.end(), [&](primitive_index aChild) { return nullable(aChild); }))
+                            add(finding_type::OverlappingRepetition, r, aPrimitive, "a repetition in " + rule_name(r) + " repeats something that can match empty input");
+                        else if (p.children.size() == 1u && iGrammar.primitives[p.children[0]].type == primitive_type::Repetition)
+                            add(finding_type::OverlappingRepetition, r, aPrimitive, "a repetition in " + rule_name(r) + " directly repeats another repetition");
+                    });
+                }
+            }
+            // Every alternative that can start at a position is tried, so two that can start alike
+            // and both recurse make each level of nesting repeat the work below it for each of
+            // them. Packrat memoization matches a symbol once per position so cannot do this.
+            void find_exponential()
+            {
+                if (iPackrat)
+                    return;
+                for (std::uint32_t s = 0u; s < iGrammar.rulesBySymbol.size(); ++s)
+                {
+                    if (!iRecursion.cyclic(s))
+                        continue;
+                    auto const component = iRecursion.component(s);
+                    auto const& symbolRules = iGrammar.rulesBySymbol[s];
+                    std::vector<rule_index> recursive;
+                    for (auto r : symbolRules)
+                        if (std::any_of(iGrammar.rules[r].rhs.begin(), iGrammar.rules[r].rhs.end(), [&](primitive_index aElement) { return references(aElement, component); }))
+                            recursive.push_back(r);
+                    for (std::size_t later = 1u; later < recursive.size(); ++later)
+                    {
+                        if (!stage_rule(recursive[later]))
+                            continue;
+                        auto const earlier = std::find_if(recursive.begin(), recursive.begin() + later, [&](rule_index aEarlier)
+                        {
+                            return overlap(iGrammar.rulePredictions[aEarlier], iGrammar.rulePredictions[recursive[later]]);
+                        });
+                        if (earlier == recursive.begin() + later)
+                            continue;
+                        iExponential[*earlier] = iExponential[recursive[later]] = true;
+                        add(finding_type::ExponentialBacktracking, recursive[later], npos, rule_name(recursive[later]) + " and " + rule_name(*earlier) +
+                            " can start alike and both recurse so matching them can take exponential time (factor out the common prefix or enable parser.packrat)");
+                    }
+                    for (auto r : symbolRules)
+                    {
+                        if (!stage_rule(r))
+                            continue;
+                        visit(r, [&](primitive_index aPrimitive, bool)
+                        {
+                            auto const& p = iGrammar.primitives[aPrimitive];
+                            if (p.type != primitive_type::Alternation)
+                                return;
+                            std::vector<primitive_index> alternatives;
+                            for (auto child : p.children)
+                                if (references(child, component))
+                                    alternatives.push_back(child);
+                            for (std::size_t later = 1u; later < alternatives.size(); ++later)
+                                for (std::size_t earlier = 0u; earlier < later; ++earlier)
+                                    if (overlap(iGrammar.primitivePredictions[alternatives[earlier]], iGrammar.primitivePredictions[alternatives[later]]))
+                                    {
+                                        iExponential[r] = true;
+                                        add(finding_type::ExponentialBacktracking, r, aPrimitive, "an alternation in " + rule_name(r) +
+                                            " has alternatives that can start alike and both recurse so matching it can take exponential time");
+                                        return;
+                                    }
+                        });
+                    }
+                }
+            }
+            // A rule costs at least as much as the symbols it references; on its own it is linear
+            // if it can match unbounded input and polynomial if, within a repetition, it tries
+            // alternatives that can start alike and match unbounded input.
+            void estimate_costs()
+            {
+                std::vector<bool> unbounded(iReferences.size(), false);
+                for (std::uint32_t s = 0u; s < unbounded.size(); ++s)
+                    unbounded[s] = iRecursion.cyclic(s);
+                auto const unbounded_primitive = [&](primitive_index aPrimitive)
+                {
+                    std::vector<primitive_index> pending{ aPrimitive };
+                    while (!pending.empty())
+                    {
+                        auto const& p = iGrammar.primitives[pending.back()];
+                        pending.pop_back();
+                        if (p.type == primitive_type::Repetition || p.type == primitive_type::Operators ||
+                            (p.type == primitive_type::Symbol && unbounded[static_cast<std::size_t>(p.symbol)]))
+                            return true;
+                        if (p.type != primitive_type::Range)
+                            pending.insert(pending.end(), p.children.begin(), p.children.end());
+                    }
+                    return false;
+                };
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (std::uint32_t s = 0u; s < unbounded.size(); ++s)
+                    {
+                        if (unbounded[s])
+                            continue;
+                        for (auto r : iGrammar.rulesBySymbol[s])
+                            if (std::any_of(iGrammar.rules[r].rhs.begin(), iGrammar.rules[r].rhs.end(), unbounded_primitive))
+                            {
+                                changed = unbounded[s] = true;
+                                break;
+                            }
+                    }
+                }
+
+                auto& costs = iResult.ruleCosts;
+                costs.assign(iGrammar.rules.size(), cost_class::Bounded);
+                for (rule_index r = 0u; r < iGrammar.rules.size(); ++r)
+                {
+                    if (!iActive[r])
+                        continue;
+                    if (iExponential[r])
+                    {
+                        costs[r] = cost_class::Exponential;
+                        continue;
+                    }
+                    if (std::any_of(iGrammar.rules[r].rhs.begin(), iGrammar.rules[r].rhs.end(), unbounded_primitive))
+                        costs[r] = cost_class::Linear;
+                    visit(r, [&](primitive_index aPrimitive, bool aRepeated)
+                    {
+                        auto const& p = iGrammar.primitives[aPrimitive];
+                        if (!aRepeated || p.type != primitive_type::Alternation)
+                            return;
+                        for (std::size_t later = 1u; later < p.children.size(); ++later)
+                            for (std::size_t earlier = 0u; earlier < later; ++earlier)
+                                if (overlap(iGrammar.primitivePredictions[p.children[earlier]], iGrammar.primitivePredictions[p.children[later]]) &&
+                                    (unbounded_primitive(p.children[earlier]) || unbounded_primitive(p.children[later])))
+                                    costs[r] = std::max(costs[r], cost_class::Polynomial);
+                    });
+                }
+                std::vector<cost_class> symbolCosts(iReferences.size(), cost_class::Bounded);
+                for (bool changed = true; changed;)
+                {
+                    changed = false;
+                    for (std::uint32_t s = 0u; s < symbolCosts.size(); ++s)
+                        for (auto r : iGrammar.rulesBySymbol[s])
+                        {
+                            std::vector<std::uint32_t> referenced;
+                            for (auto element : iGrammar.rules[r].rhs)
+                                references(element, referenced);
+                            for (auto t : referenced)
+                                costs[r] = std::max(costs[r], symbolCosts[t]);
+                            if (costs[r] > symbolCosts[s])
+                            {
+                                symbolCosts[s] = costs[r];
+                                changed = true;
+                            }
+                        }
+                }
+            }
+        private:
+            grammar const& iGrammar;
+            std::optional<code_parser::symbol> iRoot;
+            bool iPackrat;
+            symbol_graph iReferences;
+            symbol_graph iLeftEdges;
+            components iRecursion;
+            components iLeftRecursion;
+            std::vector<bool> iActive;
+            std::vector<bool> iExponential;
+            grammar_analysis iResult;
+        };
+    }
+
+    std::string_view to_string(cost_class aCost)
+    {
+        switch (aCost)
+        {
+        case cost_class::Bounded:
+            return "bounded";
+        case cost_class::Linear:
+            return "linear";
+        case cost_class::Polynomial:
+            return "polynomial";
+        case cost_class::Exponential:
+        default:
+            return "exponential";
+        }
+    }
+
+    std::string_view to_string(finding_type aType)
+    {
+        switch (aType)
+        {
+        case finding_type::ExponentialBacktracking:
+            return "exponential backtracking";
+        case finding_type::LeftRecursion:
+            return "left recursion";
+        case finding_type::UnreachableRule:
+            return "unreachable rule";
+        case finding_type::ShadowedAlternative:
+            return "shadowed alternative";
+        case finding_type::OverlappingRepetition:
+        default:
+            return "overlapping repetition";
+        }
+    }
+
+    grammar_analysis analyze(grammar const& aGrammar, std::optional<code_parser::symbol> const& aRoot, bool aPackrat)
+    {
+        return analyzer{ aGrammar, aRoot, aPackrat }.run();
+    }
+
+    namespace
+    {
+        // The stage's own rules, costliest first.
+        std::vector<rule_index> costliest(grammar const& aGrammar, grammar_analysis const& aAnalysis)
+        {
+            std::vector<rule_index> result;
+            for (auto const& symbolRules : aGrammar.rulesBySymbol)
+                for (auto r : symbolRules)
+                    if (r >= aGrammar.stageRules && r < aAnalysis.ruleCosts.size())
+                        result.push_back(r);
+            std::sort(result.begin(), result.end(), [&](rule_index lhs, rule_index rhs)
+            {
+                return aAnalysis.ruleCosts[lhs] != aAnalysis.ruleCosts[rhs] ? aAnalysis.ruleCosts[lhs] > aAnalysis.ruleCosts[rhs] : lhs < rhs;
+            });
+            return result;
+        }
+    }
+
+    void write_analysis_report(std::ostream& aStream, grammar const& aGrammar, grammar_analysis const& aAnalysis)
+    {
+        aStream << "Findings:\n";
+        if (aAnalysis.findings.empty())
+            aStream << "  none\n";
+        for (auto const& f : aAnalysis.findings)
+            aStream << "  " << to_string(f.type) << ": " << f.message << "\n";
+        aStream << "Rule costs:\n";
+        for (auto r : costliest(aGrammar, aAnalysis))
+            aStream << "  " << std::left << std::setw(13) << to_string(aAnalysis.ruleCosts[r]) << std::right << aGrammar.rule_name(r) << "\n";
+    }
+
+    void write_analysis_json(std::ostream& aStream, grammar const& aGrammar, grammar_analysis const& aAnalysis)
+    {
+        aStream << "{ \"findings\": [";
+        for (auto const& f : aAnalysis.findings)
+        {
+            aStream << (&f == &aAnalysis.findings.front() ? "\n" : ",\n") << "    { \"type\": " << json_string(to_string(f.type)) <<
+                ", \"rule\": " << json_string(aGrammar.rule_name(f.rule)) << ", \"message\": " << json_string(f.message) << " }";
+        }
+        aStream << " ],\n  \"rules\": [";
+        bool first = true;
+        for (auto r : costliest(aGrammar, aAnalysis))
+        {
+            aStream << (first ? "\n" : ",\n") << "    { \"rule\": " << json_string(aGrammar.rule_name(r)) <<
+                ", \"cost\": " << json_string(to_string(aAnalysis.ruleCosts[r])) << " }";
+            first = false;
+        }
+        aStream << " ] }";
+    }
+}
@@ -0,0 +1,149 @@
+/*
+  incremental_parser.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <neos/language/incremental_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    incremental_parser::incremental_parser(code_parser::grammar const& aGrammar, code_parser::symbol aRoot, split_hint const& aHint,
+        std::vector<std::shared_ptr<code_parser::dfa>> const& aTokenizers, bool aPackrat) :
+        iGrammar{ aGrammar }, iRoot{ aRoot }, iHint{ aHint }, iTokenizers{ aTokenizers }, iPackrat{ aPackrat }
+    {
+        // the finer the pieces the less an edit reparses
+        iHint.pieceSize = 1u;
+    }
+
+    bool incremental_parser::parse(std::string_view const& aSource)
+    {
+        iSource = aSource;
+        iPieces.clear();
+        bool ok = true;
+        for (auto const& text : split_source(iSource, iHint))
+        {
+            auto& p = iPieces.emplace_back(piece{ static_cast<std::size_t>(text.data() - iSource.data()), text.size() });
+            ok = parse_piece(p) && ok;
+        }
+        iDamage = damage{ 0u, 0u, iPieces.size(), iPieces.size() };
+        return ok;
+    }
+
+    // The source is split again (a scan, not a parse) as an edit can move piece boundaries
+    // anywhere after it, by opening a comment say; a new piece is then the old piece at the same
+    // place if it lies wholly before the edit or at the same place less the edit's growth if it
+    // lies wholly after it. The damage is what lies between the pieces kept at the front and
+    // those kept at the back, a piece moved in between included.
+    bool incremental_parser::reparse(std::string_view const& aSource, source_edit const& aEdit)
+    {
+        if (aEdit.offset > iSource.size() || aEdit.removed > iSource.size() - aEdit.offset ||
+            aSource.size() != iSource.size() - aEdit.removed + aEdit.inserted)
+            throw bad_edit();
+        std::vector<piece> oldPieces;
+        oldPieces.swap(iPieces);
+        iSource = aSource;
+        auto const editEnd = aEdit.offset + aEdit.inserted;
+        auto existing = oldPieces.begin();
+        auto const find = [&](std::size_t aBegin, std::size_t aLength) -> piece*
+        {
+            while (existing != oldPieces.end() && existing->begin < aBegin)
+                ++existing;
+            if (existing != oldPieces.end() && existing->begin == aBegin && existing->length == aLength && existing->parser)
+                return &*existing;
+            return nullptr;
+        };
+        bool ok = true;
+        // the index of the previous piece each piece was moved from
+        std::vector<std::size_t> moved;
+        iDamage = damage{};
+        for (auto const& text : split_source(iSource, iHint))
+        {
+            auto& p = iPieces.emplace_back(piece{ static_cast<std::size_t>(text.data() - iSource.data()), text.size() });
+            piece* old = nullptr;
+            if (p.begin + p.length <= aEdit.offset)
+                old = find(p.begin, p.length);
+            else if (p.begin >= editEnd)
+                old = find(p.begin - aEdit.inserted + aEdit.removed, p.length);
+            if (old)
+            {
+                p.parser = std::move(old->parser);
+                p.parsed = old->parsed;
+                if (p.parsed)
+                    p.parser->rebase(text);
+                moved.push_back(static_cast<std::size_t>(old - oldPieces.data()));
+            }
+            else
+            {
+                ++iDamage.reparsed;
+                parse_piece(p);
+                moved.push_back(npos);
+            }
+            ok = p.parsed && ok;
+        }
+        auto& kept = iDamage.first;
+        while (kept < moved.size() && kept < oldPieces.size() && moved[kept] == kept)
+            ++kept;
+        std::size_t keptAfter = 0u;
+        while (kept + keptAfter < moved.size() && kept + keptAfter < oldPieces.size() &&
+            moved[moved.size() - keptAfter - 1u] == oldPieces.size() - keptAfter - 1u)
+            ++keptAfter;
+        iDamage.removed = oldPieces.size() - kept - keptAfter;
+        iDamage.inserted = iPieces.size() - kept - keptAfter;
+        return ok;
+    }
+
+    // The piece's root is passed on too for the caller to merge (see merged_ast_sink).
+    void incremental_parser::create_ast(i_ast_sink& aSink, std::size_t aPiece)
+    {
+        iPieces.at(aPiece).parser->create_ast(aSink);
+    }
+
+    incremental_parser::damage const& incremental_parser::last_damage() const
+    {
+        return iDamage;
+    }
+
+    std::size_t incremental_parser::piece_count() const
+    {
+        return iPieces.size();
+    }
+
+    std::size_t incremental_parser::piece_at(std::size_t aOffset) const
+    {
+        auto const after = std::upper_bound(iPieces.begin(), iPieces.end(), aOffset,
+            [](std::size_t aPosition, piece const& aPiece) { return aPosition < aPiece.begin; });
+        if (after == iPieces.begin())
+            throw std::out_of_range("neos::language::code_parser::incremental_parser::piece_at");
+        return static_cast<std::size_t>(std::distance(iPieces.begin(), after)) - 1u;
+    }
+
+    bool incremental_parser::parse_piece(piece& aPiece)
+    {
+        auto const text = iSource.substr(aPiece.begin, aPiece.length);
+        if (!aPiece.parser)
+            aPiece.parser = std::make_unique<engine>(iGrammar, iPackrat);
+        aPiece.parsed = true;
+        iTokens.clear();
+        for (auto const& tokenizer : iTokenizers)
+            if (!tokenizer->tokenize(text, iTokens))
+                aPiece.parsed = false;
+        aPiece.parsed = aPiece.parsed && aPiece.parser->parse(iRoot, text, iTokens);
+        return aPiece.parsed;
+    }
+}
@@ -0,0 +1,306 @@
+/*
+  parallel_parser.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <neos/language/parallel_parser.hpp>
+
+namespace neos::language::code_parser
+{
+    std::vector<std::string_view> split_source(std::string_view const& aSource, split_hint const& aHint)
+    {
+        std::vector<std::string_view> pieces;
+        std::size_t pieceBegin = 0u;
+        std::size_t depth = 0u;
+        auto const at = [&](std::size_t aPosition, std::string const& aText)
+        {
+            return !aText.empty() && aSource.substr(aPosition).starts_with(aText);
+        };
+        auto const cut = [&](std::size_t aPosition)
+        {
+            if (aPosition - pieceBegin < aHint.pieceSize || aPosition >= aSource.size())
+                return;
+            pieces.push_back(aSource.substr(pieceBegin, aPosition - pieceBegin));
+            pieceBegin = aPosition;
+        };
+        auto const line_comment = [&](std::size_t aPosition)
+        {
+            return std::any_of(aHint.lineComments.begin(), aHint.lineComments.end(),
+                [&](std::string const& aComment) { return at(aPosition, aComment); });
+        };
+        // most bytes can't start a comment, quote, scope or bracket and are passed over on a lookup
+        std::array<bool, 256u> significant = {};
+        auto const significant_text = [&](std::string const& aText)
+        {
+            if (!aText.empty())
+                significant[static_cast<unsigned char>(aText[0])] = true;
+        };
+        for (auto const& comment : aHint.lineComments)
+            significant_text(comment);
+        for (auto const& quote : aHint.quotes)
+            significant_text(quote);
+        for (auto const& terminator : aHint.terminators)
+            significant_text(terminator);
+        for (auto const* pairs : { &aHint.scopes, &aHint.brackets, &aHint.blockComments })
+            for (auto const& pair : *pairs)
+            {
+                significant_text(pair.first);
+                significant_text(pair.second);
+            }
+        std::size_t position = 0u;
+        while (position < aSource.size())
+        {
+            if (aHint.indentation && depth == 0u && (position == 0u || aSource[position - 1u] == '\n'))
+            {
+                auto const ch = aSource[position];
+                if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n' && !line_comment(position))
+                    cut(position);
+            }
+            if (!significant[static_cast<unsigned char>(aSource[position])])
+            {
+                ++position;
+                continue;
+            }
+            if (line_comment(position))
+            {
+                auto const end = aSource.find('\n', position);
+                position = (end == std::string_view::npos ? aSource.size() : end + 1u);
+                continue;
+            }
+            auto const blockComment = std::find_if(aHint.blockComments.begin(), aHint.blockComments.end(),
+                [&](auto const& aComment) { return at(position, aComment.first); });
+            if (blockComment != aHint.blockComments.end())
+            {
+                auto const end = aSource.find(blockComment->second, position + blockComment->first.size());
+                position = (end == std::string_view::npos ? aSource.size() : end + blockComment->second.size());
+                continue;
+            }
+            auto const quote = std::find_if(aHint.quotes.begin(), aHint.quotes.end(),
+                [&](std::string const& aQuote) { return at(position, aQuote); });
+            if (quote != aHint.quotes.end())
+            {
+                position += quote->size();
+                char const stops[] = { (*quote)[0], aHint.escape.empty() ? (*quote)[0] : aHint.escape[0], '\0' };
+                while ((position = aSource.find_first_of(stops, position)) != std::string_view::npos)
+                {
+                    if (at(position, aHint.escape))
+                        position += aHint.escape.size() + 1u;
+                    else if (at(position, *quote))
+                    {
+                        position += quote->size();
+                        break;
+                    }
+                    else
+                        ++position;
+                }
+                position = std::min(position, aSource.size());
+                continue;
+            }
+            auto const bracket = [&](std::vector<std::pair<std::string, std::string>> const& aPairs, bool aScope)
+            {
+                for (auto const& pair : aPairs)
+                {
+                    if (at(position, pair.first))
+                    {
+                        ++depth;
+                        position += pair.first.size();
+                        return true;
+                    }
+                    if (at(position, pair.second))
+                    {
+                        if (depth != 0u)
+                            --depth;
+                        position += pair.second.size();
+                        if (depth == 0u && aScope && !aHint.indentation)
+                            cut(position);
+                        return true;
+                    }
+                }
+                return false;
+            };
+            if (bracket(aHint.scopes, true) || bracket(aHint.brackets, false))
+                continue;
+            auto const terminator = std::find_if(aHint.terminators.begin(), aHint.terminators.end(),
+                [&](std::string const& aTerminator) { return at(position, aTerminator); });
+            if (terminator != aHint.terminators.end())
+            {
+                position += terminator->size();
+                if (depth == 0u && !aHint.indentation)
+                    cut(position);
+                continue;
+            }
+            ++position;
+        }
+        // only whitespace and comments after the last cut go with the piece before it as a root
+        // symbol can't be expected to match them on their own
+        bool blank = true;
+        for (position = pieceBegin; blank && position < aSource.size();)
+        {
+            auto const ch = aSource[position];
+            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+                ++position;
+            else if (line_comment(position))
+            {
+                auto const end = aSource.find('\n', position);
+                position = (end == std::string_view::npos ? aSource.size() : end + 1u);
+            }
+            else
+            {
+                auto const blockComment = std::find_if(aHint.blockComments.begin(), aHint.blockComments.end(),
+                    [&](auto const& aComment) { return at(position, aComment.first); });
+                if (blockComment == aHint.blockComments.end())
+                    blank = false;
+                else
+                {
+                    auto const end = aSource.find(blockComment->second, position + blockComment->first.size());
+                    position = (end == std::string_view::npos ? aSource.size() : end + blockComment->second.size());
+                }
+            }
+        }
+        if (blank && !pieces.empty())
+        {
+            auto const last = pieces.back();
+            pieces.back() = aSource.substr(static_cast<std::size_t>(last.data() - aSource.data()));
+        }
+        else
+            pieces.push_back(aSource.substr(pieceBegin));
+        return pieces;
+    }
+
+    merged_ast_sink::merged_ast_sink(i_ast_sink& aSink, std::string_view const& aSource) :
+        iSink{ aSink }, iSource{ aSource }
+    {
+    }
+
+    void merged_ast_sink::open_node(primitive_index aConcept, std::string_view const& aValue)
+    {
+        if (iDepth++ == 0u)
+        {
+            if (!iRootOpen)
+            {
+                iRootOpen = true;
+                iRoot = aConcept;
+                iSink.open_node(aConcept, iSource);
+            }
+            iMerged = (aConcept == iRoot);
+            if (iMerged)
+                return;
+        }
+        iSink.open_node(aConcept, aValue);
+    }
+
+    void merged_ast_sink::close_node(primitive_index aConcept, std::string_view const& aValue)
+    {
+        if (--iDepth == 0u && iMerged)
+            return;
+        iSink.close_node(aConcept, aValue);
+    }
+
+    void merged_ast_sink::finish()
+    {
+        if (iRootOpen)
+            iSink.close_node(iRoot, iSource);
+        iRootOpen = false;
+    }
+
+    parallel_parser::parallel_parser(code_parser::grammar const& aGrammar, bool aPackrat) :
+        iGrammar{ aGrammar }, iPackrat{ aPackrat }
+    {
+    }
+
+    // Workers take the next piece until there are none left or one has failed; the calling thread
+    // is one of them. An exception thrown parsing a piece is rethrown once all have stopped.
+    bool parallel_parser::parse(code_parser::symbol aRoot, std::string_view const& aSource, std::vector<std::string_view> const& aPieces, token_stream const& aTokens, std::size_t aThreads)
+    {
+        iSource = aSource;
+        iEngines.clear();
+        for (std::size_t piece = 0u; piece < aPieces.size(); ++piece)
+            iEngines.push_back(std::make_unique<engine>(iGrammar, iPackrat));
+        std::atomic<std::size_t> next = 0u;
+        std::atomic<bool> failed = false;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto const work = [&]()
+        {
+            try
+            {
+                for (auto piece = next++; piece < aPieces.size() && !failed; piece = next++)
+                    if (!iEngines[piece]->parse(aRoot, aPieces[piece], aTokens))
+                        failed = true;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock{ errorMutex };
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+            }
+        };
+        iThreads = (aThreads != 0u ? aThreads : std::max<std::size_t>(std::thread::hardware_concurrency(), 1u));
+        iThreads = std::max<std::size_t>(std::min(iThreads, aPieces.size()), 1u);
+        std::vector<std::thread> workers;
+        workers.reserve(iThreads - 1u);
+        for (std::size_t worker = 1u; worker < iThreads; ++worker)
+            workers.emplace_back(work);
+        work();
+        for (auto& worker : workers)
+            worker.join();
+        if (error)
+            std::rethrow_exception(error);
+        return !failed;
+    }
+
+    void parallel_parser::create_ast(i_ast_sink& aSink)
+    {
+        merged_ast_sink merger{ aSink, iSource };
+        for (auto& e : iEngines)
+            e->create_ast(merger);
+        merger.finish();
+    }
+
+    std::size_t parallel_parser::piece_count() const
+    {
+        return iEngines.size();
+    }
+
+    std::size_t parallel_parser::thread_count() const
+    {
+        return iThreads;
+    }
+
+    code_parser::statistics parallel_parser::statistics() const
+    {
+        code_parser::statistics result;
+        for (auto const& e : iEngines)
+        {
+            auto const& s = e->statistics();
+            result.memoHits += s.memoHits;
+            result.memoMisses += s.memoMisses;
+            result.tokenHits += s.tokenHits;
+            result.keywordProbes += s.keywordProbes;
+            result.triviaScans += s.triviaScans;
+        }
+        return result;
+    }
+}
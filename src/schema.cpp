@@ -18,10 +18,16 @@
 */
 
 #include <neos/neos.hpp>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <neolib/core/scoped.hpp>
 #include <neolib/core/recursion.hpp>
 #include <neolib/core/string_utils.hpp>
+#include <neos/language/i_compiler.hpp>
 #include <neos/language/schema.hpp>
 
 namespace neos::language::schema_parser
@@ -174,118 +180,150 @@ namespace neos::language
     using atom = parser::atom;
     using primitive = parser::primitive_atom;
 
-    bool is_parent(neolib::parser<schema_parser::symbol>::ast_node const& aNode, std::string_view const& aConcept)
+    template <typename AstNode>
+    bool is_parent(AstNode const& aNode, std::string_view const& aConcept)
     {
         return aNode.parent && aNode.parent->c == aConcept;
     }
 
-    void walk_ast(neolib::parser<schema_parser::symbol> const& aSchemaParser, neolib::parser<schema_parser::symbol>::ast_node const& aNode, schema_stage& aStage, primitive* aParentAtom = nullptr)
+    // Builds both models of a stage grammar from its schema AST in a single walk: the neolib
+    // parser's rules, whose primitives are parented by pointer, and the code parser's grammar,
+    // whose primitives are parented by primitive_index.
+    class schema_ast_visitor
     {
-        auto& codeParser = *aStage.parser;
+    public:
+        struct parent
+        {
+            primitive* atom = nullptr;
+            code_parser::primitive_index primitive = code_parser::npos;
+        };
+    public:
+        schema_ast_visitor(schema_stage& aStage) :
+            iStage{ aStage }, iParser{ *aStage.parser }, iGrammar{ *aStage.codeGrammar }
+        {
+        }
+    public:
+        template <typename AstNode>
+        void visit(AstNode const& aNode, parent const& aParent = {})
+        {
+            parent const newParent{ enter_atom(aNode, aParent.atom), enter_primitive(aNode, aParent.primitive) };
 
-        primitive* currentParent = aParentAtom;
-        primitive* newParent = currentParent;
+            thread_local std::int32_t depth = 0;
+            std::optional<neolib::scoped_counter<std::int32_t>> scopedDepth;
+            if (newParent.atom != aParent.atom)
+                scopedDepth.emplace(depth);
 
-        std::optional<primitive> value;
+            for (auto const& child : aNode.children)
+                visit(*child, newParent);
 
-        thread_local std::int32_t depth = 0;
-        std::optional<neolib::scoped_counter<std::int32_t>> scopedDepth;
+            leave_atom(aNode, aParent.atom);
+            leave_primitive(aNode, aParent.primitive);
+        }
+    private:
+        template <typename AstNode>
+        primitive* enter_atom(AstNode const& aNode, primitive* aParent)
+        {
+            std::optional<primitive> value;
 
-        if (aNode.c == "rule_name")
-            value.emplace(lookup_symbol(aStage, aNode.value));
-        else if (aNode.c == "rule_constraint")
-            codeParser.rules().back().rhs.back().constraint.emplace(aNode.children.front()->value);
-        else if (aNode.c == "concatenation")
-            value.emplace(parser::concatenation{});
-        else if (aNode.c == "alternation")
-            value.emplace(parser::alternation{});
-        else if (aNode.c == "alternation_match_first")
-            std::get<parser::alternation>(value.emplace(parser::alternation{})).matchFirst = true;
-        else if (aNode.c == "repetition")
-            value.emplace(parser::repetition{});
-        else if (aNode.c == "optional")
-            value.emplace(parser::optional{});
-        else if (aNode.c == "range")
-            value.emplace(parser::range{});
-        else if (aNode.c == "string")
-            value.emplace(parser::terminal{ neolib::unescape(aNode.value) });
-        else if (aNode.c == "character")
-            value.emplace(parser::terminal{ neolib::unescape(aNode.value) });
-        else if (aNode.c == "codepoint")
-            value.emplace(parser::terminal{ neolib::utf32_to_utf8(std::u32string{ static_cast<char32_t>(std::stoul(aNode.value.data(), nullptr, 16))}) });
+            if (aNode.c == "rule_name")
+                value.emplace(lookup_symbol(iStage, aNode.value));
+            else if (aNode.c == "rule_constraint")
+                iParser.rules().back().rhs.back().constraint.emplace(aNode.children.front()->value);
+            else if (aNode.c == "concatenation")
+                value.emplace(parser::concatenation{});
+            else if (aNode.c == "alternation")
+                value.emplace(parser::alternation{});
+            else if (aNode.c == "alternation_match_first")
+                std::get<parser::alternation>(value.emplace(parser::alternation{})).matchFirst = true;
+            else if (aNode.c == "repetition")
+                value.emplace(parser::repetition{});
+            else if (aNode.c == "optional")
+                value.emplace(parser::optional{});
+            else if (aNode.c == "range")
+                value.emplace(parser::range{});
+            else if (aNode.c == "string")
+                value.emplace(parser::terminal{ neolib::unescape(aNode.value) });
+            else if (aNode.c == "character")
+                value.emplace(parser::terminal{ neolib::unescape(aNode.value) });
+            else if (aNode.c == "codepoint")
+                value.emplace(parser::terminal{ neolib::utf32_to_utf8(std::u32string{ static_cast<char32_t>(std::stoul(aNode.value.data(), nullptr, 16))}) });
 
-        if (value.has_value())
+            primitive* newParent = aParent;
+            if (value.has_value())
+            {
+                if (is_parent(aNode, "rule"))
+                {
+                    iParser.rules().emplace_back(value.value());
+                    newParent = &iParser.rules().back().lhs.back();
+                }
+                else if (is_parent(aNode, "rule_expression") && is_parent(*aNode.parent, "rule"))
+                {
+                    iParser.rules().back().rhs.push_back(value.value());
+                    newParent = &iParser.rules().back().rhs.back();
+                }
+                else if (aParent)
+                {
+                    std::visit([&](auto& aParentPrimitive)
+                    {
+                        using type = std::decay_t<decltype(aParentPrimitive)>;
+                        if constexpr (
+                            std::is_same_v<type, parser::concatenation> ||
+                            std::is_same_v<type, parser::alternation> ||
+                            std::is_same_v<type, parser::repetition> ||
+                            std::is_same_v<type, parser::optional> ||
+                            std::is_same_v<type, parser::range>)
+                        {
+                            aParentPrimitive.value.push_back(value.value());
+                            newParent = &aParentPrimitive.value.back();
+                        }
+                    }, *aParent);
+                }
+            }
+            else if (is_parent(aNode, "rule") && aNode.c == "rule_expression")
+                newParent = &iParser.rules().back().lhs.back();
+            return newParent;
+        }
+        template <typename AstNode>
+        void leave_atom(AstNode const& aNode, primitive* aParent)
         {
-            if (is_parent(aNode, "rule"))
+            if (!aParent)
             {
-                codeParser.rules().emplace_back(value.value());
-                newParent = &codeParser.rules().back().lhs.back();
+                if (aNode.c == "semantic_concept")
+                    iParser.rules().back().lhs.back().c.emplace(aNode.value);
+                return;
             }
-            else if (is_parent(aNode, "rule_expression") && is_parent(*aNode.parent, "rule"))
+
+            primitive* previous = nullptr;
+            if (!iParser.rules().empty() &&
+                !iParser.rules().back().lhs.empty() &&
+                !iParser.rules().back().rhs.empty() &&
+                aParent == &iParser.rules().back().lhs.back())
             {
-                codeParser.rules().back().rhs.push_back(value.value());
-                newParent = &codeParser.rules().back().rhs.back();
+                previous = &iParser.rules().back().rhs.back();
             }
-            else if (currentParent)
+            else
             {
                 std::visit([&](auto& aParentPrimitive)
-                {
-                    using type = std::decay_t<decltype(aParentPrimitive)>;
-                    if constexpr (
-                        std::is_same_v<type, parser::concatenation> ||
-                        std::is_same_v<type, parser::alternation> ||
-                        std::is_same_v<type, parser::repetition> ||
-                        std::is_same_v<type, parser::optional> ||
-                        std::is_same_v<type, parser::range>)
                     {
-                        aParentPrimitive.value.push_back(value.value());
-                        newParent = &aParentPrimitive.value.back();
-                    }
-                }, *currentParent);
+                        using type = std::decay_t<decltype(aParentPrimitive)>;
+                        if constexpr (
+                            std::is_same_v<type, parser::concatenation> ||
+                            std::is_same_v<type, parser::alternation> ||
+                            std::is_same_v<type, parser::repetition> ||
+                            std::is_same_v<type, parser::optional>)
+                        {
+                            if (!aParentPrimitive.value.empty())
+                                previous = &aParentPrimitive.value.back();
+                        }
+                    }, *aParent);
             }
-        }
-        else if (is_parent(aNode, "rule") && aNode.c == "rule_expression")
-            newParent = &codeParser.rules().back().lhs.back();
-
-        if (newParent != currentParent)
-            scopedDepth.emplace(depth);
-
-        for (auto const& child : aNode.children)
-            walk_ast(aSchemaParser, *child, aStage, newParent);
-
-        primitive* previous = nullptr;
-        if (!codeParser.rules().empty() &&
-            !codeParser.rules().back().lhs.empty() &&
-            !codeParser.rules().back().rhs.empty() &&
-            currentParent == &codeParser.rules().back().lhs.back())
-        {
-            previous = &codeParser.rules().back().rhs.back();
-        }
-        else if (currentParent)
-        {
-            std::visit([&](auto& aParentPrimitive)
-                {
-                    using type = std::decay_t<decltype(aParentPrimitive)>;
-                    if constexpr (
-                        std::is_same_v<type, parser::concatenation> ||
-                        std::is_same_v<type, parser::alternation> ||
-                        std::is_same_v<type, parser::repetition> ||
-                        std::is_same_v<type, parser::optional>)
-                    {
-                        if (!aParentPrimitive.value.empty())
-                            previous = &aParentPrimitive.value.back();
-                    }
-                }, *currentParent);
-        }
 
-        if (currentParent)
-        {
             if (aNode.c == "semantic_concept")
             {
                 previous->c.emplace(aNode.value);
                 thread_local std::string infixCheck;
                 infixCheck = aNode.value;
-                if (aStage.infix->find(infixCheck) != aStage.infix->end())
+                if (iStage.infix->find(infixCheck) != iStage.infix->end())
                     previous->c.value().association = neolib::concept_association::Infix;
             }
             else if (aNode.c == "rule_constraint")
@@ -323,24 +361,372 @@ namespace neos::language
                                     }
                                     else if constexpr (std::is_same_v<type, parser::range>)
                                     {
-                                        // todo
+                                        auto const& low = std::get<parser::terminal>(aRhs.value[0]);
+                                        auto const& high = std::get<parser::terminal>(aRhs.value[1]);
+                                        auto const excluded = code_parser::range_bitmap(low, high, aRhs.negate);
+                                        for (std::uint32_t byte = 0u; byte < 256u; ++byte)
+                                            if (excluded.test(byte))
+                                                ran.exclusions.insert(static_cast<unsigned char>(byte));
                                     }
                                 }, aParentPrimitive.value[1]);
                             aParentPrimitive.value.erase(std::next(aParentPrimitive.value.begin()));
                         }
-                    }, *currentParent);
+                    }, *aParent);
+            }
+        }
+        bool is_lhs(code_parser::primitive_index aPrimitive) const
+        {
+            return aPrimitive != code_parser::npos && !iGrammar.rules.empty() && iGrammar.rules.back().lhs == aPrimitive;
+        }
+        std::vector<code_parser::primitive_index>* children_of(code_parser::primitive_index aPrimitive)
+        {
+            if (aPrimitive == code_parser::npos)
+                return nullptr;
+            if (is_lhs(aPrimitive))
+                return &iGrammar.rules.back().rhs;
+            switch (iGrammar.primitives[aPrimitive].type)
+            {
+            case code_parser::primitive_type::Concatenation:
+            case code_parser::primitive_type::Alternation:
+            case code_parser::primitive_type::Repetition:
+            case code_parser::primitive_type::Optional:
+            case code_parser::primitive_type::Range:
+                return &iGrammar.primitives[aPrimitive].children;
+            default:
+                return nullptr;
             }
         }
-        else
+        template <typename AstNode>
+        code_parser::primitive_index enter_primitive(AstNode const& aNode, code_parser::primitive_index aParent)
         {
+            std::optional<code_parser::primitive> value;
+
+            if (aNode.c == "rule_name")
+            {
+                if (is_parent(aNode, "special") && std::string_view{ aNode.value } == "eof")
+                    value.emplace(code_parser::primitive{ code_parser::primitive_type::Eof });
+                else
+                    value.emplace(code_parser::primitive{ code_parser::primitive_type::Symbol, lookup_symbol(iStage, aNode.value) });
+            }
+            else if (aNode.c == "rule_constraint")
+            {
+                auto const& rhs = iGrammar.rules.back().rhs;
+                if (!rhs.empty())
+                    iGrammar.primitives[rhs.back()].constraint.emplace(neolib::unescape(aNode.children.front()->value));
+            }
+            else if (aNode.c == "concatenation")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Concatenation });
+            else if (aNode.c == "alternation")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Alternation });
+            else if (aNode.c == "alternation_match_first")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Alternation }).matchFirst = true;
+            else if (aNode.c == "repetition")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Repetition });
+            else if (aNode.c == "optional")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Optional });
+            else if (aNode.c == "range")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Range });
+            else if (aNode.c == "string" || aNode.c == "character")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Terminal }).text = neolib::unescape(aNode.value);
+            else if (aNode.c == "codepoint")
+                value.emplace(code_parser::primitive{ code_parser::primitive_type::Terminal }).text = 
+                    neolib::utf32_to_utf8(std::u32string{ static_cast<char32_t>(std::stoul(std::string{ std::string_view{ aNode.value } }, nullptr, 16)) });
+
+            code_parser::primitive_index newParent = aParent;
+            if (value.has_value())
+            {
+                if (is_parent(aNode, "rule"))
+                {
+                    auto const lhs = iGrammar.add(std::move(value.value()));
+                    iGrammar.rules.push_back(code_parser::rule{ lhs });
+                    newParent = lhs;
+                }
+                else if (is_parent(aNode, "rule_expression") && is_parent(*aNode.parent, "rule"))
+                {
+                    auto const primitive = iGrammar.add(std::move(value.value()));
+                    iGrammar.rules.back().rhs.push_back(primitive);
+                    newParent = primitive;
+                }
+                else if (aParent != code_parser::npos && !is_lhs(aParent) && children_of(aParent))
+                {
+                    auto const primitive = iGrammar.add(std::move(value.value()));
+                    children_of(aParent)->push_back(primitive);
+                    newParent = primitive;
+                }
+            }
+            else if (is_parent(aNode, "rule") && aNode.c == "rule_expression")
+                newParent = iGrammar.rules.back().lhs;
+            return newParent;
+        }
+        template <typename AstNode>
+        void leave_primitive(AstNode const& aNode, code_parser::primitive_index aParent)
+        {
+            if (aParent == code_parser::npos)
+            {
+                if (aNode.c == "semantic_concept")
+                    iGrammar.primitives[iGrammar.rules.back().lhs].c.emplace(std::string_view{ aNode.value });
+                return;
+            }
+
+            auto const siblings = children_of(aParent);
+            if (!siblings || siblings->empty())
+                return;
+            auto& previous = iGrammar.primitives[siblings->back()];
+
             if (aNode.c == "semantic_concept")
-                codeParser.rules().back().lhs.back().c.emplace(aNode.value);
+            {
+                previous.c.emplace(std::string_view{ aNode.value });
+                previous.infix = iStage.infix->find(previous.c.value()) != iStage.infix->end();
+            }
+            else if (aNode.c == "at_least_one")
+                previous.atLeastOne = true;
+            else if (aNode.c == "not")
+                previous.negate = true;
+            else if (aNode.c == "subtract" && siblings->size() >= 2u)
+            {
+                // the subtract concept is infix so the range and its subtrahend are the last two siblings
+                auto const subtrahend = siblings->back();
+                siblings->pop_back();
+                auto& ran = iGrammar.primitives[siblings->back()];
+                auto const& rhs = iGrammar.primitives[subtrahend];
+                if (rhs.type == code_parser::primitive_type::Terminal && !rhs.text.empty())
+                    ran.exclusions.set(static_cast<std::uint8_t>(rhs.text[0]));
+                else if (rhs.type != code_parser::primitive_type::Range)
+                {
+                    for (auto e : rhs.children)
+                        if (iGrammar.primitives[e].type == code_parser::primitive_type::Terminal && !iGrammar.primitives[e].text.empty())
+                            ran.exclusions.set(static_cast<std::uint8_t>(iGrammar.primitives[e].text[0]));
+                }
+                else if (rhs.children.size() == 2u)
+                    ran.exclusions |= code_parser::range_bitmap(
+                        iGrammar.primitives[rhs.children[0]].text, iGrammar.primitives[rhs.children[1]].text, rhs.negate);
+            }
+        }
+    private:
+        schema_stage& iStage;
+        parser& iParser;
+        code_parser::grammar& iGrammar;
+    };
+
+    // Each operator table becomes a rule for its expression symbol whose right hand side is a
+    // single Operators primitive; finalizing the grammar lets that rule stand in for the others.
+    void build_operator_tables(schema_stage& aStage)
+    {
+        auto& grammar = *aStage.codeGrammar;
+        auto const symbol_for = [&](std::string const& aName)
+        {
+            auto const existing = aStage.symbolMap->find(aName);
+            if (existing == aStage.symbolMap->end())
+                throw std::runtime_error("operator table symbol '" + aName + "' not found");
+            return existing->second;
+        };
+        for (auto const& table : aStage.operators)
+        {
+            auto const expression = symbol_for(table.expression);
+            auto const lhs = grammar.add(code_parser::primitive{ code_parser::primitive_type::Symbol, expression });
+            for (auto const& r : grammar.rules)
+                if (grammar.primitives[r.lhs].symbol == expression)
+                {
+                    grammar.primitives[lhs].c = grammar.primitives[r.lhs].c;
+                    break;
+                }
+            auto const operators = grammar.add(code_parser::primitive{ code_parser::primitive_type::Operators });
+            auto const operand = grammar.add(code_parser::primitive{ code_parser::primitive_type::Symbol, symbol_for(table.operand) });
+            auto const separator = table.separator ?
+                grammar.add(code_parser::primitive{ code_parser::primitive_type::Symbol, symbol_for(*table.separator) }) :
+                grammar.add(code_parser::primitive{ code_parser::primitive_type::Terminal });
+            grammar.primitives[operators].children = { operand, separator };
+            for (auto const& o : table.operators)
+            {
+                code_parser::primitive op{ code_parser::primitive_type::Terminal };
+                op.text = o.text;
+                op.c.emplace(o.semanticConcept);
+                op.precedence = o.precedence;
+                op.rightAssociative = o.rightAssociative;
+                auto const opIndex = grammar.add(std::move(op));
+                grammar.primitives[operators].children.push_back(opIndex);
+            }
+            grammar.rules.push_back(code_parser::rule{ lhs, { operators } });
+        }
+    }
+
+    template <typename AstNode>
+    void build_stage(AstNode const& aAst, schema_stage& aStage, schema_stage const* aPreviousStage)
+    {
+        if (aPreviousStage)
+            *aStage.codeGrammar = *aPreviousStage->codeGrammar;
+        aStage.codeGrammar->stageRules = static_cast<code_parser::rule_index>(aStage.codeGrammar->rules.size());
+        schema_ast_visitor{ aStage }.visit(aAst);
+        build_operator_tables(aStage);
+        aStage.codeGrammar->finalize(*aStage.symbolMap, *aStage.discard);
+        if (!aStage.root)
+            aStage.dfa = code_parser::dfa::compile(*aStage.codeGrammar);
+    }
+
+    namespace
+    {
+        char const ImageMagic[8] = { 'N', 'E', 'O', 'S', 'I', 'M', 'G', '\0' };
+        std::uint32_t const NoConcept = ~std::uint32_t{};
+
+        std::uint64_t fnv1a(std::string_view const& aData, std::uint64_t aHash = 0xCBF29CE484222325ull)
+        {
+            for (auto ch : aData)
+            {
+                aHash ^= static_cast<std::uint8_t>(ch);
+                aHash *= 0x100000001B3ull;
+            }
+            return aHash;
+        }
+
+        class image_writer
+        {
+        public:
+            image_writer(std::string& aBuffer) :
+                iBuffer{ aBuffer }
+            {
+            }
+        public:
+            template <typename T>
+            void write(T aValue) requires std::is_arithmetic_v<T>
+            {
+                iBuffer.append(reinterpret_cast<char const*>(&aValue), sizeof(T));
+            }
+            void write(std::string_view const& aValue)
+            {
+                write(static_cast<std::uint32_t>(aValue.size()));
+                iBuffer.append(aValue);
+            }
+            void write(std::vector<std::string> const& aValue)
+            {
+                write(static_cast<std::uint32_t>(aValue.size()));
+                for (auto const& s : aValue)
+                    write(std::string_view{ s });
+            }
+            void write(std::vector<std::pair<std::string, std::string>> const& aValue)
+            {
+                write(static_cast<std::uint32_t>(aValue.size()));
+                for (auto const& p : aValue)
+                {
+                    write(std::string_view{ p.first });
+                    write(std::string_view{ p.second });
+                }
+            }
+        private:
+            std::string& iBuffer;
+        };
+
+        class image_reader
+        {
+        public:
+            image_reader(char const* aBegin, char const* aEnd) :
+                iNext{ aBegin }, iEnd{ aEnd }
+            {
+            }
+        public:
+            template <typename T>
+            T read() requires std::is_arithmetic_v<T>
+            {
+                T result;
+                std::memcpy(&result, take(sizeof(T)), sizeof(T));
+                return result;
+            }
+            std::string_view read_string()
+            {
+                auto const length = read<std::uint32_t>();
+                return std::string_view{ take(length), length };
+            }
+            std::vector<std::string> read_strings()
+            {
+                std::vector<std::string> result;
+                for (auto count = read<std::uint32_t>(); count--;)
+                    result.emplace_back(read_string());
+                return result;
+            }
+            std::vector<std::pair<std::string, std::string>> read_string_pairs()
+            {
+                std::vector<std::pair<std::string, std::string>> result;
+                for (auto count = read<std::uint32_t>(); count--;)
+                {
+                    auto& p = result.emplace_back();
+                    p.first = read_string();
+                    p.second = read_string();
+                }
+                return result;
+            }
+            bool at_end() const
+            {
+                return iNext == iEnd;
+            }
+        private:
+            char const* take(std::size_t aLength)
+            {
+                if (static_cast<std::size_t>(iEnd - iNext) < aLength)
+                    throw schema::bad_image();
+                auto const result = iNext;
+                iNext += aLength;
+                return result;
+            }
+        private:
+            char const* iNext;
+            char const* iEnd;
+        };
+
+        // A schema image holds the output of the schema parser (one AST per pipeline stage) with
+        // concept names interned and node values stored as offsets into the schema source; loading
+        // an image replays the schema AST visitor over it so the schema grammar is never re-parsed.
+        struct image_node
+        {
+            std::optional<std::string_view> c;
+            std::string_view value;
+            image_node const* parent = nullptr;
+            std::vector<std::unique_ptr<image_node>> children;
+        };
+
+        template <typename AstNode>
+        void write_image_node(image_writer& aWriter, std::unordered_map<std::string, std::uint32_t>& aConcepts, std::string_view const& aSource, AstNode const& aNode)
+        {
+            if (aNode.c.has_value())
+            {
+                std::string const conceptName{ neolib::string_view{ aNode.c.value() }.to_std_string_view() };
+                auto existing = aConcepts.find(conceptName);
+                if (existing == aConcepts.end())
+                    existing = aConcepts.emplace(conceptName, static_cast<std::uint32_t>(aConcepts.size())).first;
+                aWriter.write(existing->second);
+            }
+            else
+                aWriter.write(NoConcept);
+            auto const value = neolib::string_view{ aNode.value }.to_std_string_view();
+            if (!value.empty() && (value.data() < aSource.data() || value.data() + value.size() > aSource.data() + aSource.size()))
+                throw schema::bad_image();
+            aWriter.write(static_cast<std::uint64_t>(value.empty() ? 0u : value.data() - aSource.data()));
+            aWriter.write(static_cast<std::uint64_t>(value.size()));
+            aWriter.write(static_cast<std::uint32_t>(aNode.children.size()));
+            for (auto const& child : aNode.children)
+                write_image_node(aWriter, aConcepts, aSource, *child);
+        }
+
+        std::unique_ptr<image_node> read_image_node(image_reader& aReader, std::vector<std::string_view> const& aConcepts, std::string_view const& aSource, image_node const* aParent = nullptr)
+        {
+            auto node = std::make_unique<image_node>();
+            node->parent = aParent;
+            auto const conceptIndex = aReader.read<std::uint32_t>();
+            if (conceptIndex != NoConcept)
+                node->c = aConcepts.at(conceptIndex);
+            auto const offset = aReader.read<std::uint64_t>();
+            auto const length = aReader.read<std::uint64_t>();
+            if (offset > aSource.size() || length > aSource.size() - offset)
+                throw schema::bad_image();
+            node->value = aSource.substr(static_cast<std::size_t>(offset), static_cast<std::size_t>(length));
+            for (auto count = aReader.read<std::uint32_t>(); count--;)
+                node->children.push_back(read_image_node(aReader, aConcepts, aSource, node.get()));
+            return node;
         }
     }
 
-    schema::schema(std::string const& aPath, const concept_libraries_t& aConceptLibraries) :
+    schema::schema(std::string const& aPath, const concept_libraries_t& aConceptLibraries, const concept_registry& aConceptRegistry) :
         iPath{ aPath },
-        iConceptLibraries{ aConceptLibraries }
+        iConceptLibraries{ aConceptLibraries },
+        iConceptRegistry{ aConceptRegistry }
     {
         if (!std::filesystem::exists(iPath) && std::filesystem::exists(iPath + ".neos"))
             iPath += ".neos";
@@ -349,6 +735,31 @@ namespace neos::language
         std::stringstream sourceBuffer;
         sourceBuffer << sourceFile.rdbuf();
         iSource = sourceBuffer.str();
+
+        try
+        {
+            iLoadedFromImage = load_image();
+        }
+        catch (...)
+        {
+            iLoadedFromImage = false;
+        }
+
+        if (!iLoadedFromImage)
+        {
+            iMeta = {};
+            iPipeline.clear();
+            std::string image;
+            parse_source(image);
+            save_image(image);
+        }
+
+        bind_concepts();
+        analyze();
+    }
+
+    void schema::parse_source(std::string& aImage)
+    {
         auto part = [&](std::string_view const& keyStart, std::string_view const& keyEnd)
         {
             auto range = keyStart == "%{" ? 
@@ -368,6 +779,8 @@ namespace neos::language
         parse_meta(meta);
 
         std::map<std::string, std::pair<std::string_view, std::optional<std::string>>> stages;
+        std::map<std::string, std::vector<operator_table_declaration>> stageOperators;
+        std::map<std::string, code_parser::split_hint> stageSplits;
 
         for (auto const& stage : metaContents.root().as<neolib::rjson_object>().at("stages").as<neolib::rjson_object>().contents())
         {
@@ -377,6 +790,10 @@ namespace neos::language
             if (partParams.has("root"))
                 root = partParams.at("root").as<neolib::rjson_keyword>().text;
             stages[stage.name()] = std::make_pair(part(text[0].as<neolib::rjson_string>(), text[1].as<neolib::rjson_string>()), root);
+            if (partParams.has("operators"))
+                stageOperators[stage.name()] = parse_operators(partParams.at("operators"));
+            if (partParams.has("parallel"))
+                stageSplits[stage.name()] = parse_split_hint(partParams.at("parallel"));
         }
 
         auto infix = std::make_shared<std::unordered_set<std::string>>();
@@ -398,11 +815,23 @@ namespace neos::language
             auto const& stageName = stage->text();
             auto symbolMap = iPipeline.empty() ? std::make_shared<std::unordered_map<std::string_view, code_parser::symbol>>() : iPipeline.back()->symbolMap;
             if (iPipeline.empty())
-                iPipeline.push_back(std::make_unique<schema_stage>(stageName, stages.at(stageName).first, stages.at(stageName).second, infix, discard, symbolMap, std::make_shared<parser>()));
+                iPipeline.push_back(std::make_unique<schema_stage>(stageName, stages.at(stageName).first, stages.at(stageName).second, infix, discard, symbolMap, std::make_shared<parser>(), std::make_shared<code_parser::grammar>()));
             else
-                iPipeline.push_back(std::make_unique<schema_stage>(stageName, stages.at(stageName).first, stages.at(stageName).second, infix, discard, symbolMap, std::make_shared<parser>(iPipeline.back()->parser)));
+                iPipeline.push_back(std::make_unique<schema_stage>(stageName, stages.at(stageName).first, stages.at(stageName).second, infix, discard, symbolMap, std::make_shared<parser>(iPipeline.back()->parser), std::make_shared<code_parser::grammar>()));
+            auto const operators = stageOperators.find(stageName);
+            if (operators != stageOperators.end())
+                iPipeline.back()->operators = operators->second;
+            auto const split = stageSplits.find(stageName);
+            if (split != stageSplits.end())
+                iPipeline.back()->split = split->second;
         }
 
+        std::string nodes;
+        image_writer nodeWriter{ nodes };
+        std::unordered_map<std::string, std::uint32_t> concepts;
+        bool imageable = true;
+        schema_stage const* previousStage = nullptr;
+
         for (auto const& stagePtr : iPipeline)
         {
             auto& stage = *stagePtr;
@@ -411,8 +840,81 @@ namespace neos::language
             parser.set_debug_output(std::cerr, false, false);
             parser.parse(schema_parser::symbol::Grammar, stage.grammar);
             parser.create_ast();
-            walk_ast(parser, parser.ast(), stage);
+            build_stage(parser.ast(), stage, previousStage);
+            previousStage = &stage;
+            try
+            {
+                if (imageable)
+                    write_image_node(nodeWriter, concepts, iSource, parser.ast());
+            }
+            catch (bad_image const&)
+            {
+                imageable = false;
+            }
+        }
+
+        aImage.clear();
+        if (!imageable)
+            return;
+
+        image_writer writer{ aImage };
+        aImage.append(std::begin(ImageMagic), std::end(ImageMagic));
+        writer.write(ImageVersion);
+        writer.write(image_key());
+        writer.write(std::string_view{ iMeta.language });
+        writer.write(std::string_view{ iMeta.description });
+        writer.write(std::string_view{ iMeta.copyright });
+        writer.write(std::string_view{ iMeta.version });
+        writer.write(iMeta.sourcecodeFileExtension);
+        writer.write(iMeta.sourcecodeModulePackageSpecificationFileExtension);
+        writer.write(iMeta.sourcecodeModulePackageImplementationFileExtension);
+        writer.write(static_cast<std::uint64_t>(iMeta.parserRecursionLimit));
+        writer.write(static_cast<std::uint8_t>(iMeta.parserEngine));
+        writer.write(static_cast<std::uint8_t>(iMeta.parserPackrat));
+        writer.write(std::vector<std::string>{ infix->begin(), infix->end() });
+        writer.write(std::vector<std::string>{ discard->begin(), discard->end() });
+        std::vector<std::string> conceptTable(concepts.size());
+        for (auto const& c : concepts)
+            conceptTable[c.second] = c.first;
+        writer.write(conceptTable);
+        writer.write(static_cast<std::uint32_t>(iPipeline.size()));
+        for (auto const& stage : iPipeline)
+        {
+            writer.write(std::string_view{ stage->name });
+            writer.write(static_cast<std::uint64_t>(stage->grammar.data() - iSource.data()));
+            writer.write(static_cast<std::uint64_t>(stage->grammar.size()));
+            writer.write(static_cast<std::uint8_t>(stage->root.has_value()));
+            writer.write(std::string_view{ stage->root.value_or(std::string{}) });
+            writer.write(static_cast<std::uint32_t>(stage->operators.size()));
+            for (auto const& table : stage->operators)
+            {
+                writer.write(std::string_view{ table.expression });
+                writer.write(std::string_view{ table.operand });
+                writer.write(static_cast<std::uint8_t>(table.separator.has_value()));
+                writer.write(std::string_view{ table.separator.value_or(std::string{}) });
+                writer.write(static_cast<std::uint32_t>(table.operators.size()));
+                for (auto const& o : table.operators)
+                {
+                    writer.write(std::string_view{ o.text });
+                    writer.write(std::string_view{ o.semanticConcept });
+                    writer.write(o.precedence);
+                    writer.write(static_cast<std::uint8_t>(o.rightAssociative));
+                }
+            }
+            writer.write(static_cast<std::uint8_t>(stage->split.has_value()));
+            if (stage->split)
+            {
+                writer.write(stage->split->scopes);
+                writer.write(stage->split->brackets);
+                writer.write(stage->split->terminators);
+                writer.write(stage->split->quotes);
+                writer.write(std::string_view{ stage->split->escape });
+                writer.write(stage->split->lineComments);
+                writer.write(stage->split->blockComments);
+                writer.write(static_cast<std::uint8_t>(stage->split->indentation));
+            }
         }
+        aImage.append(nodes);
     }
 
     std::string const& schema::path() const
@@ -420,6 +922,16 @@ namespace neos::language
         return iPath;
     }
 
+    std::string schema::image_path() const
+    {
+        return iPath + ".image";
+    }
+
+    bool schema::loaded_from_image() const
+    {
+        return iLoadedFromImage;
+    }
+
     language::meta const& schema::meta() const
     {
         return iMeta;
@@ -430,6 +942,27 @@ namespace neos::language
         return iPipeline;
     }
 
+    void schema::write_analysis(std::ostream& aStream, bool aJson) const
+    {
+        if (aJson)
+        {
+            aStream << "{ \"stages\": [";
+            for (auto const& stage : iPipeline)
+            {
+                aStream << (stage == iPipeline.front() ? "\n" : ",\n") << "{ \"stage\": \"" << stage->name << "\", \"analysis\":\n";
+                code_parser::write_analysis_json(aStream, *stage->codeGrammar, stage->analysis);
+                aStream << " }";
+            }
+            aStream << " ] }" << std::endl;
+            return;
+        }
+        for (auto const& stage : iPipeline)
+        {
+            aStream << "Schema stage '" << stage->name << "':" << std::endl;
+            code_parser::write_analysis_report(aStream, *stage->codeGrammar, stage->analysis);
+        }
+    }
+
     void schema::parse_meta(neolib::rjson_value const& aNode)
     {
         if (aNode.name() == "meta")
@@ -444,6 +977,14 @@ namespace neos::language
                     iMeta.copyright = meta.as<neolib::rjson_string>();
                 else if (meta.name() == "version")
                     iMeta.version = meta.as<neolib::rjson_string>();
+                else if (meta.name() == "parser.engine")
+                    iMeta.parserEngine = (meta.text() == "neos" ? parser_engine::Neos : parser_engine::Neolib);
+                else if (meta.name() == "parser.packrat")
+                {
+                    iMeta.parserPackrat = (meta.text() == "true");
+                    if (iMeta.parserPackrat)
+                        iMeta.parserEngine = parser_engine::Neos;
+                }
                 else if (meta.name() == "source.file.extension")
                 {
                     if (meta.type() == neolib::json_type::String)
@@ -478,6 +1019,258 @@ namespace neos::language
         }
     }
 
+    // An operator table lists its precedence levels loosest first, each level's operators as text
+    // and concept pairs:
+    //   operators : [ { expression : "numeric expression" operand : factor separator : WS
+    //       precedence : [ { associativity : left operators : [ "+" math.operator.add ] } ] } ]
+    std::vector<operator_table_declaration> schema::parse_operators(neolib::rjson_value const& aNode) const
+    {
+        std::vector<operator_table_declaration> result;
+        for (auto const& table : aNode.as<neolib::rjson_array>())
+        {
+            auto const& tableParams = table->as<neolib::rjson_object>();
+            if (!tableParams.has("expression") || !tableParams.has("operand") || !tableParams.has("precedence"))
+                throw_error(aNode, "operator table requires expression, operand and precedence");
+            auto& declaration = result.emplace_back();
+            declaration.expression = tableParams.at("expression").text();
+            declaration.operand = tableParams.at("operand").text();
+            if (tableParams.has("separator"))
+                declaration.separator = tableParams.at("separator").text();
+            std::uint32_t precedence = 0u;
+            for (auto const& level : tableParams.at("precedence").as<neolib::rjson_array>())
+            {
+                auto const& levelParams = level->as<neolib::rjson_object>();
+                ++precedence;
+                bool const rightAssociative = levelParams.has("associativity") && levelParams.at("associativity").text() == "right";
+                auto const& operators = levelParams.at("operators").as<neolib::rjson_array>();
+                if (operators.size() % 2u != 0u)
+                    throw_error(aNode, "operator table operators must be text and concept pairs");
+                for (std::size_t o = 0u; o < operators.size(); o += 2u)
+                    declaration.operators.push_back(operator_declaration{ operators[o].text(), operators[o + 1u].text(), precedence, rightAssociative });
+            }
+        }
+        return result;
+    }
+
+    // A split hint tells the compiler where a source can be cut into pieces that can be parsed
+    // apart (in parallel, again after an edit or as the source is read); scopes, brackets and
+    // block comments are open and close pairs:
+    //   parallel : { scopes : [ "{" "}" ] brackets : [ "(" ")" ] terminators : [ ";" ] quotes : [ "\"" ]
+    //       escape : "\\" comments : [ "//" ] block.comments : [ "/*" "*/" ] indentation : false }
+    code_parser::split_hint schema::parse_split_hint(neolib::rjson_value const& aNode) const
+    {
+        auto const& hintParams = aNode.as<neolib::rjson_object>();
+        auto const strings = [&](std::string const& aName)
+        {
+            std::vector<std::string> result;
+            if (hintParams.has(aName))
+                for (auto const& s : hintParams.at(aName).as<neolib::rjson_array>())
+                    result.push_back(s->text());
+            return result;
+        };
+        auto const pairs = [&](std::string const& aName)
+        {
+            auto const texts = strings(aName);
+            if (texts.size() % 2u != 0u)
+                throw_error(aNode, "parallel " + aName + " must be open and close pairs");
+            std::vector<std::pair<std::string, std::string>> result;
+            for (std::size_t t = 0u; t < texts.size(); t += 2u)
+                result.emplace_back(texts[t], texts[t + 1u]);
+            return result;
+        };
+        code_parser::split_hint result;
+        result.scopes = pairs("scopes");
+        result.brackets = pairs("brackets");
+        result.terminators = strings("terminators");
+        result.quotes = strings("quotes");
+        if (hintParams.has("escape"))
+            result.escape = hintParams.at("escape").text();
+        result.lineComments = strings("comments");
+        result.blockComments = pairs("block.comments");
+        result.indentation = hintParams.has("indentation") && hintParams.at("indentation").text() == "true";
+        if (result.scopes.empty() && result.terminators.empty() && !result.indentation)
+            throw_error(aNode, "parallel requires scopes, terminators or indentation");
+        return result;
+    }
+
+    std::uint64_t schema::image_key() const
+    {
+        std::ostringstream versions;
+        versions << NEOS_VERSION << ';' << ImageVersion << ';';
+        for (auto const& cl : iConceptLibraries)
+            versions << cl.first() << '=' << cl.second()->version() << ';';
+        return fnv1a(iSource, fnv1a(versions.str()));
+    }
+
+    bool schema::load_image()
+    {
+        if (!std::filesystem::exists(image_path()))
+            return false;
+
+        boost::interprocess::file_mapping const file{ image_path().c_str(), boost::interprocess::read_only };
+        boost::interprocess::mapped_region const region{ file, boost::interprocess::read_only };
+        auto const imageBegin = static_cast<char const*>(region.get_address());
+        image_reader reader{ imageBegin, imageBegin + region.get_size() };
+
+        for (auto ch : ImageMagic)
+            if (reader.read<char>() != ch)
+                return false;
+        if (reader.read<std::uint32_t>() != ImageVersion)
+            return false;
+        if (reader.read<std::uint64_t>() != image_key())
+            return false;
+
+        iMeta.language = reader.read_string();
+        iMeta.description = reader.read_string();
+        iMeta.copyright = reader.read_string();
+        iMeta.version = reader.read_string();
+        iMeta.sourcecodeFileExtension = reader.read_strings();
+        iMeta.sourcecodeModulePackageSpecificationFileExtension = reader.read_strings();
+        iMeta.sourcecodeModulePackageImplementationFileExtension = reader.read_strings();
+        iMeta.parserRecursionLimit = static_cast<std::size_t>(reader.read<std::uint64_t>());
+        iMeta.parserEngine = static_cast<parser_engine>(reader.read<std::uint8_t>());
+        iMeta.parserPackrat = reader.read<std::uint8_t>() != 0u;
+        auto const infixNames = reader.read_strings();
+        auto const discardNames = reader.read_strings();
+        auto const infix = std::make_shared<std::unordered_set<std::string>>(infixNames.begin(), infixNames.end());
+        auto const discard = std::make_shared<std::unordered_set<std::string>>(discardNames.begin(), discardNames.end());
+        std::vector<std::string_view> concepts;
+        for (auto count = reader.read<std::uint32_t>(); count--;)
+            concepts.push_back(reader.read_string());
+
+        std::string_view const source{ iSource };
+        auto const stageCount = reader.read<std::uint32_t>();
+        for (std::uint32_t stageIndex = 0u; stageIndex < stageCount; ++stageIndex)
+        {
+            std::string const stageName{ reader.read_string() };
+            auto const grammarOffset = reader.read<std::uint64_t>();
+            auto const grammarLength = reader.read<std::uint64_t>();
+            if (grammarOffset > source.size() || grammarLength > source.size() - grammarOffset)
+                throw bad_image();
+            auto const grammar = source.substr(static_cast<std::size_t>(grammarOffset), static_cast<std::size_t>(grammarLength));
+            std::optional<std::string> root;
+            auto const hasRoot = reader.read<std::uint8_t>() != 0u;
+            auto const rootName = reader.read_string();
+            if (hasRoot)
+                root = rootName;
+            std::vector<operator_table_declaration> operators;
+            for (auto tableCount = reader.read<std::uint32_t>(); tableCount--;)
+            {
+                auto& table = operators.emplace_back();
+                table.expression = reader.read_string();
+                table.operand = reader.read_string();
+                auto const hasSeparator = reader.read<std::uint8_t>() != 0u;
+                auto const separator = reader.read_string();
+                if (hasSeparator)
+                    table.separator = separator;
+                for (auto operatorCount = reader.read<std::uint32_t>(); operatorCount--;)
+                {
+                    auto& o = table.operators.emplace_back();
+                    o.text = reader.read_string();
+                    o.semanticConcept = reader.read_string();
+                    o.precedence = reader.read<std::uint32_t>();
+                    o.rightAssociative = reader.read<std::uint8_t>() != 0u;
+                }
+            }
+            std::optional<code_parser::split_hint> split;
+            if (reader.read<std::uint8_t>() != 0u)
+            {
+                split.emplace();
+                split->scopes = reader.read_string_pairs();
+                split->brackets = reader.read_string_pairs();
+                split->terminators = reader.read_strings();
+                split->quotes = reader.read_strings();
+                split->escape = reader.read_string();
+                split->lineComments = reader.read_strings();
+                split->blockComments = reader.read_string_pairs();
+                split->indentation = reader.read<std::uint8_t>() != 0u;
+            }
+            auto symbolMap = iPipeline.empty() ? std::make_shared<std::unordered_map<std::string_view, code_parser::symbol>>() : iPipeline.back()->symbolMap;
+            if (iPipeline.empty())
+                iPipeline.push_back(std::make_unique<schema_stage>(stageName, grammar, root, infix, discard, symbolMap, std::make_shared<parser>(), std::make_shared<code_parser::grammar>()));
+            else
+                iPipeline.push_back(std::make_unique<schema_stage>(stageName, grammar, root, infix, discard, symbolMap, std::make_shared<parser>(iPipeline.back()->parser), std::make_shared<code_parser::grammar>()));
+            iPipeline.back()->operators = std::move(operators);
+            iPipeline.back()->split = std::move(split);
+        }
+
+        schema_stage const* previousStage = nullptr;
+        for (auto const& stage : iPipeline)
+        {
+            auto const stageAst = read_image_node(reader, concepts, source);
+            build_stage(*stageAst, *stage, previousStage);
+            previousStage = stage.get();
+        }
+
+        return reader.at_end();
+    }
+
+    void schema::save_image(std::string const& aImage) const
+    {
+        if (aImage.empty())
+            return;
+        try
+        {
+            auto const imagePath = image_path();
+            auto const tempPath = imagePath + ".tmp";
+            {
+                std::ofstream imageFile{ tempPath, std::ios::binary | std::ios::trunc };
+                imageFile.write(aImage.data(), aImage.size());
+                if (!imageFile)
+                    return;
+            }
+            std::filesystem::rename(tempPath, imagePath);
+        }
+        catch (...)
+        {
+            // a schema image is only a cache so failing to write one is not an error
+        }
+    }
+
+    // Looks for grammar that will misbehave at parse time (exponential backtracking, left
+    // recursion, unreachable rules, shadowed alternatives and overlapping repetition) and
+    // estimates what each rule costs; done however the stages were built.
+    void schema::analyze()
+    {
+        for (auto const& stage : iPipeline)
+        {
+            std::optional<code_parser::symbol> root;
+            if (stage->root)
+                root = stage->symbolMap->at(stage->root.value());
+            stage->analysis = code_parser::analyze(*stage->codeGrammar, root, iMeta.parserPackrat);
+        }
+    }
+
+    // Every annotation names a concept (the neolib engine's primitives carry the same ones as the
+    // code grammar's) so binding those of the code grammar binds them all; a concept the registry
+    // doesn't have is an error now rather than when a program first uses it.
+    void schema::bind_concepts()
+    {
+        auto const bind = [&](std::string const& aName)
+        {
+            neolib::ref_ptr<i_semantic_concept> semanticConcept;
+            if (auto const c = iConceptRegistry.find(iConceptRegistry.id(aName)))
+                semanticConcept.reset(c);
+            else
+                throw concept_not_found(aName);
+            return bound_concept{ semanticConcept, aName != "language.keyword" };
+        };
+        for (auto const& stage : iPipeline)
+        {
+            auto const& primitives = stage->codeGrammar->primitives;
+            stage->concepts.clear();
+            stage->primitiveConcepts.assign(primitives.size(), {});
+            for (std::size_t p = 0u; p < primitives.size(); ++p)
+                if (primitives[p].c)
+                {
+                    auto existing = stage->concepts.find(*primitives[p].c);
+                    if (existing == stage->concepts.end())
+                        existing = stage->concepts.emplace(*primitives[p].c, bind(*primitives[p].c)).first;
+                    stage->primitiveConcepts[p] = existing->second;
+                }
+        }
+    }
+
     void schema::throw_error(neolib::rjson_value const& aNode, const std::string aErrorText) const
     {
         if (aNode.has_name())
@@ -0,0 +1,85 @@
+/*
+  source_buffer.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <filesystem>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <neos/language/source_buffer.hpp>
+
+namespace neos::language
+{
+    struct source_buffer::mapping
+    {
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+    };
+
+    std::shared_ptr<source_buffer const> source_buffer::map(std::string const& aPath)
+    {
+        return std::make_shared<source_buffer const>(aPath);
+    }
+
+    std::shared_ptr<source_buffer const> source_buffer::hold(std::string aText)
+    {
+        return std::make_shared<source_buffer const>(held{}, std::move(aText));
+    }
+
+    // An empty file can't be mapped so isn't; its text is empty.
+    source_buffer::source_buffer(std::string const& aPath) :
+        iPath{ aPath }
+    {
+        std::error_code error;
+        auto const size = std::filesystem::file_size(aPath, error);
+        if (error)
+            throw cannot_map(aPath);
+        if (size == 0u)
+            return;
+        try
+        {
+            boost::interprocess::file_mapping file{ aPath.c_str(), boost::interprocess::read_only };
+            boost::interprocess::mapped_region region{ file, boost::interprocess::read_only };
+            iMapping = std::make_unique<mapping>(mapping{ std::move(file), std::move(region) });
+        }
+        catch (boost::interprocess::interprocess_exception const&)
+        {
+            throw cannot_map(aPath);
+        }
+        iText = std::string_view{ static_cast<char const*>(iMapping->region.get_address()), iMapping->region.get_size() };
+    }
+
+    source_buffer::source_buffer(held, std::string aText) :
+        iHeld{ std::move(aText) }, iText{ iHeld }
+    {
+    }
+
+    source_buffer::~source_buffer()
+    {
+    }
+
+    std::string const& source_buffer::path() const
+    {
+        return iPath;
+    }
+
+    std::string_view source_buffer::text() const
+    {
+        return iText;
+    }
+}
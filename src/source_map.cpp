@@ -0,0 +1,62 @@
+/*
+  source_map.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <functional>
+#include <neos/language/compiler.hpp>
+#include <neos/language/source_map.hpp>
+
+namespace neos::language
+{
+    // A position at the end of a fragment is in it, as translation_unit::fragment() has it; one
+    // between two adjoining fragments is in the second.
+    std::optional<source_location> source_map::locate(std::vector<translation_unit> const& aUnits, char const* aPosition) const
+    {
+        if (iGeneration != source_fragment::generation())
+            update(aUnits);
+        std::less<char const*> const before;
+        auto const next = std::upper_bound(iExtents.begin(), iExtents.end(), aPosition,
+            [&](char const* aTarget, extent const& aExtent) { return before(aTarget, aExtent.begin); });
+        if (next == iExtents.begin())
+            return std::nullopt;
+        auto const& e = *std::prev(next);
+        if (before(e.end, aPosition))
+            return std::nullopt;
+        auto const offset = static_cast<std::size_t>(aPosition - e.begin);
+        auto const position = e.fragment->position(offset);
+        return source_location{ &aUnits[e.unit], e.fragment, e.fragment->origin().offset + offset,
+            static_cast<std::uint32_t>(position.line + 1u), static_cast<std::uint32_t>(position.column + 1u) };
+    }
+
+    void source_map::update(std::vector<translation_unit> const& aUnits) const
+    {
+        iGeneration = source_fragment::generation();
+        iExtents.clear();
+        for (std::size_t unit = 0u; unit < aUnits.size(); ++unit)
+            for (auto const& fragment : aUnits[unit].fragments)
+            {
+                auto const source = fragment.source().to_std_string_view();
+                if (!source.empty())
+                    iExtents.push_back(extent{ source.data(), source.data() + source.size(), unit, &fragment });
+            }
+        std::sort(iExtents.begin(), iExtents.end(),
+            [](extent const& aLeft, extent const& aRight) { return std::less<char const*>{}(aLeft.begin, aRight.begin); });
+    }
+}
@@ -0,0 +1,173 @@
+/*
+  utf8.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <bit>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NEOS_UTF8_SSE2
+#include <emmintrin.h>
+#endif
+#include <neos/language/utf8.hpp>
+
+namespace neos::language
+{
+    namespace
+    {
+        // the position of the first byte from aPosition that isn't ASCII (aSize if none)
+        std::size_t skip_ascii(unsigned char const* aText, std::size_t aSize, std::size_t aPosition)
+        {
+#ifdef NEOS_UTF8_SSE2
+            for (; aPosition + 16u <= aSize; aPosition += 16u)
+            {
+                auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(aText + aPosition));
+                auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(block));
+                if (mask != 0u)
+                    return aPosition + static_cast<std::size_t>(std::countr_zero(mask));
+            }
+#endif
+            while (aPosition < aSize && aText[aPosition] < 0x80u)
+                ++aPosition;
+            return aPosition;
+        }
+
+        // the length of the valid sequence at aPosition (0 if it isn't valid)
+        std::size_t sequence_length(unsigned char const* aText, std::size_t aSize, std::size_t aPosition)
+        {
+            static constexpr char32_t MinimumCodePoint[] = { 0u, 0u, 0x80u, 0x800u, 0x10000u };
+            auto const lead = aText[aPosition];
+            std::size_t length = 0u;
+            if (lead < 0x80u)
+                return 1u;
+            else if ((lead & 0xE0u) == 0xC0u)
+                length = 2u;
+            else if ((lead & 0xF0u) == 0xE0u)
+                length = 3u;
+            else if ((lead & 0xF8u) == 0xF0u)
+                length = 4u;
+            else
+                return 0u;
+            if (aSize - aPosition < length)
+                return 0u;
+            char32_t codePoint = lead & (0x7Fu >> length);
+            for (std::size_t continuation = 1u; continuation < length; ++continuation)
+            {
+                auto const byte = aText[aPosition + continuation];
+                if ((byte & 0xC0u) != 0x80u)
+                    return 0u;
+                codePoint = (codePoint << 6u) | (byte & 0x3Fu);
+            }
+            if (codePoint < MinimumCodePoint[length] || codePoint > 0x10FFFFu || (codePoint >= 0xD800u && codePoint <= 0xDFFFu))
+                return 0u;
+            return length;
+        }
+    }
+
+    std::size_t text_index::line(std::size_t aOffset) const
+    {
+        auto const next = std::upper_bound(lineStarts.begin(), lineStarts.end(), aOffset);
+        return next == lineStarts.begin() ? 0u : static_cast<std::size_t>(next - lineStarts.begin()) - 1u;
+    }
+
+    text_index::position_type text_index::position(std::string_view const& aText, std::size_t aOffset) const
+    {
+        auto const lineIndex = line(aOffset);
+        auto const lineStart = (lineIndex < lineStarts.size() ? lineStarts[lineIndex] : 0u);
+        return position_type{ lineIndex, count_code_points(aText.substr(lineStart, aOffset - lineStart)) };
+    }
+
+    bool validate_utf8(std::string_view const& aText)
+    {
+        auto const text = reinterpret_cast<unsigned char const*>(aText.data());
+        auto const size = aText.size();
+        for (std::size_t position = skip_ascii(text, size, 0u); position < size; position = skip_ascii(text, size, position))
+        {
+            auto const length = sequence_length(text, size, position);
+            if (length == 0u)
+                return false;
+            position += length;
+        }
+        return true;
+    }
+
+    // A block of sixteen ASCII bytes is counted whole and its newlines found from a mask; a block
+    // with anything else in it is decoded a sequence at a time to its end.
+    text_index index_text(std::string_view const& aText)
+    {
+        text_index result;
+        result.lineStarts.push_back(0u);
+        auto const text = reinterpret_cast<unsigned char const*>(aText.data());
+        auto const size = aText.size();
+        std::size_t position = 0u;
+        while (position < size)
+        {
+            auto blockEnd = size;
+#ifdef NEOS_UTF8_SSE2
+            if (position + 16u <= size)
+            {
+                auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + position));
+                if (_mm_movemask_epi8(block) == 0)
+                {
+                    auto newlines = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+                    for (; newlines != 0u; newlines &= newlines - 1u)
+                        result.lineStarts.push_back(position + static_cast<std::size_t>(std::countr_zero(newlines)) + 1u);
+                    result.codePoints += 16u;
+                    position += 16u;
+                    continue;
+                }
+                blockEnd = position + 16u;
+            }
+#endif
+            while (position < blockEnd)
+            {
+                auto const length = sequence_length(text, size, position);
+                if (length == 0u)
+                    return result;
+                if (text[position] == '\n')
+                    result.lineStarts.push_back(position + 1u);
+                ++result.codePoints;
+                position += length;
+            }
+        }
+        result.valid = true;
+        return result;
+    }
+
+    // Every byte but a continuation byte (10xxxxxx, less than -64 as a signed char) starts a
+    // code point.
+    std::size_t count_code_points(std::string_view const& aText)
+    {
+        auto const text = reinterpret_cast<unsigned char const*>(aText.data());
+        auto const size = aText.size();
+        std::size_t result = 0u;
+        std::size_t position = 0u;
+#ifdef NEOS_UTF8_SSE2
+        for (; position + 16u <= size; position += 16u)
+        {
+            auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + position));
+            auto const starts = _mm_cmpgt_epi8(block, _mm_set1_epi8(-65));
+            result += static_cast<std::size_t>(std::popcount(static_cast<std::uint32_t>(_mm_movemask_epi8(starts))));
+        }
+#endif
+        for (; position < size; ++position)
+            if ((text[position] & 0xC0u) != 0x80u)
+                ++result;
+        return result;
+    }
+}
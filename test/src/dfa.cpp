@@ -0,0 +1,139 @@
+/*
+  dfa.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <random>
+#include <regex>
+#include <neos/language/dfa.hpp>
+#include "grammar_builder.hpp"
+#include "test.hpp"
+
+namespace
+{
+    using neos::language::code_parser::symbol;
+
+    // The token classes of a tokenizer stage like neoscript's, built both as schema rules and as
+    // the regular expressions they are meant to be equivalent to.
+    struct tokenizer
+    {
+        neos::test::grammar_builder builder;
+        std::vector<std::pair<symbol, std::regex>> classes;
+        std::shared_ptr<neos::language::code_parser::dfa> dfa;
+
+        tokenizer()
+        {
+            auto& b = builder;
+            b.rule("keyword", { b.alternation({ b.terminal("if"), b.terminal("else"), b.terminal("fn"), b.terminal("return"), b.terminal("while") }) });
+            b.rule("identifier", { b.ref("identifier start"), b.repetition({ b.alternation({ b.ref("identifier start"), b.ref("digit") }) }) });
+            b.rule("identifier start", { b.alternation({ b.range("A", "Z"), b.range("a", "z"), b.terminal("_") }) });
+            b.rule("positive integer", { b.ref("digit sequence") });
+            b.rule("positive real", { b.ref("digit sequence"), b.terminal("."), b.ref("digit sequence"),
+                b.optional({ b.alternation({ b.terminal("e"), b.terminal("E") }), b.optional({ b.alternation({ b.terminal("+"), b.terminal("-") }) }), b.ref("digit sequence") }) });
+            b.rule("digit sequence", { b.ref("digit"), b.repetition({ b.ref("digit") }) });
+            b.rule("digit", { b.range("0", "9") });
+            b.rule("whitespace", { b.repetition({ b.alternation({ b.terminal(" "), b.terminal("\t"), b.terminal("\r"), b.terminal("\n") }) }, true) });
+            auto const& grammar = b.finalize();
+            classes.emplace_back(b.intern("keyword"), std::regex{ "if|else|fn|return|while" });
+            classes.emplace_back(b.intern("identifier"), std::regex{ "[A-Za-z_][A-Za-z0-9_]*" });
+            classes.emplace_back(b.intern("positive integer"), std::regex{ "[0-9]+" });
+            classes.emplace_back(b.intern("positive real"), std::regex{ "[0-9]+\\.[0-9]+([eE][+-]?[0-9]+)?" });
+            classes.emplace_back(b.intern("whitespace"), std::regex{ "[ \t\r\n]+" });
+            // the symbols the classes are built from are stage symbols too
+            classes.emplace_back(b.intern("identifier start"), std::regex{ "[A-Za-z_]" });
+            classes.emplace_back(b.intern("digit sequence"), std::regex{ "[0-9]+" });
+            classes.emplace_back(b.intern("digit"), std::regex{ "[0-9]" });
+            NEOS_CHECK_EQUAL(classes.size(), grammar.stageSymbols.size());
+            dfa = neos::language::code_parser::dfa::compile(grammar, std::span<symbol const>{ grammar.stageSymbols });
+        }
+
+        // the longest match at aPosition of any of the classes and the classes matching all of it
+        std::pair<std::uint32_t, std::vector<symbol>> longest(std::string const& aSource, std::uint32_t aPosition) const
+        {
+            std::pair<std::uint32_t, std::vector<symbol>> result{ neos::language::code_parser::npos, {} };
+            for (auto end = static_cast<std::uint32_t>(aSource.size()); end > aPosition && result.second.empty(); --end)
+                for (auto const& c : classes)
+                    if (std::regex_match(aSource.begin() + aPosition, aSource.begin() + end, c.second))
+                    {
+                        result.first = end;
+                        result.second.push_back(c.first);
+                    }
+            std::sort(result.second.begin(), result.second.end());
+            return result;
+        }
+
+        void check_equivalent(std::string const& aSource) const
+        {
+            for (std::uint32_t position = 0u; position < aSource.size(); ++position)
+            {
+                auto const expected = longest(aSource, position);
+                neos::language::code_parser::dfa::state_index acceptState = neos::language::code_parser::dfa::DeadState;
+                auto const end = dfa->match(aSource, position, acceptState);
+                NEOS_CHECK_EQUAL(end, expected.first);
+                if (end == neos::language::code_parser::npos)
+                    continue;
+                auto const accepted = dfa->accepted_symbols(acceptState);
+                std::vector<symbol> symbols{ accepted.begin(), accepted.end() };
+                std::sort(symbols.begin(), symbols.end());
+                NEOS_CHECK(symbols == expected.second);
+            }
+        }
+    };
+
+    tokenizer const& the_tokenizer()
+    {
+        static tokenizer const sTokenizer;
+        return sTokenizer;
+    }
+}
+
+NEOS_TEST(dfa_matches_regex_on_keywords)
+{
+    for (auto const& source : { "if", "else", "fn", "return", "while", "iff", "els", "elsewhere", "f", "whileif", "return_", "if1", "_if" })
+        the_tokenizer().check_equivalent(source);
+}
+
+NEOS_TEST(dfa_matches_regex_on_identifiers)
+{
+    for (auto const& source : { "x", "_", "abc_123", "A9", "9A", "__init__", "camelCase snake_case", 
+        "an_identifier_longer_than_one_sixteen_byte_block_of_input_and_then_some" })
+        the_tokenizer().check_equivalent(source);
+}
+
+NEOS_TEST(dfa_matches_regex_on_numbers)
+{
+    for (auto const& source : { "0", "42", "3.14", "1.", ".5", "1.0e10", "1.0E+10", "1.0e-", "2.5e", "1e10", "12.34.56", 
+        "12345678901234567890123456789012345678901234567890", "0.00000000000000000000000000001e-99" })
+        the_tokenizer().check_equivalent(source);
+}
+
+NEOS_TEST(dfa_matches_regex_on_mixed_input)
+{
+    std::mt19937 random{ 42u };
+    std::string const alphabet{ "aeifln_rtwEZ0159.+- \t\n" };
+    for (int i = 0; i < 200; ++i)
+    {
+        std::string source;
+        auto const length = std::uniform_int_distribution<std::size_t>{ 1u, 40u }(random);
+        for (std::size_t j = 0u; j < length; ++j)
+            source += alphabet[std::uniform_int_distribution<std::size_t>{ 0u, alphabet.size() - 1u }(random)];
+        the_tokenizer().check_equivalent(source);
+    }
+}
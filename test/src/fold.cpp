@@ -0,0 +1,99 @@
+/*
+  fold.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <neos/context.hpp>
+#include "test.hpp"
+
+namespace
+{
+    std::string neoscript_schema()
+    {
+        return (std::filesystem::path{ __FILE__ }.parent_path() / "../../languages/neoscript.neos").lexically_normal().string();
+    }
+
+    // Compiles with neoscript's schema and the concept libraries installed alongside the tests;
+    // a fold that can't complete throws. Returns the folds (and skips) the compile traced in the
+    // order they were done.
+    std::vector<std::string> compile_neoscript(std::string const& aSource, bool aIncremental = false)
+    {
+        std::ostringstream output;
+        neos::context context{ output };
+        context.compiler().set_incremental(aIncremental);
+        context.compiler().set_trace(1u);
+        context.load_schema(neoscript_schema());
+        std::istringstream source{ aSource };
+        context.load_program(source);
+        context.compile_program();
+        for (auto const& unit : context.program().translationUnits)
+            for (auto const& fragment : unit.fragments)
+                NEOS_CHECK(fragment.status() == neos::language::compilation_status::Compiled);
+        std::vector<std::string> folds;
+        std::istringstream trace{ output.str() };
+        for (std::string line; std::getline(trace, line);)
+            if (line.rfind("Folding", 0) == 0 || line.rfind("Folded", 0) == 0 || line.rfind("Skipping", 0) == 0)
+                folds.push_back(line);
+        return folds;
+    }
+
+    std::string const nestedFunctions =
+        "namespace outer\n"
+        "{\n"
+        "    namespace inner\n"
+        "    {\n"
+        "        fn add(x, y : i32) -> i32\n"
+        "        {\n"
+        "            return x + y;\n"
+        "        }\n"
+        "\n"
+        "        fn fib(x : i32) -> i32\n"
+        "        {\n"
+        "            if (x < 2)\n"
+        "                return 1;\n"
+        "            else\n"
+        "                return add(fib(x-1), fib(x-2));\n"
+        "        }\n"
+        "    }\n"
+        "}\n";
+}
+
+// Functions nested in namespaces with calls nested in their bodies: folding them changes nodes
+// below the position the next pass resumes from, which a pass that only resumed could fail on.
+NEOS_TEST(fold_nested_neoscript_function)
+{
+    NEOS_CHECK(!compile_neoscript(nestedFunctions).empty());
+}
+
+// Every step looks from the bottom of the fold stack so the folds are done in the same order
+// however the AST was built: one top level piece parsed and emitted on its own folds as the
+// whole source does.
+NEOS_TEST(fold_order_is_the_same_for_an_incremental_compile)
+{
+    auto const whole = compile_neoscript(nestedFunctions);
+    auto const incremental = compile_neoscript(nestedFunctions, true);
+    NEOS_CHECK(!whole.empty());
+    NEOS_CHECK_EQUAL(incremental.size(), whole.size());
+    for (std::size_t i = 0u; i < whole.size() && i < incremental.size(); ++i)
+        NEOS_CHECK_EQUAL(incremental[i], whole[i]);
+}
@@ -0,0 +1,163 @@
+/*
+  grammar_builder.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <deque>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+
+namespace neos::test
+{
+    // Assembles a code parser grammar the way schema loading does, without a schema: ranges have
+    // their end points as terminal children and an operator table is a rule whose right hand side
+    // is a single Operators primitive.
+    class grammar_builder
+    {
+    public:
+        using primitive_index = language::code_parser::primitive_index;
+        using primitive_type = language::code_parser::primitive_type;
+        using symbol = language::code_parser::symbol;
+
+        struct operator_declaration
+        {
+            std::string text;
+            std::string semanticConcept;
+            std::uint32_t precedence;
+            bool rightAssociative = false;
+        };
+    public:
+        symbol intern(std::string_view const& aName)
+        {
+            auto existing = iSymbols.find(aName);
+            if (existing == iSymbols.end())
+            {
+                iNames.emplace_back(aName);
+                existing = iSymbols.emplace(iNames.back(), static_cast<symbol>(iSymbols.size())).first;
+            }
+            return existing->second;
+        }
+        primitive_index ref(std::string_view const& aName)
+        {
+            language::code_parser::primitive result{ primitive_type::Symbol };
+            result.symbol = intern(aName);
+            return add(std::move(result));
+        }
+        primitive_index terminal(std::string_view const& aText)
+        {
+            language::code_parser::primitive result{ primitive_type::Terminal };
+            result.text = aText;
+            return add(std::move(result));
+        }
+        primitive_index range(std::string_view const& aLow, std::string_view const& aHigh, bool aNegate = false)
+        {
+            auto const low = terminal(aLow);
+            auto const high = terminal(aHigh);
+            language::code_parser::primitive result{ primitive_type::Range };
+            result.negate = aNegate;
+            result.children = { low, high };
+            return add(std::move(result));
+        }
+        primitive_index concatenation(std::initializer_list<primitive_index> aChildren)
+        {
+            return compound(primitive_type::Concatenation, aChildren);
+        }
+        primitive_index alternation(std::initializer_list<primitive_index> aChildren)
+        {
+            return compound(primitive_type::Alternation, aChildren);
+        }
+        primitive_index repetition(std::initializer_list<primitive_index> aChildren, bool aAtLeastOne = false)
+        {
+            auto const result = compound(primitive_type::Repetition, aChildren);
+            iGrammar.primitives[result].atLeastOne = aAtLeastOne;
+            return result;
+        }
+        primitive_index optional(std::initializer_list<primitive_index> aChildren)
+        {
+            return compound(primitive_type::Optional, aChildren);
+        }
+        primitive_index tag(primitive_index aPrimitive, std::string_view const& aConcept)
+        {
+            iGrammar.primitives[aPrimitive].c.emplace(aConcept);
+            return aPrimitive;
+        }
+        primitive_index constrain(primitive_index aPrimitive, std::string_view const& aConstraint)
+        {
+            iGrammar.primitives[aPrimitive].constraint.emplace(aConstraint);
+            return aPrimitive;
+        }
+        void rule(std::string_view const& aName, std::initializer_list<primitive_index> aRhs, std::optional<std::string_view> const& aConcept = {})
+        {
+            auto const lhs = ref(aName);
+            if (aConcept)
+                tag(lhs, *aConcept);
+            iGrammar.rules.push_back(language::code_parser::rule{ lhs, aRhs });
+        }
+        void operators(std::string_view const& aExpression, std::string_view const& aOperand, std::optional<std::string_view> const& aSeparator, 
+            std::vector<operator_declaration> const& aOperators)
+        {
+            auto const lhs = ref(aExpression);
+            auto const table = add(language::code_parser::primitive{ primitive_type::Operators });
+            auto const operand = ref(aOperand);
+            auto const separator = aSeparator ? ref(*aSeparator) : terminal({});
+            iGrammar.primitives[table].children = { operand, separator };
+            for (auto const& o : aOperators)
+            {
+                auto const op = terminal(o.text);
+                tag(op, o.semanticConcept);
+                iGrammar.primitives[op].precedence = o.precedence;
+                iGrammar.primitives[op].rightAssociative = o.rightAssociative;
+                iGrammar.primitives[table].children.push_back(op);
+            }
+            iGrammar.rules.push_back(language::code_parser::rule{ lhs, { table } });
+        }
+        language::code_parser::grammar& finalize(std::unordered_set<std::string> const& aDiscard = {})
+        {
+            iGrammar.finalize(iSymbols, aDiscard);
+            return iGrammar;
+        }
+        language::code_parser::grammar& grammar()
+        {
+            return iGrammar;
+        }
+    private:
+        primitive_index add(language::code_parser::primitive&& aPrimitive)
+        {
+            return iGrammar.add(std::move(aPrimitive));
+        }
+        primitive_index compound(primitive_type aType, std::initializer_list<primitive_index> aChildren)
+        {
+            language::code_parser::primitive result{ aType };
+            result.children = aChildren;
+            return add(std::move(result));
+        }
+    private:
+        std::deque<std::string> iNames;
+        std::unordered_map<std::string_view, symbol> iSymbols;
+        language::code_parser::grammar iGrammar;
+    };
+}
@@ -0,0 +1,135 @@
+/*
+  incremental_parser.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <string>
+#include <neos/language/incremental_parser.hpp>
+#include "grammar_builder.hpp"
+#include "test.hpp"
+
+namespace
+{
+    using neos::test::grammar_builder;
+    using neos::language::code_parser::incremental_parser;
+    using neos::language::code_parser::source_edit;
+
+    // Statements that are numbers, a piece each as every one is terminated.
+    void build_statements(grammar_builder& b)
+    {
+        b.rule("whitespace", { b.repetition({ b.alternation({ b.terminal(" "), b.terminal("\n") }) }, true) }, "language.whitespace");
+        b.rule("WS", { b.optional({ b.ref("whitespace") }) });
+        b.rule("program", { b.ref("WS"), b.repetition({ b.ref("statement"), b.ref("WS") }) }, "language.program");
+        b.rule("statement", { b.ref("number"), b.ref("WS"), b.terminal(";") }, "language.statement");
+        b.rule("number", { b.range("0", "9"), b.repetition({ b.range("0", "9") }) }, "math.universal.number");
+        b.finalize({ "whitespace" });
+    }
+
+    neos::language::code_parser::split_hint statement_hint()
+    {
+        neos::language::code_parser::split_hint hint;
+        hint.terminators = { ";" };
+        return hint;
+    }
+
+    // Counts the statements a piece's AST has.
+    class statement_counter : public neos::language::code_parser::i_ast_sink
+    {
+    public:
+        statement_counter(neos::language::code_parser::grammar const& aGrammar) : iGrammar{ aGrammar } {}
+    public:
+        void open_node(neos::language::code_parser::primitive_index, std::string_view const&) final {}
+        void close_node(neos::language::code_parser::primitive_index aConcept, std::string_view const& aValue) final
+        {
+            if (aConcept != neos::language::code_parser::npos && *iGrammar.primitives[aConcept].c == "language.statement")
+                statements += std::string{ aValue };
+        }
+    public:
+        std::string statements;
+    private:
+        neos::language::code_parser::grammar const& iGrammar;
+    };
+
+    // the parser's views are of the edited source so it is edited in place
+    incremental_parser::damage reparse(incremental_parser& aParser, std::string& aSource, std::size_t aOffset, std::size_t aLength, std::string const& aReplacement)
+    {
+        aSource.replace(aOffset, aLength, aReplacement);
+        NEOS_CHECK(aParser.reparse(aSource, source_edit{ aOffset, aLength, aReplacement.size() }));
+        return aParser.last_damage();
+    }
+}
+
+// Only the piece an edit is in is parsed again; those either side of it are kept.
+NEOS_TEST(incremental_parser_reparses_the_edited_piece)
+{
+    grammar_builder b;
+    build_statements(b);
+    std::string source = "1; 2; 3; 4;";
+    incremental_parser parser{ b.grammar(), b.intern("program"), statement_hint() };
+    NEOS_CHECK(parser.parse(source));
+    NEOS_CHECK_EQUAL(parser.piece_count(), 4u);
+    auto const damage = reparse(parser, source, 6u, 1u, "33");
+    NEOS_CHECK_EQUAL(parser.piece_count(), 4u);
+    NEOS_CHECK_EQUAL(damage.first, 2u);
+    NEOS_CHECK_EQUAL(damage.removed, 1u);
+    NEOS_CHECK_EQUAL(damage.inserted, 1u);
+    NEOS_CHECK_EQUAL(damage.reparsed, 1u);
+    NEOS_CHECK_EQUAL(parser.piece_at(source.find("33")), 2u);
+    NEOS_CHECK_EQUAL(parser.piece_at(source.find('4')), 3u);
+    statement_counter counter{ b.grammar() };
+    for (std::size_t piece = 0u; piece < parser.piece_count(); ++piece)
+        parser.create_ast(counter, piece);
+    NEOS_CHECK_EQUAL(counter.statements, "1;2;33;4;");
+}
+
+// Splitting a piece in two replaces one piece by two; the pieces after it move.
+NEOS_TEST(incremental_parser_damage_covers_split_pieces)
+{
+    grammar_builder b;
+    build_statements(b);
+    std::string source = "1; 2; 3;";
+    incremental_parser parser{ b.grammar(), b.intern("program"), statement_hint() };
+    NEOS_CHECK(parser.parse(source));
+    auto const damage = reparse(parser, source, 4u, 0u, "; 5");
+    NEOS_CHECK_EQUAL(parser.piece_count(), 4u);
+    NEOS_CHECK_EQUAL(damage.first, 1u);
+    NEOS_CHECK_EQUAL(damage.removed, 1u);
+    NEOS_CHECK_EQUAL(damage.inserted, 2u);
+    NEOS_CHECK_EQUAL(damage.reparsed, 2u);
+}
+
+// An edit reaching past the end of the source is refused before anything is reparsed.
+NEOS_TEST(incremental_parser_refuses_an_edit_outside_the_source)
+{
+    grammar_builder b;
+    build_statements(b);
+    std::string const source = "1; 2;";
+    incremental_parser parser{ b.grammar(), b.intern("program"), statement_hint() };
+    NEOS_CHECK(parser.parse(source));
+    bool refused = false;
+    try
+    {
+        parser.reparse("1;", source_edit{ 3u, 10u, 0u });
+    }
+    catch (incremental_parser::bad_edit const&)
+    {
+        refused = true;
+    }
+    NEOS_CHECK(refused);
+    NEOS_CHECK_EQUAL(parser.piece_count(), 2u);
+}
@@ -0,0 +1,102 @@
+/*
+  keyword_table.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <neos/language/code_parser.hpp>
+#include "test.hpp"
+
+namespace
+{
+    using neos::language::code_parser::keyword_table;
+    using neos::language::code_parser::symbol;
+
+    // neoscript's keywords (the constrained rules over its potential keyword symbol)
+    std::vector<std::string> const sKeywords = 
+    {
+        "using", "import", "namespace", "public", "protected", "private", "override", "final", "mutable", "is",
+        "extends", "implements", "struct", "class", "interface", "auto", "def", "fn", "proc", "in", "out", "inout",
+        "if", "else", "for", "while", "do", "return", "isize", "usize", "bool", "i8", "u8", "i16", "u16", "i32",
+        "u32", "i64", "u64", "float", "double", "char", "string", "true", "false"
+    };
+
+    keyword_table make_table()
+    {
+        keyword_table table;
+        for (std::size_t k = 0u; k < sKeywords.size(); ++k)
+        {
+            auto& entry = table.entries.emplace_back();
+            entry.text = sKeywords[k];
+            entry.symbols.push_back(static_cast<symbol>(k));
+        }
+        table.build();
+        return table;
+    }
+}
+
+NEOS_TEST(keyword_table_finds_every_keyword)
+{
+    auto const table = make_table();
+    NEOS_CHECK(table.slots.size() >= table.entries.size());
+    for (std::size_t k = 0u; k < sKeywords.size(); ++k)
+    {
+        auto const found = table.find(sKeywords[k]);
+        NEOS_CHECK_EQUAL(found.size(), 1u);
+        NEOS_CHECK(found[0] == static_cast<symbol>(k));
+    }
+}
+
+NEOS_TEST(keyword_table_rejects_near_misses)
+{
+    auto const table = make_table();
+    for (auto const& keyword : sKeywords)
+    {
+        // a prefix, an extension, a changed case and a changed last character of each keyword
+        std::vector<std::string> nearMisses = { keyword.substr(0u, keyword.size() - 1u), keyword + "_", keyword + keyword.back(), "_" + keyword };
+        auto changedCase = keyword;
+        changedCase[0] = static_cast<char>(changedCase[0] ^ 0x20);
+        nearMisses.push_back(changedCase);
+        auto changedLast = keyword;
+        changedLast.back() = static_cast<char>(changedLast.back() + 1);
+        nearMisses.push_back(changedLast);
+        for (auto const& nearMiss : nearMisses)
+            if (std::find(sKeywords.begin(), sKeywords.end(), nearMiss) == sKeywords.end())
+                NEOS_CHECK(table.find(nearMiss).empty());
+    }
+    for (auto const& other : { "", "x", "identifier", "fnn", "i128", "u", "returns", "elseif", "inoutout" })
+        NEOS_CHECK(table.find(other).empty());
+}
+
+NEOS_TEST(keyword_table_keeps_every_symbol_of_a_shared_keyword)
+{
+    keyword_table table;
+    auto& entry = table.entries.emplace_back();
+    entry.text = "in";
+    entry.symbols = { static_cast<symbol>(3u), static_cast<symbol>(7u) };
+    table.entries.emplace_back().text = "out";
+    table.entries.back().symbols = { static_cast<symbol>(4u) };
+    table.build();
+    auto const found = table.find("in");
+    NEOS_CHECK_EQUAL(found.size(), 2u);
+    NEOS_CHECK(found[0] == static_cast<symbol>(3u) && found[1] == static_cast<symbol>(7u));
+    NEOS_CHECK(table.find("inout").empty());
+}
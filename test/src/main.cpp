@@ -0,0 +1,48 @@
+/*
+  main.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <iostream>
+#include <string_view>
+#include "test.hpp"
+
+int main(int argc, char* argv[])
+{
+    std::string_view const filter{ argc > 1 ? argv[1] : "" };
+    std::size_t run = 0u;
+    std::size_t failed = 0u;
+    for (auto const& test : neos::test::tests())
+    {
+        if (!filter.empty() && std::string_view{ test.name }.find(filter) == std::string_view::npos)
+            continue;
+        ++run;
+        try
+        {
+            test.function();
+        }
+        catch (std::exception const& e)
+        {
+            ++failed;
+            std::cerr << test.name << ": " << e.what() << std::endl;
+        }
+    }
+    std::cout << run - failed << " of " << run << " test(s) passed" << std::endl;
+    return failed == 0u ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+/*
+  operators.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <string>
+#include <neos/language/code_parser.hpp>
+#include <neos/language/dfa.hpp>
+#include "grammar_builder.hpp"
+#include "test.hpp"
+
+namespace
+{
+    using neos::test::grammar_builder;
+
+    // The Calculator schema's stages as one grammar with its operator table, optionally with a
+    // right associative level above its two left associative ones.
+    void build_calculator(grammar_builder& b, bool aPower = false)
+    {
+        b.rule("whitespace", { b.repetition({ b.alternation({ b.terminal(" "), b.terminal("\n"), b.terminal("\r"), b.terminal("\t") }) }, true) }, "language.whitespace");
+        b.rule("exponent", { b.alternation({ b.terminal("e"), b.terminal("E") }), b.optional({ b.alternation({ b.terminal("+"), b.terminal("-") }) }), b.ref("digit sequence") });
+        b.rule("digit sequence", { b.ref("digit"), b.repetition({ b.ref("digit") }) });
+        b.rule("digit", { b.range("0", "9") });
+        b.rule("program", { b.ref("WS"), b.ref("statement"), b.ref("WS") }, "language.program");
+        b.rule("statement", { b.repetition({ b.ref("expression"), b.ref("WS"), b.terminal(";") }) }, "language.statement");
+        b.rule("factor", { b.optional({ b.tag(b.terminal("-"), "math.operator.negate") }), b.ref("WS"), b.ref("primary") });
+        b.rule("primary", { b.alternation({ b.concatenation({ b.terminal("("), b.ref("WS"), b.ref("expression"), b.ref("WS"), b.terminal(")") }), b.ref("number") }) });
+        b.rule("number", { b.ref("digit sequence"), b.optional({ b.terminal("."), b.ref("digit sequence"), b.optional({ b.ref("exponent") }) }) }, "math.universal.number");
+        b.rule("WS", { b.optional({ b.ref("whitespace") }) });
+        b.rule("punctuation", { b.alternation({ b.terminal("+"), b.terminal("-"), b.terminal("*"), b.terminal("/"), b.terminal("^"),
+            b.terminal("("), b.terminal(")"), b.terminal(";") }) });
+        std::vector<grammar_builder::operator_declaration> operators = 
+        {
+            { "+", "math.operator.add", 1u },
+            { "-", "math.operator.subtract", 1u },
+            { "*", "math.operator.multiply", 2u },
+            { "/", "math.operator.divide", 2u }
+        };
+        if (aPower)
+            operators.push_back({ "^", "math.operator.power", 3u, true });
+        b.operators("expression", "factor", "WS", operators);
+        b.finalize({ "whitespace" });
+    }
+
+    // The leaves of an AST in the order they fold: numbers by value and operators by the last part
+    // of their concept name.
+    void append_postfix(neos::language::code_parser::ast_node const& aNode, std::string& aResult)
+    {
+        if (aNode.c && aNode.children.empty())
+        {
+            if (!aResult.empty())
+                aResult += ' ';
+            std::string_view const c{ *aNode.c };
+            if (c == "math.universal.number")
+                aResult += aNode.value;
+            else
+                aResult += c.substr(c.rfind('.') + 1u);
+        }
+        for (auto const* child : aNode.children)
+            append_postfix(*child, aResult);
+    }
+
+    std::string postfix(std::string const& aSource, bool aPower = false)
+    {
+        grammar_builder b;
+        build_calculator(b, aPower);
+        neos::language::code_parser::engine engine{ b.grammar() };
+        if (!engine.parse(b.intern("program"), aSource))
+            return "(no parse)";
+        engine.create_ast();
+        std::string result;
+        append_postfix(engine.ast(), result);
+        return result;
+    }
+
+    // Parses as the final stage after a tokenizer stage, checking that the tokens were consumed
+    // and that the parse and its trivia match parsing the bytes.
+    void check_token_stream(std::string const& aSource)
+    {
+        grammar_builder b;
+        build_calculator(b);
+        auto const& grammar = b.grammar();
+        std::vector<neos::language::code_parser::symbol> const tokenSymbols{ b.intern("whitespace"), b.intern("number"), b.intern("punctuation") };
+        auto const tokenizer = neos::language::code_parser::dfa::compile(grammar, tokenSymbols);
+        neos::language::code_parser::token_stream tokens;
+        NEOS_CHECK(tokenizer->tokenize(aSource, tokens));
+        neos::language::code_parser::engine bytes{ grammar };
+        neos::language::code_parser::engine consumer{ grammar };
+        NEOS_CHECK(bytes.parse(b.intern("program"), aSource));
+        NEOS_CHECK(consumer.parse(b.intern("program"), aSource, tokens));
+        NEOS_CHECK(consumer.statistics().tokenHits > 0u);
+        bytes.create_ast();
+        consumer.create_ast();
+        std::string expected;
+        std::string actual;
+        append_postfix(bytes.ast(), expected);
+        append_postfix(consumer.ast(), actual);
+        NEOS_CHECK_EQUAL(actual, expected);
+        NEOS_CHECK_EQUAL(consumer.trivia().size(), bytes.trivia().size());
+        for (std::size_t i = 0u; i < std::min(consumer.trivia().size(), bytes.trivia().size()); ++i)
+        {
+            NEOS_CHECK_EQUAL(consumer.trivia()[i].begin, bytes.trivia()[i].begin);
+            NEOS_CHECK_EQUAL(consumer.trivia()[i].end, bytes.trivia()[i].end);
+        }
+    }
+}
+
+NEOS_TEST(operators_are_left_associative)
+{
+    NEOS_CHECK_EQUAL(postfix("1 - 2 - 3;"), "1 2 subtract 3 subtract");
+    NEOS_CHECK_EQUAL(postfix("8 / 4 / 2;"), "8 4 divide 2 divide");
+    NEOS_CHECK_EQUAL(postfix("1 + 2 - 3 + 4;"), "1 2 add 3 subtract 4 add");
+    NEOS_CHECK_EQUAL(postfix("1 * 2 / 3 * 4;"), "1 2 multiply 3 divide 4 multiply");
+}
+
+NEOS_TEST(operators_bind_by_precedence)
+{
+    NEOS_CHECK_EQUAL(postfix("1 + 2 * 3;"), "1 2 3 multiply add");
+    NEOS_CHECK_EQUAL(postfix("1 * 2 + 3;"), "1 2 multiply 3 add");
+    NEOS_CHECK_EQUAL(postfix("1 - 2 / 3 + 4;"), "1 2 3 divide subtract 4 add");
+    NEOS_CHECK_EQUAL(postfix("1 * 2 + 3 * 4;"), "1 2 multiply 3 4 multiply add");
+    NEOS_CHECK_EQUAL(postfix("1+2*3-4/5;"), "1 2 3 multiply add 4 5 divide subtract");
+}
+
+NEOS_TEST(operators_respect_parentheses)
+{
+    NEOS_CHECK_EQUAL(postfix("(1 + 2) * 3;"), "1 2 add 3 multiply");
+    NEOS_CHECK_EQUAL(postfix("1 - (2 - 3);"), "1 2 3 subtract subtract");
+    NEOS_CHECK_EQUAL(postfix("((1));"), "1");
+    NEOS_CHECK_EQUAL(postfix("2 * (3 + 4) * 5;"), "2 3 4 add multiply 5 multiply");
+}
+
+NEOS_TEST(operators_right_associative_level)
+{
+    NEOS_CHECK_EQUAL(postfix("2 ^ 3 ^ 4;", true), "2 3 4 power power");
+    NEOS_CHECK_EQUAL(postfix("2 * 3 ^ 4;", true), "2 3 4 power multiply");
+    NEOS_CHECK_EQUAL(postfix("2 ^ 3 * 4;", true), "2 3 power 4 multiply");
+    NEOS_CHECK_EQUAL(postfix("1 - 2 ^ 3 ^ 4 - 5;", true), "1 2 3 4 power power subtract 5 subtract");
+}
+
+NEOS_TEST(operators_with_several_statements)
+{
+    NEOS_CHECK_EQUAL(postfix("1 + 2; 3 * 4 - 5;"), "1 2 add 3 4 multiply 5 subtract");
+    NEOS_CHECK_EQUAL(postfix("1.5e2 * 2;"), "1.5e2 2 multiply");
+}
+
+NEOS_TEST(operators_over_a_token_stream)
+{
+    check_token_stream("1 + 2 * 3;");
+    check_token_stream("  (1 - 2)\t*\n3 ;  4/5;\n");
+    check_token_stream("1.5e2*2;");
+}
@@ -0,0 +1,123 @@
+/*
+  reparse.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <neos/neos.hpp>
+#include <filesystem>
+#include <sstream>
+#include <neos/context.hpp>
+#include "test.hpp"
+
+namespace
+{
+    std::string neoscript_schema()
+    {
+        return (std::filesystem::path{ __FILE__ }.parent_path() / "../../languages/neoscript.neos").lexically_normal().string();
+    }
+
+    neos::language::i_scope const* find_child(neos::language::i_scope const& aScope, std::string const& aName)
+    {
+        for (auto const& child : aScope.children())
+            if (child->name().to_std_string() == aName)
+                return &*child;
+        return nullptr;
+    }
+
+    std::string const source =
+        "namespace a\n"
+        "{\n"
+        "    fn f(x : i32) -> i32\n"
+        "    {\n"
+        "        return x;\n"
+        "    }\n"
+        "}\n"
+        "namespace b\n"
+        "{\n"
+        "    fn g(x : i32) -> i32\n"
+        "    {\n"
+        "        return x;\n"
+        "    }\n"
+        "}\n";
+}
+
+// Renaming a function reparses and folds only the namespace it is in: the function's old scope
+// goes and the other namespace's scopes are those its first compile made.
+NEOS_TEST(reparse_replaces_the_scopes_of_the_edited_declaration)
+{
+    std::ostringstream output;
+    neos::context context{ output };
+    context.compiler().set_incremental(true);
+    context.load_schema(neoscript_schema());
+    std::istringstream stream{ source };
+    context.load_program(stream);
+    context.compile_program();
+    auto& program = context.program();
+    auto& unit = program.translationUnits.front();
+    auto& fragment = unit.fragments.front();
+    auto const& parser = context.compiler().incremental_parser(fragment);
+    NEOS_CHECK_EQUAL(parser.piece_count(), 2u);
+    auto const* const a = find_child(program.scope, "a");
+    NEOS_CHECK(a != nullptr);
+    auto const* const f = find_child(*a, "f");
+    NEOS_CHECK(f != nullptr);
+    NEOS_CHECK(find_child(program.scope, "b") != nullptr);
+
+    auto const offset = source.find("fn g") + 3u;
+    NEOS_CHECK(context.compiler().reparse(program, unit, fragment, offset, 1u, "h"));
+    NEOS_CHECK(fragment.status() == neos::language::compilation_status::Compiled);
+    NEOS_CHECK_EQUAL(parser.last_damage().first, 1u);
+    NEOS_CHECK_EQUAL(parser.last_damage().removed, 1u);
+    NEOS_CHECK_EQUAL(parser.last_damage().inserted, 1u);
+    NEOS_CHECK_EQUAL(parser.last_damage().reparsed, 1u);
+
+    NEOS_CHECK_EQUAL(program.scope.children().size(), 2u);
+    NEOS_CHECK(find_child(program.scope, "a") == a);
+    NEOS_CHECK_EQUAL(a->children().size(), 1u);
+    NEOS_CHECK(find_child(*a, "f") == f);
+    auto const* const b = find_child(program.scope, "b");
+    NEOS_CHECK(b != nullptr);
+    NEOS_CHECK_EQUAL(b->children().size(), 1u);
+    NEOS_CHECK(find_child(*b, "g") == nullptr);
+    NEOS_CHECK(find_child(*b, "h") != nullptr);
+}
+
+// An edit reaching past the end of the fragment's source is refused and the source kept.
+NEOS_TEST(reparse_refuses_an_edit_outside_the_source)
+{
+    std::ostringstream output;
+    neos::context context{ output };
+    context.compiler().set_incremental(true);
+    context.load_schema(neoscript_schema());
+    std::istringstream stream{ source };
+    context.load_program(stream);
+    context.compile_program();
+    auto& program = context.program();
+    auto& unit = program.translationUnits.front();
+    auto& fragment = unit.fragments.front();
+    bool refused = false;
+    try
+    {
+        context.compiler().reparse(program, unit, fragment, source.size() - 1u, 2u, "");
+    }
+    catch (neos::language::compiler::bad_edit const&)
+    {
+        refused = true;
+    }
+    NEOS_CHECK(refused);
+    NEOS_CHECK(fragment.source().to_std_string_view() == source);
+}
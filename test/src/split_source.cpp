@@ -0,0 +1,152 @@
+/*
+  split_source.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <numeric>
+#include <string>
+#include <neos/language/parallel_parser.hpp>
+#include "test.hpp"
+
+namespace
+{
+    using neos::language::code_parser::split_hint;
+    using neos::language::code_parser::split_source;
+
+    // neoscript's split hint with the smallest piece size so that every top level boundary is a
+    // cut point.
+    split_hint neoscript_hint()
+    {
+        split_hint hint;
+        hint.scopes = { { "{", "}" } };
+        hint.brackets = { { "(", ")" }, { "[", "]" } };
+        hint.terminators = { ";" };
+        hint.quotes = { "\"", "'" };
+        hint.escape = "\\";
+        hint.lineComments = { "//" };
+        hint.blockComments = { { "/*", "*/" } };
+        hint.pieceSize = 1u;
+        return hint;
+    }
+
+    std::vector<std::string> split(std::string_view const& aSource, split_hint const& aHint = neoscript_hint())
+    {
+        auto const pieces = split_source(aSource, aHint);
+        std::vector<std::string> result;
+        std::size_t next = 0u;
+        for (auto const& piece : pieces)
+        {
+            // the pieces are contiguous and cover the whole source
+            NEOS_CHECK(piece.data() == aSource.data() + next);
+            next += piece.size();
+            result.emplace_back(piece);
+        }
+        NEOS_CHECK_EQUAL(next, aSource.size());
+        return result;
+    }
+}
+
+NEOS_TEST(split_source_cuts_at_top_level_boundaries)
+{
+    auto const pieces = split("fn a() { x; } fn b() { y; } z;");
+    NEOS_CHECK_EQUAL(pieces.size(), 3u);
+    NEOS_CHECK_EQUAL(pieces[0], "fn a() { x; }");
+    NEOS_CHECK_EQUAL(pieces[1], " fn b() { y; }");
+    NEOS_CHECK_EQUAL(pieces[2], " z;");
+}
+
+NEOS_TEST(split_source_ignores_nested_scopes)
+{
+    auto const pieces = split("namespace n { fn a() { if (x) { y; } } } fn b() { { { } } }");
+    NEOS_CHECK_EQUAL(pieces.size(), 2u);
+    NEOS_CHECK_EQUAL(pieces[0], "namespace n { fn a() { if (x) { y; } } }");
+    NEOS_CHECK_EQUAL(pieces[1], " fn b() { { { } } }");
+}
+
+NEOS_TEST(split_source_ignores_brackets)
+{
+    // a terminator inside brackets is not at the top level
+    auto const pieces = split("f(a; b); g[c; d];");
+    NEOS_CHECK_EQUAL(pieces.size(), 2u);
+    NEOS_CHECK_EQUAL(pieces[0], "f(a; b);");
+}
+
+NEOS_TEST(split_source_ignores_quotes)
+{
+    auto const pieces = split("s = \"}; {\"; t = '}'; u = \"\\\"}\"; v;");
+    NEOS_CHECK_EQUAL(pieces.size(), 4u);
+    NEOS_CHECK_EQUAL(pieces[0], "s = \"}; {\";");
+    NEOS_CHECK_EQUAL(pieces[1], " t = '}';");
+    NEOS_CHECK_EQUAL(pieces[2], " u = \"\\\"}\";");
+    NEOS_CHECK_EQUAL(pieces[3], " v;");
+}
+
+NEOS_TEST(split_source_ignores_comments)
+{
+    auto const pieces = split("a; /* b; } { c; */ d; // e; }\nf;");
+    NEOS_CHECK_EQUAL(pieces.size(), 3u);
+    NEOS_CHECK_EQUAL(pieces[0], "a;");
+    NEOS_CHECK_EQUAL(pieces[1], " /* b; } { c; */ d;");
+    NEOS_CHECK_EQUAL(pieces[2], " // e; }\nf;");
+}
+
+NEOS_TEST(split_source_keeps_a_scope_open_across_a_quote_or_comment)
+{
+    // the closing brace in the quote and in the comment must not end the scope
+    auto const pieces = split("fn a() { s = \"}\"; /* } */ // }\n t; } b;");
+    NEOS_CHECK_EQUAL(pieces.size(), 2u);
+    NEOS_CHECK_EQUAL(pieces[0], "fn a() { s = \"}\"; /* } */ // }\n t; }");
+    NEOS_CHECK_EQUAL(pieces[1], " b;");
+}
+
+NEOS_TEST(split_source_keeps_trailing_trivia_with_the_last_piece)
+{
+    auto const pieces = split("a; b; /* trailing */ // comment\n  ");
+    NEOS_CHECK_EQUAL(pieces.size(), 2u);
+    NEOS_CHECK_EQUAL(pieces[1], " b; /* trailing */ // comment\n  ");
+}
+
+NEOS_TEST(split_source_unterminated_quote_and_comment)
+{
+    NEOS_CHECK_EQUAL(split("a; \"b; c;").size(), 2u);
+    NEOS_CHECK_EQUAL(split("a; /* b; c;").size(), 1u);
+}
+
+NEOS_TEST(split_source_honours_piece_size)
+{
+    auto hint = neoscript_hint();
+    hint.pieceSize = 8u;
+    auto const pieces = split("a; b; c; d; e; f; g;", hint);
+    for (std::size_t p = 0u; p + 1u < pieces.size(); ++p)
+        NEOS_CHECK(pieces[p].size() >= hint.pieceSize);
+    NEOS_CHECK_EQUAL(std::accumulate(pieces.begin(), pieces.end(), std::string{}), "a; b; c; d; e; f; g;");
+}
+
+NEOS_TEST(split_source_by_indentation)
+{
+    auto hint = neoscript_hint();
+    hint.scopes.clear();
+    hint.terminators.clear();
+    hint.lineComments = { "#" };
+    hint.blockComments.clear();
+    hint.indentation = true;
+    auto const pieces = split("def a():\n    x = (1,\n2)\n# comment\n    y\ndef b():\n    s = \"\"\"\nz\"\"\"\n", hint);
+    NEOS_CHECK_EQUAL(pieces.size(), 2u);
+    NEOS_CHECK_EQUAL(pieces[0], "def a():\n    x = (1,\n2)\n# comment\n    y\n");
+}
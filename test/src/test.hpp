@@ -0,0 +1,82 @@
+/*
+  test.hpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <neos/neos.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace neos::test
+{
+    struct test_case
+    {
+        char const* name;
+        void(*function)();
+    };
+
+    struct failure : std::runtime_error
+    {
+        failure(std::string const& aWhat) : std::runtime_error{ aWhat } {}
+    };
+
+    inline std::vector<test_case>& tests()
+    {
+        static std::vector<test_case> sTests;
+        return sTests;
+    }
+
+    struct registrar
+    {
+        registrar(char const* aName, void(*aFunction)())
+        {
+            tests().push_back(test_case{ aName, aFunction });
+        }
+    };
+
+    inline void check(bool aCondition, char const* aExpression, char const* aFile, int aLine)
+    {
+        if (aCondition)
+            return;
+        std::ostringstream message;
+        message << aFile << "(" << aLine << "): check failed: " << aExpression;
+        throw failure{ message.str() };
+    }
+
+    template <typename T1, typename T2>
+    inline void check_equal(T1 const& aActual, T2 const& aExpected, char const* aExpression, char const* aFile, int aLine)
+    {
+        if (aActual == aExpected)
+            return;
+        std::ostringstream message;
+        message << aFile << "(" << aLine << "): check failed: " << aExpression << " (got '" << aActual << "', expected '" << aExpected << "')";
+        throw failure{ message.str() };
+    }
+}
+
+#define NEOS_TEST(name) \
+    static void name(); \
+    static neos::test::registrar const name##_registrar{ #name, &name }; \
+    static void name()
+
+#define NEOS_CHECK(condition) neos::test::check((condition), #condition, __FILE__, __LINE__)
+#define NEOS_CHECK_EQUAL(actual, expected) neos::test::check_equal((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
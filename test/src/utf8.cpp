@@ -0,0 +1,148 @@
+/*
+  utf8.cpp
+
+  Copyright (c) 2025 Leigh Johnston.  All Rights Reserved.
+
+  This program is free software: you can redistribute it and / or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <neos/neos.hpp>
+#include <string>
+#include <neos/language/utf8.hpp>
+#include "test.hpp"
+
+namespace
+{
+    using neos::language::validate_utf8;
+    using neos::language::index_text;
+
+    // Validators work sixteen bytes at a time so place a sequence at every offset either side of
+    // a block boundary, ASCII around it, and at the very end of the text.
+    template <typename Check>
+    void at_every_offset(std::string const& aSequence, Check aCheck)
+    {
+        for (std::size_t offset = 0u; offset <= 40u; ++offset)
+        {
+            std::string const text = std::string(offset, 'a') + aSequence + std::string(40u - offset % 17u, 'b');
+            aCheck(text);
+            aCheck(std::string(offset, 'a') + aSequence);
+        }
+    }
+
+    void check_valid(std::string const& aSequence)
+    {
+        at_every_offset(aSequence, [](std::string const& aText)
+        {
+            NEOS_CHECK(validate_utf8(aText));
+            NEOS_CHECK(index_text(aText).valid);
+        });
+    }
+
+    void check_invalid(std::string const& aSequence)
+    {
+        at_every_offset(aSequence, [](std::string const& aText)
+        {
+            NEOS_CHECK(!validate_utf8(aText));
+            NEOS_CHECK(!index_text(aText).valid);
+        });
+    }
+}
+
+NEOS_TEST(utf8_accepts_valid_sequences)
+{
+    check_valid("");
+    check_valid("\x7F");
+    check_valid("\xC2\x80");                // U+0080, the smallest two byte sequence
+    check_valid("\xDF\xBF");                // U+07FF
+    check_valid("\xE0\xA0\x80");            // U+0800, the smallest three byte sequence
+    check_valid("\xED\x9F\xBF");            // U+D7FF, just below the surrogates
+    check_valid("\xEE\x80\x80");            // U+E000, just above them
+    check_valid("\xEF\xBF\xBF");            // U+FFFF
+    check_valid("\xF0\x90\x80\x80");        // U+10000, the smallest four byte sequence
+    check_valid("\xF4\x8F\xBF\xBF");        // U+10FFFF, the largest code point
+    check_valid("\xE2\x82\xAC\xF0\x9F\x98\x80\xC3\xA9");
+}
+
+NEOS_TEST(utf8_rejects_overlong_forms)
+{
+    check_invalid("\xC0\x80");              // U+0000 in two bytes
+    check_invalid("\xC1\xBF");              // U+007F in two bytes
+    check_invalid("\xE0\x80\x80");          // U+0000 in three bytes
+    check_invalid("\xE0\x9F\xBF");          // U+07FF in three bytes
+    check_invalid("\xF0\x80\x80\x80");      // U+0000 in four bytes
+    check_invalid("\xF0\x8F\xBF\xBF");      // U+FFFF in four bytes
+}
+
+NEOS_TEST(utf8_rejects_surrogates)
+{
+    check_invalid("\xED\xA0\x80");          // U+D800
+    check_invalid("\xED\xAF\xBF");          // U+DBFF
+    check_invalid("\xED\xB0\x80");          // U+DC00
+    check_invalid("\xED\xBF\xBF");          // U+DFFF
+    check_invalid("\xED\xA0\xBD\xED\xB8\x80"); // a surrogate pair as CESU-8 has it
+}
+
+NEOS_TEST(utf8_rejects_code_points_past_the_last)
+{
+    check_invalid("\xF4\x90\x80\x80");      // U+110000
+    check_invalid("\xF7\xBF\xBF\xBF");
+    check_invalid("\xF8\x88\x80\x80\x80");  // five and six byte forms
+    check_invalid("\xFC\x84\x80\x80\x80\x80");
+    check_invalid("\xFE");
+    check_invalid("\xFF");
+}
+
+NEOS_TEST(utf8_rejects_truncated_sequences)
+{
+    check_invalid("\xC2");
+    check_invalid("\xE2\x82");
+    check_invalid("\xF0\x9F\x98");
+    check_invalid("\xF0\x9F");
+    check_invalid("\xF0");
+    // a continuation byte with no lead and a lead cut short by the next lead or by ASCII
+    check_invalid("\x80");
+    check_invalid("\xBF\xBF");
+    check_invalid("\xE2\x82\xC3\xA9");
+    check_invalid("\xF0\x9F\x98" "a");
+}
+
+NEOS_TEST(utf8_truncated_at_end_of_a_block)
+{
+    // a multibyte sequence cut off by the end of the text just as a block ends
+    for (std::size_t length = 1u; length <= 48u; ++length)
+    {
+        std::string const text = std::string(length, 'x') + "\xF0\x9F\x98\x80";
+        NEOS_CHECK(validate_utf8(text));
+        for (std::size_t cut = 1u; cut < 4u; ++cut)
+        {
+            auto const truncated = text.substr(0u, length + cut);
+            NEOS_CHECK(!validate_utf8(truncated));
+            NEOS_CHECK(!index_text(truncated).valid);
+        }
+    }
+}
+
+NEOS_TEST(utf8_index_counts_and_finds_lines)
+{
+    std::string const text = std::string(15u, 'a') + "\xC3\xA9\n" + std::string(20u, 'b') + "\n\xE2\x82\xAC";
+    auto const index = index_text(text);
+    NEOS_CHECK(index.valid);
+    NEOS_CHECK_EQUAL(index.codePoints, 15u + 1u + 1u + 20u + 1u + 1u);
+    NEOS_CHECK_EQUAL(index.lineStarts.size(), 3u);
+    NEOS_CHECK_EQUAL(index.lineStarts[1], 18u);
+    NEOS_CHECK_EQUAL(index.lineStarts[2], 39u);
+    NEOS_CHECK_EQUAL(index.position(text, 40u).line, 2u);
+    NEOS_CHECK_EQUAL(index.position(text, 17u).column, 16u);
+}